@@ -0,0 +1,393 @@
+/*
+ * Lua binding for LLVM C API.
+ * Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+ *
+ * This file is part of llb.
+ *
+ * llb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * llb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with llb. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <lauxlib.h>
+#include <lua.h>
+#include <lualib.h>
+
+#include <llvm-c/Core.h>
+
+#include "batch.h"
+#include "core.h"
+
+#define OUTOFMEMORY ("out of memory")
+
+// serialized tables may nest up to MAXDEPTH levels
+#define MAXDEPTH (64)
+
+// ==================================================
+//
+// a growing byte buffer
+//
+// ==================================================
+struct buffer {
+    char* data;
+    size_t len;
+    size_t cap;
+};
+
+static int put(struct buffer* b, const void* p, size_t n) {
+    if (b->len + n > b->cap) {
+        size_t cap = b->cap == 0 ? 64 : b->cap;
+        while (cap < b->len + n) {
+            cap *= 2;
+        }
+        char* data = realloc(b->data, cap);
+        if (data == NULL) {
+            return -1;
+        }
+        b->data = data;
+        b->cap = cap;
+    }
+    memcpy(b->data + b->len, p, n);
+    b->len += n;
+    return 0;
+}
+
+static int puttag(struct buffer* b, char tag) {
+    return put(b, &tag, 1);
+}
+
+// ==================================================
+//
+// serializes the value at index i into b. supports nil, booleans,
+// numbers, strings and tables of them.
+// returns NULL on success, otherwise an error message.
+//
+// ==================================================
+static const char* serialize(lua_State* L, int i, struct buffer* b,
+    int depth) {
+    i = lua_absindex(L, i);
+    int err = 0;
+    switch (lua_type(L, i)) {
+        case LUA_TNIL:
+            err = puttag(b, 'n');
+            break;
+        case LUA_TBOOLEAN:
+            err = puttag(b, lua_toboolean(L, i) ? 't' : 'f');
+            break;
+        case LUA_TNUMBER:
+            if (lua_isinteger(L, i)) {
+                lua_Integer n = lua_tointeger(L, i);
+                err = puttag(b, 'i') || put(b, &n, sizeof(n));
+            } else {
+                lua_Number n = lua_tonumber(L, i);
+                err = puttag(b, 'd') || put(b, &n, sizeof(n));
+            }
+            break;
+        case LUA_TSTRING: {
+            size_t len;
+            const char* s = lua_tolstring(L, i, &len);
+            err = puttag(b, 's') || put(b, &len, sizeof(len)) ||
+                put(b, s, len);
+            break;
+        }
+        case LUA_TTABLE:
+            if (depth == MAXDEPTH) {
+                return "tables nested too deep";
+            }
+            if (!lua_checkstack(L, 2) || puttag(b, '{')) {
+                return OUTOFMEMORY;
+            }
+            lua_pushnil(L);
+            while (lua_next(L, i) != 0) {
+                const char* e = serialize(L, -2, b, depth + 1);
+                if (e == NULL) {
+                    e = serialize(L, -1, b, depth + 1);
+                }
+                if (e != NULL) {
+                    lua_pop(L, 2);
+                    return e;
+                }
+                lua_pop(L, 1);
+            }
+            err = puttag(b, '}');
+            break;
+        default:
+            return lua_pushfstring(
+                L, "cannot serialize a %s", luaL_typename(L, i));
+    }
+    return err ? OUTOFMEMORY : NULL;
+}
+
+// ==================================================
+//
+// pushes the value serialized at *p and moves *p past it.
+// the stack must have room for 2 values per nesting level.
+//
+// ==================================================
+static void deserialize(lua_State* L, const char** p) {
+    char tag = *(*p)++;
+    switch (tag) {
+        case 'n':
+            lua_pushnil(L);
+            break;
+        case 't':
+        case 'f':
+            lua_pushboolean(L, tag == 't');
+            break;
+        case 'i': {
+            lua_Integer n;
+            memcpy(&n, *p, sizeof(n));
+            *p += sizeof(n);
+            lua_pushinteger(L, n);
+            break;
+        }
+        case 'd': {
+            lua_Number n;
+            memcpy(&n, *p, sizeof(n));
+            *p += sizeof(n);
+            lua_pushnumber(L, n);
+            break;
+        }
+        case 's': {
+            size_t len;
+            memcpy(&len, *p, sizeof(len));
+            *p += sizeof(len);
+            lua_pushlstring(L, *p, len);
+            *p += len;
+            break;
+        }
+        case '{':
+            lua_newtable(L);
+            while (**p != '}') {
+                deserialize(L, p);
+                deserialize(L, p);
+                lua_rawset(L, -3);
+            }
+            (*p)++;
+            break;
+    }
+}
+
+// ==================================================
+//
+// the work shared by all threads of a batch.
+// threads claim the next path until all of them are processed.
+//
+// ==================================================
+struct result {
+    struct buffer value;
+    char* err;
+    int done;
+};
+
+struct job {
+    const char** paths;
+    unsigned n;
+    unsigned next;
+    struct buffer script;
+    const char* path;
+    const char* cpath;
+    struct result* results;
+};
+
+static unsigned claim(struct job* job) {
+    return __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+}
+
+static char* errstring(lua_State* L, int i) {
+    const char* err = lua_tostring(L, i);
+    return strdup(err != NULL ? err : "(error object is not a string)");
+}
+
+// ==================================================
+//
+// prepares the lua state of a worker: opens the libraries with the
+// package paths of the caller and leaves the function of batch.lua
+// that runs the script on a path.
+//
+// ==================================================
+static int setup(lua_State* L) {
+    struct job* job = lua_touserdata(L, 1);
+    luaL_openlibs(L);
+    lua_getglobal(L, "package");
+    if (job->path != NULL) {
+        lua_pushstring(L, job->path);
+        lua_setfield(L, -2, "path");
+    }
+    if (job->cpath != NULL) {
+        lua_pushstring(L, job->cpath);
+        lua_setfield(L, -2, "cpath");
+    }
+    lua_getglobal(L, "require");
+    lua_pushliteral(L, "batch");
+    lua_call(L, 1, 1);
+    lua_pushlstring(L, job->script.data, job->script.len);
+    lua_call(L, 1, 1);
+    return 1;
+}
+
+// ==================================================
+//
+// a worker thread, with its own lua state and so its own LLVM context
+//
+// ==================================================
+static void* worker(void* arg) {
+    struct job* job = arg;
+    lua_State* L = luaL_newstate();
+    if (L == NULL) {
+        return NULL;
+    }
+
+    lua_pushcfunction(L, setup);
+    lua_pushlightuserdata(L, job);
+    int failed = lua_pcall(L, 1, 1, 0) != LUA_OK;
+
+    for (unsigned i = claim(job); i < job->n; i = claim(job)) {
+        struct result* r = &job->results[i];
+        r->done = 1;
+        if (failed) {
+            r->err = errstring(L, 1);
+            continue;
+        }
+        lua_pushvalue(L, 1);
+        lua_pushstring(L, job->paths[i]);
+        if (lua_pcall(L, 1, 1, 0) != LUA_OK) {
+            r->err = errstring(L, -1);
+        } else {
+            const char* err = serialize(L, -1, &r->value, 0);
+            if (err != NULL) {
+                r->err = strdup(err);
+                free(r->value.data);
+                r->value.data = NULL;
+            }
+        }
+        lua_settop(L, 1);
+    }
+
+    lua_close(L);
+    return NULL;
+}
+
+static int dumpwriter(lua_State* L, const void* p, size_t n, void* b) {
+    return put(b, p, n);
+}
+
+// ==================================================
+//
+// runs a script on many IR or bitcode files in parallel.
+// receives the list of paths, the script (lua source or a function
+// without upvalues) and the number of threads, the number of online
+// cores by default. each thread has its own lua state and LLVM context.
+// the script is called with the module and its path, and its result
+// is copied back to the caller.
+// returns the list of results and the table of error messages, both
+// indexed like the paths.
+//
+// ==================================================
+int batch_run(lua_State* L) {
+    luaL_checktype(L, 1, LUA_TTABLE);
+    long ncores = sysconf(_SC_NPROCESSORS_ONLN);
+    lua_Integer nthreads = luaL_optinteger(L, 3, ncores > 0 ? ncores : 1);
+    luaL_argcheck(L, nthreads > 0, 3, "expected a positive number");
+
+    struct job job;
+    memset(&job, 0, sizeof(job));
+    job.n = luaL_len(L, 1);
+    job.paths = lua_newuserdata(L, job.n * sizeof(const char*));
+    job.results = lua_newuserdata(L, job.n * sizeof(struct result));
+    memset(job.results, 0, job.n * sizeof(struct result));
+    for (unsigned i = 0; i < job.n; i++) {
+        lua_geti(L, 1, i + 1);
+        luaL_argcheck(L, lua_type(L, -1) == LUA_TSTRING, 1,
+            "expected a list of paths");
+        // still referenced by the list
+        job.paths[i] = lua_tostring(L, -1);
+        lua_pop(L, 1);
+    }
+
+    if (lua_getglobal(L, "package") == LUA_TTABLE) {
+        lua_getfield(L, -1, "path");
+        job.path = lua_tostring(L, -1);
+        lua_getfield(L, -2, "cpath");
+        job.cpath = lua_tostring(L, -1);
+    }
+
+    if (lua_type(L, 2) == LUA_TFUNCTION) {
+        luaL_argcheck(L, !lua_iscfunction(L, 2), 2, "expected a lua function");
+        const char* upvalue;
+        for (int k = 1; (upvalue = lua_getupvalue(L, 2, k)) != NULL; k++) {
+            lua_pop(L, 1);
+            luaL_argcheck(L, strcmp(upvalue, "_ENV") == 0, 2,
+                "the function must not have upvalues");
+        }
+        lua_pushvalue(L, 2);
+        int err = lua_dump(L, dumpwriter, &job.script, 0);
+        lua_pop(L, 1);
+        if (err) {
+            free(job.script.data);
+            return throw(L, "out of memory");
+        }
+    } else {
+        size_t len;
+        const char* s = luaL_checklstring(L, 2, &len);
+        if (put(&job.script, s, len)) {
+            free(job.script.data);
+            return throw(L, "out of memory");
+        }
+    }
+
+    if (nthreads > job.n) {
+        nthreads = job.n;
+    }
+    pthread_t* threads = malloc(nthreads * sizeof(pthread_t));
+    lua_Integer started = 0;
+    if (threads != NULL) {
+        for (lua_Integer t = 0; t < nthreads; t++) {
+            if (pthread_create(&threads[started], NULL, worker, &job) == 0) {
+                started++;
+            }
+        }
+    }
+    if (started == 0) {
+        worker(&job);
+    }
+    for (lua_Integer t = 0; t < started; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    free(threads);
+    free(job.script.data);
+
+    luaL_checkstack(L, 2 * MAXDEPTH + 8, "too many nested tables");
+    lua_createtable(L, job.n, 0);
+    lua_newtable(L);
+    for (unsigned i = 0; i < job.n; i++) {
+        struct result* r = &job.results[i];
+        if (r->value.data != NULL) {
+            const char* p = r->value.data;
+            deserialize(L, &p);
+            lua_seti(L, -3, i + 1);
+        } else {
+            lua_pushstring(L, r->err != NULL ? r->err
+                    : r->done               ? OUTOFMEMORY
+                                            : "not processed");
+            lua_seti(L, -2, i + 1);
+        }
+        free(r->value.data);
+        free(r->err);
+    }
+    return 2;
+}
@@ -0,0 +1,26 @@
+/*
+ * Lua binding for LLVM C API.
+ * Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+ *
+ * This file is part of llb.
+ *
+ * llb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * llb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with llb. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LLB_BATCH_H
+#define _LLB_BATCH_H
+
+extern int batch_run(lua_State*);
+
+#endif
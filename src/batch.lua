@@ -0,0 +1,41 @@
+--
+-- Lua binding for LLVM C API.
+-- Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+--
+-- This file is part of llb.
+--
+-- llb is free software: you can redistribute it and/or modify
+-- it under the terms of the GNU General Public License as published by
+-- the Free Software Foundation, either version 2 of the License, or
+-- (at your option) any later version.
+--
+-- llb is distributed in the hope that it will be useful,
+-- but WITHOUT ANY WARRANTY; without even the implied warranty of
+-- MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+-- GNU General Public License for more details.
+--
+-- You should have received a copy of the GNU General Public License
+-- along with llb. If not, see <http://www.gnu.org/licenses/>.
+--
+
+--
+-- worker side of llb.batch.
+-- receives the script, as source or as a dumped function, and returns
+-- the function that runs it on a file: the script is called with the
+-- module and its path, and the module is disposed afterwards.
+--
+local llb = require "llb"
+
+return function(script)
+    local f, err = load(script, "=batch", "bt")
+    if not f then error(err, 0) end
+    return function(path)
+        local load = path:match("%.ll$") and llb.load_ir or llb.load_bitcode
+        local module, err = load(path)
+        if not module then error(err, 0) end
+        local ok, res = pcall(f, module, path)
+        llb.dispose(module)
+        if not ok then error(res, 0) end
+        return res
+    end
+end
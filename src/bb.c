@@ -27,15 +27,16 @@
 
 #include "bb.h"
 #include "core.h"
+#include "function.h"
 #include "instruction.h"
 
 // ==================================================
 //
-// instantiates a new basic block object
+// instantiates a new basic block object, or reuses the interned one
 //
 // ==================================================
 int bb_new(lua_State* L, LLVMBasicBlockRef bb) {
-    newuserdata(L, bb, LLB_BASICBLOCK);
+    pushobject(L, bb, LLB_BASICBLOCK);
     return 1;
 }
 
@@ -50,6 +51,16 @@ int bb_pointer(lua_State* L) {
     return 1;
 }
 
+// ==================================================
+//
+// gets the function that contains a basic block
+//
+// ==================================================
+int bb_parent(lua_State* L) {
+    LLVMBasicBlockRef bb = getbasicblock(L, 1);
+    return function_new(L, LLVMGetBasicBlockParent(bb));
+}
+
 // ==================================================
 //
 // gets all successors of a basic block
@@ -62,7 +73,7 @@ int bb_successors(lua_State* L) {
     unsigned n_succs = LLVMGetNumSuccessors(terminator);
     lua_newtable(L);
     for (int i = 0; i < n_succs; i++) {
-        lua_pushlightuserdata(L, LLVMGetSuccessor(terminator, i));
+        bb_new(L, LLVMGetSuccessor(terminator, i));
         lua_seti(L, -2, i + 1);
     }
 
@@ -87,6 +98,52 @@ int bb_instructions(lua_State* L) {
     return 1;
 }
 
+// ==================================================
+//
+// iterator of bb_each_instruction.
+// the next instruction is fetched before yielding the current one,
+// so the loop body may delete the current instruction.
+//
+// ==================================================
+static int bb_instruction_iterator(lua_State* L) {
+    LLVMValueRef inst = lua_touserdata(L, lua_upvalueindex(1));
+    if (inst == NULL) {
+        return 0;
+    }
+    lua_pushlightuserdata(L, LLVMGetNextInstruction(inst));
+    lua_replace(L, lua_upvalueindex(1));
+    return instruction_new(L, inst);
+}
+
+// ==================================================
+//
+// iterates over the instructions of a basic block without building
+// a table: for instruction in bb:each_instruction() do ... end
+//
+// ==================================================
+int bb_each_instruction(lua_State* L) {
+    LLVMBasicBlockRef bb = getbasicblock(L, 1);
+    lua_pushlightuserdata(L, LLVMGetFirstInstruction(bb));
+    lua_pushcclosure(L, bb_instruction_iterator, 1);
+    return 1;
+}
+
+// ==================================================
+//
+// counts the instructions of a basic block
+//
+// ==================================================
+int bb_instruction_count(lua_State* L) {
+    LLVMBasicBlockRef bb = getbasicblock(L, 1);
+    lua_Integer n = 0;
+    for (LLVMValueRef inst = LLVMGetFirstInstruction(bb); inst != NULL;
+         inst = LLVMGetNextInstruction(inst)) {
+        n++;
+    }
+    lua_pushinteger(L, n);
+    return 1;
+}
+
 // ==================================================
 //
 // gets the first instruction of a basic block
@@ -121,6 +178,7 @@ int bb_build_phi(lua_State* L) {
     LLVMPositionBuilderBefore(builder, LLVMGetFirstInstruction(bb));
     LLVMTypeRef type = LLVMGetAllocatedType(alloca);
     LLVMValueRef phi = LLVMBuildPhi(builder, type, "phi");
+    touchinstruction(L, phi);
     return instruction_new(L, phi);
 }
 
@@ -136,6 +194,7 @@ int bb_replace_between(lua_State* L) {
     LLVMValueRef value = getinstruction(L, 4);
     LLVMValueRef alloca = getinstruction(L, 5);
     LLVMValueRef instruction = a1;
+    touchfunction(L, LLVMGetBasicBlockParent(getbasicblock(L, 1)), 0);
     while (instruction && instruction != a2) {
         LLVMValueRef next = LLVMGetNextInstruction(instruction);
         if (LLVMIsALoadInst(instruction) &&
@@ -23,8 +23,11 @@
 
 extern int bb_new(lua_State*, LLVMBasicBlockRef);
 extern int bb_pointer(lua_State*);
+extern int bb_parent(lua_State*);
 extern int bb_successors(lua_State*);
 extern int bb_instructions(lua_State*);
+extern int bb_each_instruction(lua_State*);
+extern int bb_instruction_count(lua_State*);
 extern int bb_first_instruction(lua_State*);
 extern int bb_last_instruction(lua_State*);
 extern int bb_build_phi(lua_State*);
@@ -18,72 +18,113 @@
 -- along with llb. If not, see <http://www.gnu.org/licenses/>.
 --
 
+local core = require "core"
 local set = require "set"
+local stats = require "stats"
 
 local bbgraph = {}
 bbgraph.__index = bbgraph
 
+-- graphs with at least DENSE nodes use bitsets instead of sets
+bbgraph.DENSE = 512
+
+-- dense[bbgraph] => true if the graph uses bitsets
+local dense = setmetatable({}, {__mode = "k"})
+
+-- dfcache[bbgraph] => df, computed once per graph and dropped by edge updates
+local dfcache = setmetatable({}, {__mode = "k"})
+
+-- domtrees[bbgraph] => domtree, kept up to date by the edge updates
+local domtrees = setmetatable({}, {__mode = "k"})
+
 --
 -- receives a list of basic blocks
 -- returns the predecessors-sucessors graph for the basic blocks
+-- node sets are bitsets (see bitset.c) if "isdense" is true,
+-- by default only graphs with at least bbgraph.DENSE nodes are dense
 --
-function bbgraph.new(bbs)
+function bbgraph.new(bbs, isdense)
+    local start = stats.clock()
     local nodes = {}
     setmetatable(nodes, bbgraph)
 
-    local auxmap = {}
+    if isdense == nil then
+        isdense = #bbs >= bbgraph.DENSE
+    end
+    dense[nodes] = isdense or nil
 
     for i, bb in ipairs(bbs) do
-        nodes[i] = {
-            ref = bb,
-            successors = set.new(),
-            predecessors = set.new()
-        }
-        auxmap[bb:pointer()] = nodes[i]
+        nodes[i] = {ref = bb}
     end
 
     for _, node in ipairs(nodes) do
-        for _, s in ipairs(node.ref:successors()) do
-            local successor = auxmap[s]
-            node.successors:add(successor)
-            successor.predecessors:add(node)
+        node.successors = nodes:newset()
+        node.predecessors = nodes:newset()
+    end
+
+    -- the edges come from the native graph, see function:cfg
+    if #bbs > 0 then
+        local cfg = bbs[1]:parent():cfg(bbs)
+        local succoff, succ = cfg.succoff, cfg.succ
+        for i, node in ipairs(nodes) do
+            for k = succoff[i], succoff[i + 1] - 1 do
+                local successor = nodes[succ[k]]
+                node.successors:add(successor)
+                successor.predecessors:add(node)
+            end
         end
     end
 
+    stats.time("bbgraph.new", start)
     return nodes
 end
 
+--
+-- returns a new set of nodes of the graph
+--
+function bbgraph:newset(...)
+    if dense[self] then
+        return core.bitset(self, ...)
+    end
+    return set.new(...)
+end
+
 --
 -- dominators
 -- returns {node: set<node>}
 -- dom[a] = {a, b, c} ===> "a", b" and "c" dominate "a"
+-- derived on demand from the dominator tree
 --
-function bbgraph:dom()
-    local all = set.new(table.unpack(self))
-    local entry = self[1] -- TODO: is the entry bb always bbgraph[1]?
-    local regular_nodes = all - {entry}
+function bbgraph:dom(idom)
+    local idom = idom or self:idom()
+    local start = stats.clock()
+    local entry = self[1]
     local dom = {}
 
-    dom[entry] = set.new(entry)
-    for n in pairs(regular_nodes) do
-        dom[n] = all
+    local all = self:newset()
+    for _, n in ipairs(self) do
+        all:add(n)
     end
 
-    repeat
-        local change = false
-        for n in pairs(regular_nodes) do
-            local D = all
-            for p in pairs(n.predecessors) do
-                D = D * dom[p]
-            end
-            D = D + {n}
-            if D ~= dom[n] then
-                change = true
-                dom[n] = D
+    local function build(n)
+        if dom[n] == nil then
+            if n == entry then
+                dom[n] = self:newset(n)
+            elseif idom[n] == nil then
+                -- unreachable from the entry, dominated by every node
+                dom[n] = all
+            else
+                dom[n] = build(idom[n]) + {n}
             end
         end
-    until not change
+        return dom[n]
+    end
 
+    for _, n in ipairs(self) do
+        build(n)
+    end
+
+    stats.time("bbgraph.dom", start)
     return dom
 end
 
@@ -93,57 +134,96 @@ end
 -- dom[a] = {b, c} ===> b" and "c" strictly dominate "a"
 --
 function bbgraph:sdom(dom)
-    local sdom
-    if dom ~= nil then
-        sdom = {}
-        for k, v in pairs(dom) do
-            sdom[k] = v:copy()
-            sdom[k]:remove(k)
-        end
-    else
-        sdom = self:dom()
-        for k, v in pairs(sdom) do
-            v:remove(k)
-        end
+    local dom = dom or self:dom()
+    local sdom = {}
+    for k, v in pairs(dom) do
+        sdom[k] = v:copy()
+        sdom[k]:remove(k)
     end
     return sdom
 end
 
+--
+-- returns the dominator tree of the graph (see domtree.c), built once
+-- and updated incrementally by bbgraph:insert_edge and delete_edge
+--
+function bbgraph:domtree()
+    if domtrees[self] == nil and #self > 0 then
+        local refs = {}
+        for i, node in ipairs(self) do
+            refs[i] = node.ref
+        end
+        domtrees[self] = self[1].ref:parent():domtree(refs)
+    end
+    return domtrees[self]
+end
+
 --
 -- imediate dominance
 -- returns {node: node}
--- TODO
+-- read from the dominator tree of the graph, in one call
 --
-function bbgraph:idom(dom)
-    local dom = dom or self:dom()
-
-    local all = set.new(table.unpack(self))
-    local entry = self[1] -- entry basic block is always bbgraph[1]
-    local regular_nodes = all - {entry}
+function bbgraph:idom()
     local idom = {}
-
-    for n in pairs(all) do
-        idom[n] = dom[n] - {n}
+    if #self == 0 then
+        return idom
     end
 
-    for n in pairs(regular_nodes) do
-        for s in pairs(idom[n]) do
-            for t in pairs(idom[n] - {s}) do
-                if idom[s]:contains(t) then
-                    idom[n] = idom[n] - {t}
-                end
-            end
-        end
+    local start = stats.clock()
+    local domtree = self:domtree()
+    local nodes = {}
+    for _, node in ipairs(self) do
+        nodes[node.ref] = node
+    end
+    local blocks = domtree:blocks()
+    for i, j in pairs(domtree:idoms()) do
+        idom[nodes[blocks[i]]] = nodes[blocks[j]]
     end
 
-    idom[entry] = nil
+    stats.time("bbgraph.idom", start)
+    return idom
+end
 
-    for k, v in pairs(idom) do
-        idom[k] = v:pop()
-        assert(v:is_empty())
+--
+-- adds a node for the basic block bb, without edges
+-- the nodes of dense graphs are fixed, they are the bitsets' universe
+--
+function bbgraph:add_block(bb)
+    assert(not dense[self], "can not add blocks to a dense graph")
+    local node = {ref = bb}
+    node.successors = self:newset()
+    node.predecessors = self:newset()
+    table.insert(self, node)
+    return node
+end
+
+--
+-- adds the edge a -> b, updating the dominator tree in place
+-- the caller changes the terminator of a.ref first, the graph stays
+-- the function's cached analysis (see function:preserve)
+--
+function bbgraph:insert_edge(a, b)
+    a.successors:add(b)
+    b.predecessors:add(a)
+    dfcache[self] = nil
+    if domtrees[self] ~= nil then
+        domtrees[self]:insert_edge(a.ref, b.ref)
     end
+    a.ref:parent():preserve("bbgraph", self)
+end
 
-    return idom
+--
+-- removes the edge a -> b, the dominator tree is recomputed when it's
+-- next queried. as insert_edge, it's called after the change.
+--
+function bbgraph:delete_edge(a, b)
+    a.successors:remove(b)
+    b.predecessors:remove(a)
+    dfcache[self] = nil
+    if domtrees[self] ~= nil then
+        domtrees[self]:delete_edge(a.ref, b.ref)
+    end
+    a.ref:parent():preserve("bbgraph", self)
 end
 
 --
@@ -156,7 +236,7 @@ function bbgraph:ridom(idom)
     local ridom = {}
 
     for _, v in ipairs(self) do
-        ridom[v] = set.new()
+        ridom[v] = self:newset()
     end
 
     for k, v in pairs(idom) do
@@ -167,30 +247,40 @@ function bbgraph:ridom(idom)
 end
 
 --
--- dominance frontier (FIXME: this is the quadratic version)
--- TODO
+-- dominance frontier
+-- returns {node: set<node>}
+-- computed natively from the dominator tree by function:df,
+-- once per graph. the returned sets must not be modified.
 --
-function bbgraph:df(dom, sdom)
-    local dom = dom or self:dom()
-    local sdom = sdom or self:sdom(dom)
+function bbgraph:df()
+    if dfcache[self] ~= nil then
+        return dfcache[self]
+    end
 
+    local start = stats.clock()
     local df = {}
-
     for _, x in ipairs(self) do
-        df[x] = set.new()
+        df[x] = self:newset()
+    end
+    if #self == 0 then
+        return df
     end
 
-    -- df(x) = {y | (z E predecessors(y) | x C dom[z]) and (x !C sdom[y])}
-    for _, x in ipairs(self) do
-        for _, y in ipairs(self) do
-            for z in pairs(y.predecessors) do
-                if dom[z]:contains(x) and not sdom[y]:contains(x) then
-                    df[x]:add(y)
-                end
-            end
+    local refs = {}
+    for i, node in ipairs(self) do
+        refs[i] = node.ref
+    end
+
+    -- the frontier comes from function:df, as CSR arrays
+    local off, frontier = self[1].ref:parent():df(refs)
+    for i, x in ipairs(self) do
+        for k = off[i], off[i + 1] - 1 do
+            df[x]:add(self[frontier[k]])
         end
     end
 
+    dfcache[self] = df
+    stats.time("bbgraph.df", start)
     return df
 end
 
@@ -201,36 +291,80 @@ end
 --
 function bbgraph:dfplus(s, df)
     local df = df or self:df()
+    local start = stats.clock()
+    local dfp = self:newset()
+
+    -- worklist, every node enters it at most once
+    -- S U {entry} => DF(S) => DF(DF(S)) => ...
+    local work, queued = {self[1]}, {[self[1]] = true}
+    for x in pairs(s) do
+        if not queued[x] then
+            queued[x] = true
+            table.insert(work, x)
+        end
+    end
+
+    while #work > 0 do
+        local x = table.remove(work)
+        for y in pairs(df[x]) do
+            dfp:add(y)
+            if not queued[y] then
+                queued[y] = true
+                table.insert(work, y)
+            end
+        end
+    end
+
+    stats.time("bbgraph.dfplus", start)
+    return dfp
+end
+
+--
+-- places the phi-functions of many variables in a single pass (Cytron et al.)
+-- receives defs[v] => set<node>, the nodes that assign to each variable "v"
+-- returns {node: set<v>}, the variables that need a phi-function in each node
+--
+function bbgraph:phis(defs, df)
+    local df = df or self:df()
+    local start = stats.clock()
+    local entry = self[1]
 
-    local s = s:copy()
-    s:add(self[1]) -- adds "entry" block
+    local phis = {}
+    for _, node in ipairs(self) do
+        phis[node] = set.new()
+    end
 
-    local function dfunion(s)
-        local dfu = set.new()
+    -- hasphi[node] == i and queued[node] == i are relative to the i-th
+    -- variable, so the marks never need to be cleared between variables
+    local hasphi, queued = {}, {}
+    local i = 0
+    for v, s in pairs(defs) do
+        i = i + 1
+        local work = {entry}
+        queued[entry] = i
         for x in pairs(s) do
-            dfu = dfu + df[x]
+            if queued[x] ~= i then
+                queued[x] = i
+                table.insert(work, x)
+            end
         end
-        return dfu
-    end
-
-    -- S = bbgraph
-    -- DF(S) = U[x E S] DF(x)
-    local dfs = dfunion(s)
-
-    -- DF[1](S) = DF(S)
-    -- DF[i+1](S) = DF(S U DF[i](S))
-    -- DF+(S) = lim[i => infinity] DF[i](S)
-    local dfp = dfs
-    repeat
-        local change = false
-        local D = dfunion(s + dfp)
-        if D ~= dfp then
-            dfp = D
-            change = true
+        while #work > 0 do
+            local x = table.remove(work)
+            for y in pairs(df[x]) do
+                if hasphi[y] ~= i then
+                    hasphi[y] = i
+                    phis[y]:add(v)
+                    if queued[y] ~= i then
+                        queued[y] = i
+                        table.insert(work, y)
+                    end
+                end
+            end
         end
-    until not change
+    end
 
-    return dfp
+    stats.time("bbgraph.phis", start)
+    return phis
 end
 
 --
@@ -0,0 +1,485 @@
+/*
+ * Lua binding for LLVM C API.
+ * Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+ *
+ * This file is part of llb.
+ *
+ * llb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * llb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with llb. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <lauxlib.h>
+#include <lua.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <llvm-c/Core.h>
+
+#include "bitset.h"
+#include "core.h"
+
+// ==================================================
+//
+// dense set of the integers [1, n], or of the elements of a
+// "universe" list, where element universe[i] is the bit i.
+// the universe is kept as the userdata's user value and its
+// reverse index (element => i) is cached on the registry.
+//
+// ==================================================
+struct bitset {
+    lua_Integer n;
+    lua_Integer count;
+    uint64_t words[];
+};
+
+#define NWORDS(n) (((n) + 63) / 64)
+#define BIT(i) ((uint64_t)1 << ((i) % 64))
+
+#define LLB_BITSET_INDEX ("__llb_bitset_index")
+
+// clang-format off
+
+#define getbitset(L, i) \
+    ((struct bitset*)luaL_checkudata(L, i, LLB_BITSET))
+
+// clang-format on
+
+static struct bitset* newbitset(lua_State* L, lua_Integer n) {
+    size_t size = sizeof(struct bitset) + NWORDS(n) * sizeof(uint64_t);
+    struct bitset* s = lua_newuserdata(L, size);
+    memset(s, 0, size);
+    s->n = n;
+    luaL_setmetatable(L, LLB_BITSET);
+    return s;
+}
+
+static void recount(struct bitset* s) {
+    s->count = 0;
+    for (lua_Integer w = 0; w < NWORDS(s->n); w++) {
+        s->count += __builtin_popcountll(s->words[w]);
+    }
+}
+
+// ==================================================
+//
+// pushes the reverse index of a universe list, building it if needed
+//
+// ==================================================
+static void pushindex(lua_State* L, int universe) {
+    universe = lua_absindex(L, universe);
+    if (lua_getfield(L, LUA_REGISTRYINDEX, LLB_BITSET_INDEX) == LUA_TNIL) {
+        lua_pop(L, 1);
+        lua_newtable(L);
+        lua_newtable(L);
+        lua_pushstring(L, "k");
+        lua_setfield(L, -2, "__mode");
+        lua_setmetatable(L, -2);
+        lua_pushvalue(L, -1);
+        lua_setfield(L, LUA_REGISTRYINDEX, LLB_BITSET_INDEX);
+    }
+    lua_pushvalue(L, universe);
+    if (lua_gettable(L, -2) == LUA_TNIL) {
+        lua_pop(L, 1);
+        lua_newtable(L);
+        lua_Integer n = luaL_len(L, universe);
+        for (lua_Integer i = 1; i <= n; i++) {
+            lua_geti(L, universe, i);
+            lua_pushinteger(L, i);
+            lua_settable(L, -3);
+        }
+        lua_pushvalue(L, universe);
+        lua_pushvalue(L, -2);
+        lua_settable(L, -4);
+    }
+    lua_remove(L, -2);
+}
+
+// ==================================================
+//
+// returns the 0-based bit of the element at index e, or -1 if
+// the element doesn't belong to the set's universe
+//
+// ==================================================
+static lua_Integer tobit(lua_State* L, int set, int e) {
+    set = lua_absindex(L, set);
+    e = lua_absindex(L, e);
+    struct bitset* s = lua_touserdata(L, set);
+    lua_Integer i;
+    if (lua_getuservalue(L, set) == LUA_TTABLE) {
+        pushindex(L, -1);
+        lua_pushvalue(L, e);
+        int isnum;
+        lua_gettable(L, -2);
+        i = lua_tointegerx(L, -1, &isnum);
+        lua_pop(L, 3);
+        if (!isnum) {
+            return -1;
+        }
+    } else {
+        lua_pop(L, 1);
+        int isnum;
+        i = lua_tointegerx(L, e, &isnum);
+        if (!isnum) {
+            return -1;
+        }
+    }
+    return i >= 1 && i <= s->n ? i - 1 : -1;
+}
+
+// ==================================================
+//
+// pushes the element of a 0-based bit
+//
+// ==================================================
+static void pushelement(lua_State* L, int set, lua_Integer bit) {
+    if (lua_getuservalue(L, set) == LUA_TTABLE) {
+        lua_geti(L, -1, bit + 1);
+        lua_remove(L, -2);
+    } else {
+        lua_pop(L, 1);
+        lua_pushinteger(L, bit + 1);
+    }
+}
+
+// ==================================================
+//
+// returns a bitset for the value at index i, that must share the
+// universe of the bitset at index set. lists of elements are
+// converted to a new bitset, which replaces them on the stack.
+//
+// ==================================================
+static struct bitset* checkoperand(lua_State* L, int set, int i) {
+    struct bitset* s = lua_touserdata(L, set);
+    if (lua_type(L, i) == LUA_TTABLE) {
+        struct bitset* t = newbitset(L, s->n);
+        lua_getuservalue(L, set);
+        lua_setuservalue(L, -2);
+        lua_Integer n = luaL_len(L, i);
+        for (lua_Integer k = 1; k <= n; k++) {
+            lua_geti(L, i, k);
+            lua_Integer bit = tobit(L, -2, -1);
+            lua_pop(L, 1);
+            if (bit < 0) {
+                luaL_error(L, "element not in the bitset universe");
+            }
+            t->words[bit / 64] |= BIT(bit);
+        }
+        recount(t);
+        lua_replace(L, i);
+        return t;
+    }
+
+    struct bitset* t = getbitset(L, i);
+    lua_getuservalue(L, set);
+    lua_getuservalue(L, i);
+    int same = lua_rawequal(L, -1, -2) && t->n == s->n;
+    lua_pop(L, 2);
+    if (!same) {
+        luaL_error(L, "bitsets with different universes");
+    }
+    return t;
+}
+
+// ==================================================
+//
+// creates a new bitset.
+// receives the capacity n or an universe list, plus the initial elements
+//
+// ==================================================
+int bitset_new(lua_State* L) {
+    int top = lua_gettop(L);
+    lua_Integer n;
+    if (lua_type(L, 1) == LUA_TTABLE) {
+        n = luaL_len(L, 1);
+    } else {
+        n = luaL_checkinteger(L, 1);
+        luaL_argcheck(L, n >= 0, 1, "negative capacity");
+    }
+
+    struct bitset* s = newbitset(L, n);
+    if (lua_type(L, 1) == LUA_TTABLE) {
+        pushindex(L, 1);
+        lua_pop(L, 1);
+        lua_pushvalue(L, 1);
+        lua_setuservalue(L, -2);
+    }
+
+    int set = lua_gettop(L);
+    for (int i = 2; i <= top; i++) {
+        lua_Integer bit = tobit(L, set, i);
+        if (bit < 0) {
+            return throw(L, "element not in the bitset universe");
+        }
+        s->words[bit / 64] |= BIT(bit);
+    }
+    recount(s);
+    return 1;
+}
+
+// ==================================================
+//
+// pushes a bitset over the universe list at index universe, with the
+// elements of the native set words, where bit i is universe[i + 1].
+// used by the native analyses to return their sets.
+//
+// ==================================================
+void bitset_push(lua_State* L, int universe, const uint64_t* words) {
+    universe = lua_absindex(L, universe);
+    struct bitset* s = newbitset(L, luaL_len(L, universe));
+    memcpy(s->words, words, NWORDS(s->n) * sizeof(uint64_t));
+    recount(s);
+    pushindex(L, universe);
+    lua_pop(L, 1);
+    lua_pushvalue(L, universe);
+    lua_setuservalue(L, -2);
+}
+
+// ==================================================
+//
+// copies a bitset, returns the new copy
+//
+// ==================================================
+int bitset_copy(lua_State* L) {
+    struct bitset* s = getbitset(L, 1);
+    struct bitset* t = newbitset(L, s->n);
+    memcpy(t->words, s->words, NWORDS(s->n) * sizeof(uint64_t));
+    t->count = s->count;
+    lua_getuservalue(L, 1);
+    lua_setuservalue(L, -2);
+    return 1;
+}
+
+// ==================================================
+//
+// adds n items to the bitset
+//
+// ==================================================
+int bitset_add(lua_State* L) {
+    struct bitset* s = getbitset(L, 1);
+    int top = lua_gettop(L);
+    for (int i = 2; i <= top; i++) {
+        lua_Integer bit = tobit(L, 1, i);
+        if (bit < 0) {
+            return throw(L, "element not in the bitset universe");
+        }
+        if (!(s->words[bit / 64] & BIT(bit))) {
+            s->words[bit / 64] |= BIT(bit);
+            s->count++;
+        }
+    }
+    return 0;
+}
+
+// ==================================================
+//
+// removes n items from the bitset
+//
+// ==================================================
+int bitset_remove(lua_State* L) {
+    struct bitset* s = getbitset(L, 1);
+    int top = lua_gettop(L);
+    for (int i = 2; i <= top; i++) {
+        lua_Integer bit = tobit(L, 1, i);
+        if (bit >= 0 && (s->words[bit / 64] & BIT(bit))) {
+            s->words[bit / 64] &= ~BIT(bit);
+            s->count--;
+        }
+    }
+    return 0;
+}
+
+// ==================================================
+//
+// pops the item with the lowest index from the bitset
+//
+// ==================================================
+int bitset_pop(lua_State* L) {
+    struct bitset* s = getbitset(L, 1);
+    for (lua_Integer w = 0; w < NWORDS(s->n); w++) {
+        if (s->words[w] != 0) {
+            lua_Integer bit = w * 64 + __builtin_ctzll(s->words[w]);
+            s->words[w] &= s->words[w] - 1;
+            s->count--;
+            pushelement(L, 1, bit);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// ==================================================
+//
+// is the bitset empty?
+//
+// ==================================================
+int bitset_is_empty(lua_State* L) {
+    struct bitset* s = getbitset(L, 1);
+    lua_pushboolean(L, s->count == 0);
+    return 1;
+}
+
+// ==================================================
+//
+// returns the size of the bitset
+//
+// ==================================================
+int bitset_size(lua_State* L) {
+    struct bitset* s = getbitset(L, 1);
+    lua_pushinteger(L, s->count);
+    return 1;
+}
+
+// ==================================================
+//
+// does it contains these elements?
+//
+// ==================================================
+int bitset_contains(lua_State* L) {
+    struct bitset* s = getbitset(L, 1);
+    int top = lua_gettop(L);
+    for (int i = 2; i <= top; i++) {
+        lua_Integer bit = tobit(L, 1, i);
+        if (bit < 0 || !(s->words[bit / 64] & BIT(bit))) {
+            lua_pushboolean(L, 0);
+            return 1;
+        }
+    }
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// ==================================================
+//
+// in place union, intersection and difference. return the bitset itself.
+//
+// ==================================================
+int bitset_union(lua_State* L) {
+    struct bitset* s = getbitset(L, 1);
+    struct bitset* t = checkoperand(L, 1, 2);
+    for (lua_Integer w = 0; w < NWORDS(s->n); w++) {
+        s->words[w] |= t->words[w];
+    }
+    recount(s);
+    lua_settop(L, 1);
+    return 1;
+}
+
+int bitset_intersect(lua_State* L) {
+    struct bitset* s = getbitset(L, 1);
+    struct bitset* t = checkoperand(L, 1, 2);
+    for (lua_Integer w = 0; w < NWORDS(s->n); w++) {
+        s->words[w] &= t->words[w];
+    }
+    recount(s);
+    lua_settop(L, 1);
+    return 1;
+}
+
+int bitset_difference(lua_State* L) {
+    struct bitset* s = getbitset(L, 1);
+    struct bitset* t = checkoperand(L, 1, 2);
+    for (lua_Integer w = 0; w < NWORDS(s->n); w++) {
+        s->words[w] &= ~t->words[w];
+    }
+    recount(s);
+    lua_settop(L, 1);
+    return 1;
+}
+
+// ==================================================
+//
+// __eq metamethod
+// are the bitsets exactly the same?
+//
+// ==================================================
+int bitset_eq(lua_State* L) {
+    struct bitset* s = getbitset(L, 1);
+    struct bitset* t = getbitset(L, 2);
+    lua_getuservalue(L, 1);
+    lua_getuservalue(L, 2);
+    int eq = lua_rawequal(L, -1, -2) && s->n == t->n &&
+             s->count == t->count &&
+             memcmp(s->words, t->words, NWORDS(s->n) * sizeof(uint64_t)) == 0;
+    lua_pushboolean(L, eq);
+    return 1;
+}
+
+// ==================================================
+//
+// __add, __mul and __sub metamethods
+// return a new bitset with the union, intersection or difference
+//
+// ==================================================
+static int arith(lua_State* L, int (*op)(lua_State*)) {
+    // the bitset operand may be on either side of the operator
+    if (luaL_testudata(L, 1, LLB_BITSET) == NULL) {
+        luaL_checkudata(L, 2, LLB_BITSET);
+        checkoperand(L, 2, 1);
+    }
+    lua_settop(L, 2);
+    lua_pushcfunction(L, op);
+    lua_pushcfunction(L, bitset_copy);
+    lua_pushvalue(L, 1);
+    lua_call(L, 1, 1);
+    lua_pushvalue(L, 2);
+    lua_call(L, 2, 1);
+    return 1;
+}
+
+int bitset_add_mm(lua_State* L) {
+    return arith(L, bitset_union);
+}
+
+int bitset_mul_mm(lua_State* L) {
+    return arith(L, bitset_intersect);
+}
+
+int bitset_sub_mm(lua_State* L) {
+    return arith(L, bitset_difference);
+}
+
+// ==================================================
+//
+// __pairs metamethod
+// iterates over the elements as (element, element), like set.lua
+//
+// ==================================================
+static int bitset_iterator(lua_State* L) {
+    struct bitset* s = lua_touserdata(L, lua_upvalueindex(1));
+    lua_Integer bit = lua_tointeger(L, lua_upvalueindex(2));
+    while (bit < s->n) {
+        uint64_t word = s->words[bit / 64] >> (bit % 64);
+        if (word == 0) {
+            bit = (bit / 64 + 1) * 64;
+            continue;
+        }
+        bit += __builtin_ctzll(word);
+        lua_pushinteger(L, bit + 1);
+        lua_replace(L, lua_upvalueindex(2));
+        pushelement(L, lua_upvalueindex(1), bit);
+        lua_pushvalue(L, -1);
+        return 2;
+    }
+    return 0;
+}
+
+int bitset_pairs(lua_State* L) {
+    getbitset(L, 1);
+    lua_pushvalue(L, 1);
+    lua_pushinteger(L, 0);
+    lua_pushcclosure(L, bitset_iterator, 2);
+    lua_pushvalue(L, 1);
+    lua_pushnil(L);
+    return 3;
+}
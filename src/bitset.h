@@ -0,0 +1,43 @@
+/*
+ * Lua binding for LLVM C API.
+ * Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+ *
+ * This file is part of llb.
+ *
+ * llb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * llb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with llb. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _LLB_BITSET_H
+#define _LLB_BITSET_H
+
+extern int bitset_new(lua_State*);
+extern int bitset_copy(lua_State*);
+extern int bitset_add(lua_State*);
+extern int bitset_remove(lua_State*);
+extern int bitset_pop(lua_State*);
+extern int bitset_is_empty(lua_State*);
+extern int bitset_size(lua_State*);
+extern int bitset_contains(lua_State*);
+extern int bitset_union(lua_State*);
+extern int bitset_intersect(lua_State*);
+extern int bitset_difference(lua_State*);
+extern int bitset_eq(lua_State*);
+extern int bitset_add_mm(lua_State*);
+extern int bitset_mul_mm(lua_State*);
+extern int bitset_sub_mm(lua_State*);
+extern int bitset_pairs(lua_State*);
+extern void bitset_push(lua_State*, int, const uint64_t*);
+
+#endif
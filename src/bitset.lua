@@ -0,0 +1,67 @@
+--
+-- Lua binding for LLVM C API.
+-- Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+--
+-- This file is part of llb.
+--
+-- llb is free software: you can redistribute it and/or modify
+-- it under the terms of the GNU General Public License as published by
+-- the Free Software Foundation, either version 2 of the License, or
+-- (at your option) any later version.
+--
+-- llb is distributed in the hope that it will be useful,
+-- but WITHOUT ANY WARRANTY; without even the implied warranty of
+-- MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+-- GNU General Public License for more details.
+--
+-- You should have received a copy of the GNU General Public License
+-- along with llb. If not, see <http://www.gnu.org/licenses/>.
+--
+
+--
+-- Lua side of the dense bitset class (see bitset.c)
+-- mirrors the parts of set.lua that aren't implemented natively
+--
+
+local set = require "set"
+
+local bitset = {}
+
+--
+-- returns a mapped copy of the bitset
+-- the mapped elements may be outside the universe, so the copy is a set
+--
+function bitset:map(f)
+    local new = set.new()
+    for e in pairs(self) do
+        new:add(f(e))
+    end
+    return new
+end
+
+--
+-- returns a filtered copy of the bitset
+--
+function bitset:filter(f)
+    local new = self:copy()
+    for e in pairs(self) do
+        if not f(e) then
+            new:remove(e)
+        end
+    end
+    return new
+end
+
+--
+-- __tostring metamethod
+-- returns the bitset in a human understandable way
+--
+function bitset:__tostring()
+    local t = {}
+    for e in pairs(self) do
+        table.insert(t, tostring(type(e) == "table" and e.ref or e))
+    end
+    return "{" .. table.concat(t, ", ") .. "}"
+end
+
+return bitset
@@ -0,0 +1,934 @@
+/*
+ * Lua binding for LLVM C API.
+ * Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+ *
+ * This file is part of llb.
+ *
+ * llb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * llb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with llb. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <lauxlib.h>
+#include <lua.h>
+
+#include <llvm-c/Core.h>
+
+#include "bb.h"
+#include "builder.h"
+#include "core.h"
+#include "function.h"
+#include "instruction.h"
+
+// ==================================================
+//
+// types are written as in the IR: i32, double, i8*, [4 x i32], {i32, i1}
+//
+// ==================================================
+#define MAXFIELDS (64)
+
+static LLVMTypeRef parsetype(LLVMContextRef ctx, const char** s);
+
+static const char* skipspaces(const char* s) {
+    while (isspace((unsigned char)*s)) {
+        s++;
+    }
+    return s;
+}
+
+static int match(const char** s, const char* word) {
+    size_t len = strlen(word);
+    if (strncmp(*s, word, len) != 0 || isalnum((unsigned char)(*s)[len])) {
+        return 0;
+    }
+    *s += len;
+    return 1;
+}
+
+static LLVMTypeRef parsestruct(LLVMContextRef ctx, const char** s) {
+    LLVMTypeRef fields[MAXFIELDS];
+    unsigned n = 0;
+    *s = skipspaces(*s + 1);
+    while (**s != '}') {
+        if (n > 0 && *(*s)++ != ',') {
+            return NULL;
+        }
+        if (n == MAXFIELDS || (fields[n++] = parsetype(ctx, s)) == NULL) {
+            return NULL;
+        }
+        *s = skipspaces(*s);
+    }
+    (*s)++;
+    return LLVMStructTypeInContext(ctx, fields, n, 0);
+}
+
+static LLVMTypeRef parsetype(LLVMContextRef ctx, const char** s) {
+    LLVMTypeRef type = NULL;
+    char* end;
+    *s = skipspaces(*s);
+    if (**s == 'i' && isdigit((unsigned char)(*s)[1])) {
+        unsigned long width = strtoul(*s + 1, &end, 10);
+        if (width == 0 || width > (1 << 23)) {
+            return NULL;
+        }
+        type = LLVMIntTypeInContext(ctx, width);
+        *s = end;
+    } else if (match(s, "half")) {
+        type = LLVMHalfTypeInContext(ctx);
+    } else if (match(s, "float")) {
+        type = LLVMFloatTypeInContext(ctx);
+    } else if (match(s, "double")) {
+        type = LLVMDoubleTypeInContext(ctx);
+    } else if (match(s, "void")) {
+        return LLVMVoidTypeInContext(ctx);
+    } else if (**s == '[') {
+        unsigned long n = strtoul(*s + 1, &end, 10);
+        *s = skipspaces(end);
+        if (!match(s, "x") || (type = parsetype(ctx, s)) == NULL) {
+            return NULL;
+        }
+        *s = skipspaces(*s);
+        if (*(*s)++ != ']') {
+            return NULL;
+        }
+        type = LLVMArrayType(type, n);
+    } else if (**s == '{') {
+        type = parsestruct(ctx, s);
+    }
+    if (type == NULL) {
+        return NULL;
+    }
+    for (*s = skipspaces(*s); **s == '*'; *s = skipspaces(*s + 1)) {
+        type = LLVMPointerType(type, 0);
+    }
+    return type;
+}
+
+// ==================================================
+//
+// gets the type written in s, raises an error if it is invalid
+//
+// ==================================================
+LLVMTypeRef builder_type(lua_State* L, LLVMContextRef ctx, const char* s) {
+    const char* p = s;
+    LLVMTypeRef type = parsetype(ctx, &p);
+    if (type == NULL || *skipspaces(p) != '\0') {
+        luaL_error(L, "invalid type '%s'", s);
+    }
+    return type;
+}
+
+// ==================================================
+//
+// the operands of an instruction, either the arguments of a builder
+// method or the fields of an instruction of builder:emit.
+// in emit, integers refer to the results of the previous instructions,
+// or to the inputs when negative, and blocks are kept as values.
+//
+// ==================================================
+struct operands {
+    lua_State* L;
+    LLVMBuilderRef builder;
+    LLVMContextRef ctx;
+    int bulk;
+    int args;    // index of the first argument, or of the instruction table
+    int n;       // number of operands
+    int index;   // number of the instruction in emit
+    int seen;    // number of the results it may refer to
+    int inputs;  // index of the inputs table, 0 if there are none
+    int input;   // the last operand pushed was taken from the inputs
+    LLVMValueRef* results;
+};
+
+static void operanderror(struct operands* o, int k, const char* msg) {
+    if (o->bulk) {
+        luaL_error(o->L, "instruction %d, operand %d: %s", o->index, k, msg);
+    }
+    luaL_argerror(o->L, o->args + k - 1, msg);
+}
+
+// pushes the k-th operand, resolving references to the inputs
+static int pushoperand(struct operands* o, int k) {
+    lua_State* L = o->L;
+    o->input = 0;
+    if (!o->bulk) {
+        lua_pushvalue(L, o->args + k - 1);
+        return lua_type(L, -1);
+    }
+    int t = lua_geti(L, o->args, k + 1);
+    if (t == LUA_TNUMBER && lua_isinteger(L, -1) && lua_tointeger(L, -1) < 0) {
+        if (o->inputs == 0) {
+            operanderror(o, k, "no inputs");
+        }
+        lua_Integer i = -lua_tointeger(L, -1);
+        lua_pop(L, 1);
+        t = lua_geti(L, o->inputs, i);
+        o->input = 1;
+    }
+    return t;
+}
+
+// the result referred by the integer on the top of the stack
+static LLVMValueRef reference(struct operands* o, int k) {
+    lua_Integer r = lua_tointeger(o->L, -1);
+    if (r < 1 || r > o->seen || o->results[r - 1] == NULL) {
+        operanderror(o, k, "invalid reference");
+    }
+    return o->results[r - 1];
+}
+
+// numbers taken from the inputs are constants, never references
+static int isreference(struct operands* o) {
+    return o->bulk && !o->input && lua_isinteger(o->L, -1);
+}
+
+// the number on the top of the stack as a constant of type
+static LLVMValueRef constant(struct operands* o, int k, LLVMTypeRef type) {
+    lua_State* L = o->L;
+    if (type == NULL) {
+        operanderror(o, k, "constant without a type");
+    }
+    switch (LLVMGetTypeKind(type)) {
+        case LLVMIntegerTypeKind:
+            if (!lua_isinteger(L, -1)) {
+                operanderror(o, k, "expected an integer");
+            }
+            return LLVMConstInt(type, lua_tointeger(L, -1), 1);
+        case LLVMHalfTypeKind:
+        case LLVMFloatTypeKind:
+        case LLVMDoubleTypeKind:
+            return LLVMConstReal(type, lua_tonumber(L, -1));
+        case LLVMPointerTypeKind:
+            if (lua_tonumber(L, -1) != 0) {
+                operanderror(o, k, "pointer constants must be 0");
+            }
+            return LLVMConstPointerNull(type);
+        default:
+            operanderror(o, k, "type without constants");
+            return NULL;
+    }
+}
+
+// ==================================================
+//
+// gets the k-th operand as a value. numbers are constants of type hint.
+//
+// ==================================================
+static LLVMValueRef value(struct operands* o, int k, LLVMTypeRef hint) {
+    lua_State* L = o->L;
+    LLVMValueRef v = NULL;
+    switch (pushoperand(o, k)) {
+        case LUA_TNUMBER:
+            v = isreference(o) ? reference(o, k) : constant(o, k, hint);
+            break;
+        case LUA_TBOOLEAN:
+            v = LLVMConstInt(
+                LLVMInt1TypeInContext(o->ctx), lua_toboolean(L, -1), 0);
+            break;
+        case LUA_TUSERDATA:
+            if (luaL_testudata(L, -1, LLB_INSTRUCTION) != NULL ||
+                luaL_testudata(L, -1, LLB_FUNCTION) != NULL) {
+                v = *(LLVMValueRef*)lua_touserdata(L, -1);
+            }
+            break;
+    }
+    if (v == NULL || LLVMValueIsBasicBlock(v)) {
+        operanderror(o, k, "expected a value");
+    }
+    lua_pop(L, 1);
+    return v;
+}
+
+// ==================================================
+//
+// gets the k-th operand as a value of type t. LLVM takes operands of
+// the wrong type and builds invalid IR, so they are errors here.
+//
+// ==================================================
+static LLVMValueRef typed(struct operands* o, int k, LLVMTypeRef t) {
+    LLVMValueRef v = value(o, k, t);
+    if (LLVMTypeOf(v) != t) {
+        char* name = LLVMPrintTypeToString(t);
+        lua_pushfstring(o->L, "expected a value of type %s", name);
+        LLVMDisposeMessage(name);
+        operanderror(o, k, lua_tostring(o->L, -1));
+    }
+    return v;
+}
+
+// the kind of a type, or of the elements of a vector type
+static LLVMTypeKind scalarkind(LLVMValueRef v) {
+    LLVMTypeRef t = LLVMTypeOf(v);
+    if (LLVMGetTypeKind(t) == LLVMVectorTypeKind) {
+        t = LLVMGetElementType(t);
+    }
+    return LLVMGetTypeKind(t);
+}
+
+static int isfloating(LLVMValueRef v) {
+    switch (scalarkind(v)) {
+        case LLVMHalfTypeKind:
+        case LLVMBFloatTypeKind:
+        case LLVMFloatTypeKind:
+        case LLVMDoubleTypeKind:
+        case LLVMX86_FP80TypeKind:
+        case LLVMFP128TypeKind:
+        case LLVMPPC_FP128TypeKind:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// raises an error unless v is an integer, or a floating point value
+static void checkkind(struct operands* o, int k, LLVMValueRef v, int fp) {
+    if (fp && !isfloating(v)) {
+        operanderror(o, k, "expected a floating point value");
+    } else if (!fp && scalarkind(v) != LLVMIntegerTypeKind) {
+        operanderror(o, k, "expected an integer value");
+    }
+}
+
+static int isconstant(struct operands* o, int k) {
+    int t = pushoperand(o, k);
+    int constant = t == LUA_TNUMBER && !isreference(o);
+    lua_pop(o->L, 1);
+    return constant;
+}
+
+// gets the k-th and (k+1)-th operands, that have the same type
+static void pair(
+    struct operands* o, int k, LLVMValueRef* a, LLVMValueRef* b) {
+    if (isconstant(o, k)) {
+        *b = value(o, k + 1, NULL);
+        *a = typed(o, k, LLVMTypeOf(*b));
+    } else {
+        *a = value(o, k, NULL);
+        *b = typed(o, k + 1, LLVMTypeOf(*a));
+    }
+}
+
+static LLVMBasicBlockRef block(struct operands* o, int k) {
+    lua_State* L = o->L;
+    LLVMBasicBlockRef bb = NULL;
+    int t = pushoperand(o, k);
+    if (t == LUA_TNUMBER && isreference(o)) {
+        LLVMValueRef v = reference(o, k);
+        if (LLVMValueIsBasicBlock(v)) {
+            bb = LLVMValueAsBasicBlock(v);
+        }
+    } else if (t == LUA_TUSERDATA &&
+        luaL_testudata(L, -1, LLB_BASICBLOCK) != NULL) {
+        bb = *(LLVMBasicBlockRef*)lua_touserdata(L, -1);
+    }
+    if (bb == NULL) {
+        operanderror(o, k, "expected a basic block");
+    }
+    lua_pop(L, 1);
+    return bb;
+}
+
+static const char* string(struct operands* o, int k) {
+    if (pushoperand(o, k) != LUA_TSTRING) {
+        operanderror(o, k, "expected a string");
+    }
+    // the instruction table, or the stack, keeps the string alive
+    const char* s = lua_tostring(o->L, -1);
+    lua_pop(o->L, 1);
+    return s;
+}
+
+static LLVMTypeRef type(struct operands* o, int k) {
+    return builder_type(o->L, o->ctx, string(o, k));
+}
+
+static int option(struct operands* o, int k, const char* const names[]) {
+    const char* s = string(o, k);
+    for (int i = 0; names[i] != NULL; i++) {
+        if (strcmp(names[i], s) == 0) {
+            return i;
+        }
+    }
+    operanderror(o, k, lua_pushfstring(o->L, "invalid option '%s'", s));
+    return 0;
+}
+
+static void checkcount(struct operands* o, int min, int max) {
+    if (o->n < min || (max >= 0 && o->n > max)) {
+        operanderror(o, o->n + 1, "wrong number of operands");
+    }
+}
+
+static LLVMTypeRef pointee(struct operands* o, int k, LLVMValueRef ptr) {
+    LLVMTypeRef type = LLVMTypeOf(ptr);
+    if (LLVMGetTypeKind(type) != LLVMPointerTypeKind) {
+        operanderror(o, k, "expected a pointer");
+    }
+    return LLVMGetElementType(type);
+}
+
+static LLVMValueRef currentfunction(struct operands* o) {
+    LLVMBasicBlockRef bb = LLVMGetInsertBlock(o->builder);
+    if (bb == NULL) {
+        luaL_error(o->L, "builder is not positioned");
+    }
+    return LLVMGetBasicBlockParent(bb);
+}
+
+// ==================================================
+//
+// build functions, one for each group of instructions of BUILDER_OPS
+//
+// ==================================================
+static LLVMValueRef buildbinop(struct operands* o, int opcode) {
+    checkcount(o, 2, 2);
+    LLVMValueRef a, b;
+    pair(o, 1, &a, &b);
+    checkkind(o, 1, a,
+        opcode == LLVMFAdd || opcode == LLVMFSub || opcode == LLVMFMul ||
+            opcode == LLVMFDiv || opcode == LLVMFRem);
+    return LLVMBuildBinOp(o->builder, opcode, a, b, "");
+}
+
+static LLVMValueRef buildunop(struct operands* o, int opcode) {
+    checkcount(o, 1, 1);
+    LLVMValueRef v = value(o, 1, NULL);
+    checkkind(o, 1, v, opcode == LLVMFNeg);
+    switch (opcode) {
+        case LLVMFNeg:
+            return LLVMBuildFNeg(o->builder, v, "");
+        case LLVMSub:
+            return LLVMBuildNeg(o->builder, v, "");
+        default:
+            return LLVMBuildNot(o->builder, v, "");
+    }
+}
+
+static const char* const ipredicates[] = {
+    "eq", "ne", "ugt", "uge", "ult", "ule", "sgt", "sge", "slt", "sle", NULL};
+
+static LLVMValueRef buildicmp(struct operands* o, int unused) {
+    checkcount(o, 3, 3);
+    int predicate = option(o, 1, ipredicates) + LLVMIntEQ;
+    LLVMValueRef a, b;
+    pair(o, 2, &a, &b);
+    if (scalarkind(a) != LLVMPointerTypeKind) {
+        checkkind(o, 2, a, 0);
+    }
+    return LLVMBuildICmp(o->builder, predicate, a, b, "");
+}
+
+// in the order of LLVMRealPredicate
+static const char* const fpredicates[] = {"false", "oeq", "ogt", "oge",
+    "olt", "ole", "one", "ord", "uno", "ueq", "ugt", "uge", "ult", "ule",
+    "une", "true", NULL};
+
+static LLVMValueRef buildfcmp(struct operands* o, int unused) {
+    checkcount(o, 3, 3);
+    int predicate = option(o, 1, fpredicates);
+    LLVMValueRef a, b;
+    pair(o, 2, &a, &b);
+    checkkind(o, 2, a, 1);
+    return LLVMBuildFCmp(o->builder, predicate, a, b, "");
+}
+
+static LLVMValueRef buildselect(struct operands* o, int unused) {
+    checkcount(o, 3, 3);
+    LLVMValueRef condition = typed(o, 1, LLVMInt1TypeInContext(o->ctx));
+    LLVMValueRef a, b;
+    pair(o, 2, &a, &b);
+    return LLVMBuildSelect(o->builder, condition, a, b, "");
+}
+
+static LLVMValueRef buildalloca(struct operands* o, int unused) {
+    checkcount(o, 1, 1);
+    return LLVMBuildAlloca(o->builder, type(o, 1), "");
+}
+
+static LLVMValueRef buildload(struct operands* o, int unused) {
+    checkcount(o, 1, 2);
+    LLVMValueRef ptr = value(o, 1, NULL);
+    LLVMTypeRef t = o->n == 2 ? type(o, 2) : pointee(o, 1, ptr);
+    return LLVMBuildLoad2(o->builder, t, ptr, "");
+}
+
+static LLVMValueRef buildstore(struct operands* o, int unused) {
+    checkcount(o, 2, 2);
+    LLVMValueRef ptr = value(o, 2, NULL);
+    LLVMValueRef v = typed(o, 1, pointee(o, 2, ptr));
+    return LLVMBuildStore(o->builder, v, ptr);
+}
+
+static LLVMValueRef buildgep(struct operands* o, int inbounds) {
+    checkcount(o, 2, -1);
+    LLVMValueRef ptr = value(o, 1, NULL);
+    LLVMTypeRef t = pointee(o, 1, ptr);
+    LLVMValueRef indices[o->n - 1];
+    for (int k = 2; k <= o->n; k++) {
+        indices[k - 2] = value(o, k, LLVMInt32TypeInContext(o->ctx));
+    }
+    if (inbounds) {
+        return LLVMBuildInBoundsGEP2(
+            o->builder, t, ptr, indices, o->n - 1, "");
+    }
+    return LLVMBuildGEP2(o->builder, t, ptr, indices, o->n - 1, "");
+}
+
+static LLVMValueRef buildcast(struct operands* o, int opcode) {
+    checkcount(o, 2, 2);
+    LLVMValueRef v = value(o, 1, NULL);
+    return LLVMBuildCast(o->builder, opcode, v, type(o, 2), "");
+}
+
+static LLVMValueRef buildcall(struct operands* o, int unused) {
+    checkcount(o, 1, -1);
+    LLVMValueRef f = value(o, 1, NULL);
+    LLVMTypeRef t = LLVMIsAFunction(f) ? LLVMGlobalGetValueType(f)
+                                       : pointee(o, 1, f);
+    if (LLVMGetTypeKind(t) != LLVMFunctionTypeKind) {
+        operanderror(o, 1, "expected a function");
+    }
+    unsigned nparams = LLVMCountParamTypes(t);
+    unsigned nargs = o->n - 1;
+    if (nargs < nparams || (nargs > nparams && !LLVMIsFunctionVarArg(t))) {
+        operanderror(o, o->n, "wrong number of arguments");
+    }
+    LLVMTypeRef params[nparams + 1];
+    LLVMValueRef args[nargs + 1];
+    LLVMGetParamTypes(t, params);
+    for (unsigned i = 0; i < nargs; i++) {
+        args[i] = i < nparams ? typed(o, i + 2, params[i])
+                              : value(o, i + 2, NULL);
+    }
+    return LLVMBuildCall2(o->builder, t, f, args, nargs, "");
+}
+
+// the number of incoming pairs of value and block, from the second
+// operand on
+static int npairs(struct operands* o) {
+    if (o->n % 2 == 0) {
+        operanderror(o, o->n, "expected a value and a block");
+    }
+    return (o->n - 1) / 2;
+}
+
+static void readincoming(struct operands* o, LLVMTypeRef type,
+    LLVMValueRef* values, LLVMBasicBlockRef* blocks, int n) {
+    for (int i = 0; i < n; i++) {
+        values[i] = typed(o, 2 * i + 2, type);
+        blocks[i] = block(o, 2 * i + 3);
+    }
+}
+
+static void addincoming(struct operands* o, LLVMValueRef phi) {
+    int n = npairs(o);
+    LLVMValueRef values[n + 1];
+    LLVMBasicBlockRef blocks[n + 1];
+    readincoming(o, LLVMTypeOf(phi), values, blocks, n);
+    LLVMAddIncoming(phi, values, blocks, n);
+}
+
+// in emit, incoming values are added after all instructions
+static LLVMValueRef buildphi(struct operands* o, int unused) {
+    checkcount(o, 1, -1);
+    LLVMTypeRef t = type(o, 1);
+    if (o->bulk) {
+        return LLVMBuildPhi(o->builder, t, "");
+    }
+    int n = npairs(o);
+    LLVMValueRef values[n + 1];
+    LLVMBasicBlockRef blocks[n + 1];
+    readincoming(o, t, values, blocks, n);
+    LLVMValueRef phi = LLVMBuildPhi(o->builder, t, "");
+    LLVMAddIncoming(phi, values, blocks, n);
+    return phi;
+}
+
+static LLVMValueRef buildbr(struct operands* o, int unused) {
+    checkcount(o, 1, 1);
+    return LLVMBuildBr(o->builder, block(o, 1));
+}
+
+static LLVMValueRef buildcondbr(struct operands* o, int unused) {
+    checkcount(o, 3, 3);
+    LLVMValueRef condition = typed(o, 1, LLVMInt1TypeInContext(o->ctx));
+    return LLVMBuildCondBr(o->builder, condition, block(o, 2), block(o, 3));
+}
+
+static LLVMValueRef buildswitch(struct operands* o, int unused) {
+    checkcount(o, 2, -1);
+    if (o->n % 2 != 0) {
+        operanderror(o, o->n, "expected a value and a block");
+    }
+    LLVMValueRef v = value(o, 1, NULL);
+    checkkind(o, 1, v, 0);
+    LLVMBasicBlockRef otherwise = block(o, 2);
+    int n = (o->n - 2) / 2;
+    LLVMValueRef cases[n + 1];
+    LLVMBasicBlockRef blocks[n + 1];
+    for (int i = 0; i < n; i++) {
+        cases[i] = typed(o, 2 * i + 3, LLVMTypeOf(v));
+        if (!LLVMIsAConstantInt(cases[i])) {
+            operanderror(o, 2 * i + 3, "expected a constant");
+        }
+        blocks[i] = block(o, 2 * i + 4);
+    }
+    LLVMValueRef s = LLVMBuildSwitch(o->builder, v, otherwise, n);
+    for (int i = 0; i < n; i++) {
+        LLVMAddCase(s, cases[i], blocks[i]);
+    }
+    return s;
+}
+
+static LLVMValueRef buildret(struct operands* o, int unused) {
+    checkcount(o, 0, 1);
+    LLVMTypeRef t = LLVMGetReturnType(
+        LLVMGlobalGetValueType(currentfunction(o)));
+    int isvoid = LLVMGetTypeKind(t) == LLVMVoidTypeKind;
+    if (o->n == 0 && !isvoid) {
+        operanderror(o, 1, "expected a return value");
+    } else if (o->n == 1 && isvoid) {
+        operanderror(o, 1, "the function returns void");
+    }
+    if (o->n == 0) {
+        return LLVMBuildRetVoid(o->builder);
+    }
+    return LLVMBuildRet(o->builder, typed(o, 1, t));
+}
+
+static LLVMValueRef buildunreachable(struct operands* o, int unused) {
+    checkcount(o, 0, 0);
+    return LLVMBuildUnreachable(o->builder);
+}
+
+static LLVMValueRef buildconst(struct operands* o, int unused) {
+    checkcount(o, 2, 2);
+    LLVMTypeRef t = type(o, 1);
+    // integers are literals, not references
+    if (o->bulk) {
+        lua_geti(o->L, o->args, 3);
+    } else {
+        lua_pushvalue(o->L, o->args + 1);
+    }
+    if (lua_type(o->L, -1) != LUA_TNUMBER) {
+        operanderror(o, 2, "expected a number");
+    }
+    LLVMValueRef v = constant(o, 2, t);
+    lua_pop(o->L, 1);
+    return v;
+}
+
+// a block appended to a function, to the current one by default
+static LLVMValueRef buildblock(struct operands* o, int unused) {
+    checkcount(o, 0, 1);
+    LLVMValueRef f = o->n == 1 ? value(o, 1, NULL) : currentfunction(o);
+    if (!LLVMIsAFunction(f)) {
+        operanderror(o, 1, "expected a function");
+    }
+    return LLVMBasicBlockAsValue(
+        LLVMAppendBasicBlockInContext(o->ctx, f, ""));
+}
+
+// positions at the end of a block, or before an instruction
+static LLVMValueRef buildposition(struct operands* o, int before) {
+    checkcount(o, 1, 1);
+    if (before) {
+        LLVMValueRef v = value(o, 1, NULL);
+        if (!LLVMIsAInstruction(v)) {
+            operanderror(o, 1, "expected an instruction");
+        }
+        LLVMPositionBuilderBefore(o->builder, v);
+    } else {
+        LLVMPositionBuilderAtEnd(o->builder, block(o, 1));
+    }
+    return NULL;
+}
+
+// ==================================================
+//
+// the table of instructions, indexed by the OP_ enum
+//
+// ==================================================
+#define BUILDER_ENUM(name, fn, arg) OP_##name,
+enum { BUILDER_OPS(BUILDER_ENUM) NOPS };
+#undef BUILDER_ENUM
+
+struct op {
+    const char* name;
+    LLVMValueRef (*build)(struct operands*, int);
+    int arg;
+};
+
+#define BUILDER_OP(name, fn, arg) {#name, build##fn, arg},
+static const struct op ops[] = {BUILDER_OPS(BUILDER_OP)};
+#undef BUILDER_OP
+
+static void initoperands(lua_State* L, struct operands* o) {
+    o->L = L;
+    o->builder = getbuilder(L, 1);
+    // the module of a builder is its user value
+    lua_getuservalue(L, 1);
+    o->ctx = LLVMGetModuleContext(getmodule(L, -1));
+    lua_pop(L, 1);
+    o->bulk = 0;
+    o->index = 0;
+    o->seen = 0;
+    o->inputs = 0;
+    o->input = 0;
+    o->results = NULL;
+}
+
+// bumps the epochs of the function of a new block or instruction
+static void touch(lua_State* L, LLVMValueRef v) {
+    if (v == NULL) {
+        return;
+    }
+    if (LLVMValueIsBasicBlock(v)) {
+        LLVMBasicBlockRef bb = LLVMValueAsBasicBlock(v);
+        touchfunction(L, LLVMGetBasicBlockParent(bb), 1);
+    } else if (LLVMIsAInstruction(v)) {
+        touchinstruction(L, v);
+    }
+}
+
+static int pushresult(lua_State* L, LLVMValueRef v) {
+    if (v == NULL) {
+        return 0;
+    }
+    if (LLVMValueIsBasicBlock(v)) {
+        return bb_new(L, LLVMValueAsBasicBlock(v));
+    }
+    if (LLVMIsAFunction(v)) {
+        return function_new(L, v);
+    }
+    return instruction_new(L, v);
+}
+
+// ==================================================
+//
+// builds an instruction with the arguments of a builder method.
+// numbers are constants of the type of the other operands. operands
+// of another type than the instruction takes are errors, raised
+// before anything is built.
+//
+// ==================================================
+static int method(lua_State* L, int op) {
+    struct operands o;
+    initoperands(L, &o);
+    o.args = 2;
+    o.n = lua_gettop(L) - 1;
+    LLVMValueRef v = ops[op].build(&o, ops[op].arg);
+    touch(L, v);
+    return pushresult(L, v);
+}
+
+#define BUILDER_METHOD(name, fn, arg) \
+    int builder_##name(lua_State* L) {  \
+        return method(L, OP_##name);    \
+    }
+BUILDER_OPS(BUILDER_METHOD)
+#undef BUILDER_METHOD
+
+// ==================================================
+//
+// gets the block the builder is positioned at
+//
+// ==================================================
+int builder_insert_block(lua_State* L) {
+    LLVMBuilderRef builder = getbuilder(L, 1);
+    LLVMBasicBlockRef bb = LLVMGetInsertBlock(builder);
+    if (bb == NULL) {
+        lua_pushnil(L);
+        return 1;
+    }
+    return bb_new(L, bb);
+}
+
+// the opcode of the instruction on the top of the stack
+static int checkop(struct operands* o) {
+    lua_State* L = o->L;
+    if (lua_geti(L, -1, 1) != LUA_TSTRING) {
+        luaL_error(L, "instruction %d: expected an opcode", o->index);
+    }
+    lua_getfield(L, LUA_REGISTRYINDEX, LLB_BUILDEROPS);
+    lua_pushvalue(L, -2);
+    if (lua_rawget(L, -2) != LUA_TNUMBER) {
+        luaL_error(L, "instruction %d: invalid opcode '%s'", o->index,
+            lua_tostring(L, -3));
+    }
+    int op = lua_tointeger(L, -1);
+    lua_pop(L, 3);
+    return op;
+}
+
+static void checkinstruction(struct operands* o, int program, int i) {
+    o->index = i;
+    if (lua_geti(o->L, program, i) != LUA_TTABLE) {
+        luaL_error(o->L, "instruction %d: expected a table", i);
+    }
+    o->args = lua_gettop(o->L);
+    o->n = luaL_len(o->L, -1) - 1;
+}
+
+// ==================================================
+//
+// builds the n instructions of the program at index 2, in protected
+// mode: receives the arguments of emit and the operands, whose
+// results are set as the instructions are built
+//
+// ==================================================
+static int emitprogram(lua_State* L) {
+    struct operands* o = lua_touserdata(L, 5);
+    lua_Integer n = luaL_len(L, 2);
+    int top = lua_gettop(L);
+
+    for (lua_Integer i = 1; i <= n; i++) {
+        checkinstruction(o, 2, i);
+        o->seen = i - 1;
+        int op = checkop(o);
+        o->results[i - 1] = ops[op].build(o, ops[op].arg);
+        lua_settop(L, top);
+        touch(L, o->results[i - 1]);
+    }
+
+    // any result may be incoming to a phi
+    o->seen = n;
+    for (lua_Integer i = 1; i <= n; i++) {
+        if (o->results[i - 1] != NULL && LLVMIsAPHINode(o->results[i - 1])) {
+            checkinstruction(o, 2, i);
+            if (checkop(o) == OP_phi) {
+                addincoming(o, o->results[i - 1]);
+            }
+            lua_settop(L, top);
+        }
+    }
+    return 0;
+}
+
+// ==================================================
+//
+// removes what a failed emit built: the uses of its results are
+// replaced by undef, then its instructions and blocks are deleted
+//
+// ==================================================
+static void rollback(struct operands* o, lua_Integer n) {
+    for (lua_Integer i = 0; i < n; i++) {
+        LLVMValueRef v = o->results[i];
+        if (v != NULL && LLVMIsAInstruction(v) &&
+            LLVMGetTypeKind(LLVMTypeOf(v)) != LLVMVoidTypeKind) {
+            LLVMReplaceAllUsesWith(v, LLVMGetUndef(LLVMTypeOf(v)));
+        }
+    }
+    for (lua_Integer i = n - 1; i >= 0; i--) {
+        LLVMValueRef v = o->results[i];
+        if (v != NULL && LLVMIsAInstruction(v)) {
+            LLVMInstructionEraseFromParent(v);
+        }
+    }
+    for (lua_Integer i = n - 1; i >= 0; i--) {
+        LLVMValueRef v = o->results[i];
+        if (v != NULL && LLVMValueIsBasicBlock(v)) {
+            LLVMDeleteBasicBlock(LLVMValueAsBasicBlock(v));
+        }
+    }
+    LLVMClearInsertionPosition(o->builder);
+}
+
+// ==================================================
+//
+// emits a program, an array of instructions, in a single call:
+// builder:emit({{"block"}, {"position", 1}, {"add", -1, -2}, {"ret", 3}},
+//     {x, y})
+// an instruction is an opcode, the name of a builder method, and its
+// operands. integers refer to the results of the previous instructions,
+// negative integers to the inputs, an optional array of objects.
+// other numbers, including the ones in the inputs, and the integers
+// of const, are literals.
+// the incoming values and blocks of phis may be later results.
+// the results of the instructions are stored in the optional results
+// table. returns the last result.
+// a program is built entirely or not at all: on an error, such as an
+// operand of the wrong type, the blocks and instructions it built are
+// deleted and the builder is left unpositioned.
+//
+// ==================================================
+int builder_emit(lua_State* L) {
+    struct operands o;
+    initoperands(L, &o);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    if (!lua_isnoneornil(L, 3)) {
+        luaL_checktype(L, 3, LUA_TTABLE);
+        o.inputs = 3;
+    }
+    int keep = !lua_isnoneornil(L, 4);
+    if (keep) {
+        luaL_checktype(L, 4, LUA_TTABLE);
+    }
+    lua_settop(L, 4);
+
+    lua_Integer n = luaL_len(L, 2);
+    // a userdata, so it is collected on errors
+    o.results = lua_newuserdata(L, n * sizeof(LLVMValueRef));
+    memset(o.results, 0, n * sizeof(LLVMValueRef));
+    o.bulk = 1;
+
+    lua_pushcfunction(L, emitprogram);
+    for (int i = 1; i <= 4; i++) {
+        lua_pushvalue(L, i);
+    }
+    lua_pushlightuserdata(L, &o);
+    if (lua_pcall(L, 5, 0, 0) != LUA_OK) {
+        rollback(&o, n);
+        return lua_error(L);
+    }
+
+    if (keep) {
+        for (lua_Integer i = 1; i <= n; i++) {
+            if (pushresult(L, o.results[i - 1])) {
+                lua_seti(L, 4, i);
+            }
+        }
+    }
+    return n > 0 ? pushresult(L, o.results[n - 1]) : 0;
+}
+
+// ==================================================
+//
+// __gc metamethod
+//
+// ==================================================
+int builder_gc(lua_State* L) {
+    LLVMBuilderRef* builder = luaL_checkudata(L, 1, LLB_BUILDER);
+    if (*builder != NULL) {
+        LLVMDisposeBuilder(*builder);
+        *builder = NULL;
+    }
+    return 0;
+}
+
+// ==================================================
+//
+// the opcodes of builder:emit, in the registry
+//
+// ==================================================
+void builder_open(lua_State* L) {
+    lua_createtable(L, 0, NOPS);
+    for (int i = 0; i < NOPS; i++) {
+        lua_pushinteger(L, i);
+        lua_setfield(L, -2, ops[i].name);
+    }
+    lua_setfield(L, LUA_REGISTRYINDEX, LLB_BUILDEROPS);
+}
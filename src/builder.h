@@ -0,0 +1,98 @@
+/*
+ * Lua binding for LLVM C API.
+ * Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+ *
+ * This file is part of llb.
+ *
+ * llb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * llb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with llb. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LLB_BUILDER_H
+#define _LLB_BUILDER_H
+
+// ==================================================
+//
+// the instructions of a builder, as (name, build function, argument).
+// build functions are named build<function>, in builder.c.
+// each one is a builder method and an opcode of builder:emit.
+//
+// ==================================================
+// clang-format off
+#define BUILDER_OPS(X)                                  \
+    X(add, binop, LLVMAdd)                              \
+    X(sub, binop, LLVMSub)                              \
+    X(mul, binop, LLVMMul)                              \
+    X(udiv, binop, LLVMUDiv)                            \
+    X(sdiv, binop, LLVMSDiv)                            \
+    X(urem, binop, LLVMURem)                            \
+    X(srem, binop, LLVMSRem)                            \
+    X(shl, binop, LLVMShl)                              \
+    X(lshr, binop, LLVMLShr)                            \
+    X(ashr, binop, LLVMAShr)                            \
+    X(band, binop, LLVMAnd)                             \
+    X(bor, binop, LLVMOr)                               \
+    X(bxor, binop, LLVMXor)                             \
+    X(fadd, binop, LLVMFAdd)                            \
+    X(fsub, binop, LLVMFSub)                            \
+    X(fmul, binop, LLVMFMul)                            \
+    X(fdiv, binop, LLVMFDiv)                            \
+    X(frem, binop, LLVMFRem)                            \
+    X(neg, unop, LLVMSub)                               \
+    X(fneg, unop, LLVMFNeg)                             \
+    X(bnot, unop, LLVMXor)                              \
+    X(icmp, icmp, 0)                                    \
+    X(fcmp, fcmp, 0)                                    \
+    X(select, select, 0)                                \
+    X(alloca, alloca, 0)                                \
+    X(load, load, 0)                                    \
+    X(store, store, 0)                                  \
+    X(gep, gep, 0)                                      \
+    X(inbounds_gep, gep, 1)                             \
+    X(trunc, cast, LLVMTrunc)                           \
+    X(zext, cast, LLVMZExt)                             \
+    X(sext, cast, LLVMSExt)                             \
+    X(fptoui, cast, LLVMFPToUI)                         \
+    X(fptosi, cast, LLVMFPToSI)                         \
+    X(uitofp, cast, LLVMUIToFP)                         \
+    X(sitofp, cast, LLVMSIToFP)                         \
+    X(fptrunc, cast, LLVMFPTrunc)                       \
+    X(fpext, cast, LLVMFPExt)                           \
+    X(ptrtoint, cast, LLVMPtrToInt)                     \
+    X(inttoptr, cast, LLVMIntToPtr)                     \
+    X(bitcast, cast, LLVMBitCast)                       \
+    X(call, call, 0)                                    \
+    X(phi, phi, 0)                                      \
+    X(br, br, 0)                                        \
+    X(cond_br, condbr, 0)                               \
+    X(switch, switch, 0)                                \
+    X(ret, ret, 0)                                      \
+    X(unreachable, unreachable, 0)                      \
+    X(const, const, 0)                                  \
+    X(block, block, 0)                                  \
+    X(position, position, 0)                            \
+    X(position_before, position, 1)
+// clang-format on
+
+#define BUILDER_DECLARE(name, fn, arg) \
+    extern int builder_##name(lua_State*);
+BUILDER_OPS(BUILDER_DECLARE)
+#undef BUILDER_DECLARE
+
+extern LLVMTypeRef builder_type(lua_State*, LLVMContextRef, const char*);
+extern int builder_insert_block(lua_State*);
+extern int builder_emit(lua_State*);
+extern int builder_gc(lua_State*);
+extern void builder_open(lua_State*);
+
+#endif
@@ -0,0 +1,282 @@
+/*
+ * Lua binding for LLVM C API.
+ * Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+ *
+ * This file is part of llb.
+ *
+ * llb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * llb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with llb. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdlib.h>
+
+#include <llvm-c/Core.h>
+
+#include "cfg.h"
+#include "stats.h"
+
+struct cfgkey {
+    LLVMBasicBlockRef bb;
+    unsigned i;
+};
+
+static int keycmp(const void* a, const void* b) {
+    LLVMBasicBlockRef x = ((const struct cfgkey*)a)->bb;
+    LLVMBasicBlockRef y = ((const struct cfgkey*)b)->bb;
+    return x < y ? -1 : x > y;
+}
+
+// ==================================================
+//
+// returns the index of a basic block, or CFG_UNDEF if
+// the block isn't part of the graph
+//
+// ==================================================
+unsigned cfg_index(const struct cfg* g, LLVMBasicBlockRef bb) {
+    struct cfgkey key = {bb, 0};
+    struct cfgkey* found =
+        bsearch(&key, g->keys, g->n, sizeof(struct cfgkey), keycmp);
+    return found == NULL ? CFG_UNDEF : found->i;
+}
+
+// ==================================================
+//
+// computes the reverse postorder of the blocks reachable
+// from the entry with an iterative depth first search
+//
+// ==================================================
+static int buildrpo(struct cfg* g) {
+    unsigned* stack = malloc(g->n * sizeof(unsigned));
+    unsigned* next = malloc(g->n * sizeof(unsigned));
+    if (stack == NULL || next == NULL) {
+        free(stack);
+        free(next);
+        return -1;
+    }
+
+    for (unsigned i = 0; i < g->n; i++) {
+        g->order[i] = CFG_UNDEF;
+    }
+
+    // order[] marks visited blocks during the search
+    unsigned top = 0, post = g->n;
+    stack[top++] = 0;
+    next[0] = g->succoff[0];
+    g->order[0] = 0;
+    while (top > 0) {
+        unsigned b = stack[top - 1];
+        if (next[b] < g->succoff[b + 1]) {
+            unsigned s = g->succ[next[b]++];
+            if (g->order[s] == CFG_UNDEF) {
+                g->order[s] = 0;
+                next[s] = g->succoff[s];
+                stack[top++] = s;
+            }
+        } else {
+            g->rpo[--post] = b;
+            top--;
+        }
+    }
+
+    // reachable blocks were written at the tail of rpo[]
+    g->nrpo = g->n - post;
+    for (unsigned k = 0; k < g->nrpo; k++) {
+        g->rpo[k] = g->rpo[post + k];
+    }
+    for (unsigned i = 0; i < g->n; i++) {
+        g->order[i] = CFG_UNDEF;
+    }
+    for (unsigned k = 0; k < g->nrpo; k++) {
+        g->order[g->rpo[k]] = k;
+    }
+
+    free(stack);
+    free(next);
+    return 0;
+}
+
+// ==================================================
+//
+// builds the graph of a list of n basic blocks.
+// takes ownership of the blocks array, blocks[0] must be the entry.
+// edges to blocks outside the list are ignored.
+// returns 0 on success, -1 if out of memory.
+//
+// ==================================================
+int cfg_build(struct cfg* g, LLVMBasicBlockRef* blocks, unsigned n) {
+    STATS_START(start);
+    *g = (struct cfg){.n = n, .blocks = blocks};
+    g->succoff = calloc(n + 1, sizeof(unsigned));
+    g->predoff = calloc(n + 1, sizeof(unsigned));
+    g->rpo = malloc((n + 1) * sizeof(unsigned));
+    g->order = malloc((n + 1) * sizeof(unsigned));
+    g->keys = malloc((n + 1) * sizeof(struct cfgkey));
+    unsigned* mark = malloc((n + 1) * sizeof(unsigned));
+    if (!g->succoff || !g->predoff || !g->rpo || !g->order || !g->keys ||
+        !mark) {
+        goto fail;
+    }
+
+    for (unsigned i = 0; i < n; i++) {
+        g->keys[i] = (struct cfgkey){blocks[i], i};
+        mark[i] = CFG_UNDEF;
+    }
+    qsort(g->keys, n, sizeof(struct cfgkey), keycmp);
+
+    // first pass counts the edges, second pass fills them in.
+    // mark[s] == i filters duplicated edges (i.e. switch cases)
+    unsigned nedges = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        for (unsigned i = 0; i < n; i++) {
+            LLVMValueRef terminator = LLVMGetBasicBlockTerminator(blocks[i]);
+            unsigned n_succs =
+                terminator ? LLVMGetNumSuccessors(terminator) : 0;
+            for (unsigned k = 0; k < n_succs; k++) {
+                unsigned s = cfg_index(g, LLVMGetSuccessor(terminator, k));
+                if (s == CFG_UNDEF || mark[s] == i) {
+                    continue;
+                }
+                mark[s] = i;
+                if (pass == 0) {
+                    g->succoff[i + 1]++;
+                    g->predoff[s + 1]++;
+                    nedges++;
+                } else {
+                    g->succ[g->succoff[i + 1]++] = s;
+                    g->pred[g->predoff[s + 1]++] = i;
+                }
+            }
+        }
+        for (unsigned i = 0; i < n; i++) {
+            mark[i] = CFG_UNDEF;
+        }
+        if (pass == 0) {
+            for (unsigned i = 0; i < n; i++) {
+                g->succoff[i + 1] += g->succoff[i];
+                g->predoff[i + 1] += g->predoff[i];
+            }
+            g->succ = malloc((nedges + 1) * sizeof(unsigned));
+            g->pred = malloc((nedges + 1) * sizeof(unsigned));
+            if (g->succ == NULL || g->pred == NULL) {
+                goto fail;
+            }
+            // the second pass uses off[i + 1] as the insertion cursor of i
+            for (unsigned i = n; i > 0; i--) {
+                g->succoff[i] = g->succoff[i - 1];
+                g->predoff[i] = g->predoff[i - 1];
+            }
+        }
+    }
+
+    if (n > 0 && buildrpo(g)) {
+        goto fail;
+    }
+
+    free(mark);
+    STATS_STOP(STATS_CFG, start);
+    return 0;
+
+fail:
+    free(mark);
+    cfg_free(g);
+    return -1;
+}
+
+// ==================================================
+//
+// builds the graph of n basic blocks from its successor lists,
+// without reading their terminators. takes ownership of the blocks,
+// succoff and succ arrays, which are laid out as in struct cfg and
+// must have no duplicated edges.
+// returns 0 on success, -1 if out of memory.
+//
+// ==================================================
+int cfg_fromedges(struct cfg* g, LLVMBasicBlockRef* blocks, unsigned n,
+    unsigned* succoff, unsigned* succ) {
+    STATS_START(start);
+    *g = (struct cfg){.n = n, .blocks = blocks, .succoff = succoff,
+        .succ = succ};
+    unsigned nedges = succoff[n];
+    g->predoff = calloc(n + 1, sizeof(unsigned));
+    g->pred = malloc((nedges + 1) * sizeof(unsigned));
+    g->rpo = malloc((n + 1) * sizeof(unsigned));
+    g->order = malloc((n + 1) * sizeof(unsigned));
+    g->keys = malloc((n + 1) * sizeof(struct cfgkey));
+    if (!g->predoff || !g->pred || !g->rpo || !g->order || !g->keys) {
+        cfg_free(g);
+        return -1;
+    }
+
+    for (unsigned i = 0; i < n; i++) {
+        g->keys[i] = (struct cfgkey){blocks[i], i};
+    }
+    qsort(g->keys, n, sizeof(struct cfgkey), keycmp);
+
+    for (unsigned e = 0; e < nedges; e++) {
+        g->predoff[succ[e] + 1]++;
+    }
+    for (unsigned i = 0; i < n; i++) {
+        g->predoff[i + 1] += g->predoff[i];
+    }
+    // predoff[i + 1] is the insertion cursor of i, as in cfg_build
+    for (unsigned i = n; i > 0; i--) {
+        g->predoff[i] = g->predoff[i - 1];
+    }
+    for (unsigned i = 0; i < n; i++) {
+        for (unsigned e = succoff[i]; e < succoff[i + 1]; e++) {
+            g->pred[g->predoff[succ[e] + 1]++] = i;
+        }
+    }
+
+    if (n > 0 && buildrpo(g)) {
+        cfg_free(g);
+        return -1;
+    }
+
+    STATS_STOP(STATS_CFG, start);
+    return 0;
+}
+
+// ==================================================
+//
+// builds the graph of all basic blocks of a function
+//
+// ==================================================
+int cfg_fromfunction(struct cfg* g, LLVMValueRef f) {
+    unsigned n = LLVMCountBasicBlocks(f);
+    LLVMBasicBlockRef* blocks = malloc((n + 1) * sizeof(LLVMBasicBlockRef));
+    if (blocks == NULL) {
+        *g = (struct cfg){0};
+        return -1;
+    }
+    LLVMGetBasicBlocks(f, blocks);
+    return cfg_build(g, blocks, n);
+}
+
+// ==================================================
+//
+// releases all memory held by a graph
+//
+// ==================================================
+void cfg_free(struct cfg* g) {
+    free(g->blocks);
+    free(g->succoff);
+    free(g->succ);
+    free(g->predoff);
+    free(g->pred);
+    free(g->rpo);
+    free(g->order);
+    free(g->keys);
+    *g = (struct cfg){0};
+}
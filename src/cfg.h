@@ -0,0 +1,60 @@
+/*
+ * Lua binding for LLVM C API.
+ * Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+ *
+ * This file is part of llb.
+ *
+ * llb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * llb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with llb. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _LLB_CFG_H
+#define _LLB_CFG_H
+
+// ==================================================
+//
+//  integer indexed control flow graph.
+//  blocks[0] is the entry block, edges are stored as
+//  compact (CSR) successor and predecessor arrays.
+//
+// ==================================================
+struct cfg {
+    unsigned n;
+    LLVMBasicBlockRef* blocks;
+    // successors of i are succ[succoff[i] .. succoff[i + 1] - 1]
+    unsigned* succoff;
+    unsigned* succ;
+    // predecessors of i are pred[predoff[i] .. predoff[i + 1] - 1]
+    unsigned* predoff;
+    unsigned* pred;
+    // rpo[k] is the k-th of the nrpo blocks reachable from the entry,
+    // in reverse postorder. order[i] is the position of i in rpo[],
+    // CFG_UNDEF if i is unreachable.
+    unsigned nrpo;
+    unsigned* rpo;
+    unsigned* order;
+    // blocks sorted by address, for cfg_index
+    struct cfgkey* keys;
+};
+
+#define CFG_UNDEF ((unsigned)-1)
+
+extern int cfg_build(struct cfg*, LLVMBasicBlockRef*, unsigned);
+extern int cfg_fromfunction(struct cfg*, LLVMValueRef);
+extern int cfg_fromedges(
+    struct cfg*, LLVMBasicBlockRef*, unsigned, unsigned*, unsigned*);
+extern unsigned cfg_index(const struct cfg*, LLVMBasicBlockRef);
+extern void cfg_free(struct cfg*);
+
+#endif
@@ -0,0 +1,148 @@
+/*
+ * Lua binding for LLVM C API.
+ * Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+ *
+ * This file is part of llb.
+ *
+ * llb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * llb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with llb. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <lauxlib.h>
+#include <lua.h>
+
+#include <llvm-c/Core.h>
+
+#include "context.h"
+#include "core.h"
+
+// ==================================================
+//
+// pushes a new context object
+//
+// ==================================================
+static struct context* pushcontext(lua_State* L) {
+    struct context* ctx = lua_newuserdata(L, sizeof(struct context));
+    ctx->ref = LLVMContextCreate();
+    ctx->refs = 1;
+    ctx->disposed = 0;
+    luaL_setmetatable(L, LLB_CONTEXT);
+    return ctx;
+}
+
+// ==================================================
+//
+// returns the context at index i, or the default context when it is
+// absent. leaves the context object on the top of the stack.
+//
+// ==================================================
+struct context* context_opt(lua_State* L, int i) {
+    if (lua_isnoneornil(L, i)) {
+        context_default(L);
+    } else {
+        luaL_checkudata(L, i, LLB_CONTEXT);
+        lua_pushvalue(L, i);
+    }
+    struct context* ctx = lua_touserdata(L, -1);
+    if (ctx->disposed) {
+        luaL_argerror(L, i, "disposed context");
+    }
+    return ctx;
+}
+
+// ==================================================
+//
+// a module holds a reference to its context
+//
+// ==================================================
+void context_retain(struct context* ctx) {
+    ctx->refs++;
+}
+
+void context_release(struct context* ctx) {
+    if (--ctx->refs == 0) {
+        LLVMContextDispose(ctx->ref);
+        ctx->ref = NULL;
+    }
+}
+
+// ==================================================
+//
+// creates a new context
+//
+// ==================================================
+int context_new(lua_State* L) {
+    pushcontext(L);
+    return 1;
+}
+
+// ==================================================
+//
+// returns the default context, shared by all modules loaded without
+// an explicit context. it lives until the lua state is closed, or until
+// it is disposed, then a new one takes its place.
+//
+// ==================================================
+int context_default(lua_State* L) {
+    if (lua_getfield(L, LUA_REGISTRYINDEX, LLB_DEFAULTCONTEXT) == LUA_TNIL) {
+        lua_pop(L, 1);
+        pushcontext(L);
+        lua_pushvalue(L, -1);
+        lua_setfield(L, LUA_REGISTRYINDEX, LLB_DEFAULTCONTEXT);
+    }
+    return 1;
+}
+
+// ==================================================
+//
+// drops the lua handle of a context, no modules can be loaded in it
+// anymore. the context is disposed with its last module.
+// disposing the default context makes the next one a new context.
+// also the __gc metamethod
+//
+// ==================================================
+int context_dispose(lua_State* L) {
+    struct context* ctx = getcontext(L, 1);
+    if (!ctx->disposed) {
+        ctx->disposed = 1;
+        context_release(ctx);
+    }
+    lua_getfield(L, LUA_REGISTRYINDEX, LLB_DEFAULTCONTEXT);
+    if (lua_touserdata(L, -1) == ctx) {
+        lua_pushnil(L);
+        lua_setfield(L, LUA_REGISTRYINDEX, LLB_DEFAULTCONTEXT);
+    }
+    return 0;
+}
+
+// ==================================================
+//
+// returns the number of modules alive in a context
+//
+// ==================================================
+int context_module_count(lua_State* L) {
+    struct context* ctx = getcontext(L, 1);
+    lua_pushinteger(L, ctx->refs - !ctx->disposed);
+    return 1;
+}
+
+// ==================================================
+//
+// __tostring metamethod
+//
+// ==================================================
+int context_tostring(lua_State* L) {
+    struct context* ctx = getcontext(L, 1);
+    lua_pushfstring(L, "context: %p", ctx->ref);
+    return 1;
+}
@@ -0,0 +1,46 @@
+/*
+ * Lua binding for LLVM C API.
+ * Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+ *
+ * This file is part of llb.
+ *
+ * llb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * llb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with llb. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LLB_CONTEXT_H
+#define _LLB_CONTEXT_H
+
+// ==================================================
+//
+// a LLVM context shared by modules.
+// refs counts the modules loaded in the context plus the lua handle,
+// the context is disposed when it drops to zero.
+//
+// ==================================================
+struct context {
+    LLVMContextRef ref;
+    int refs;
+    int disposed;
+};
+
+extern struct context* context_opt(lua_State*, int);
+extern void context_retain(struct context*);
+extern void context_release(struct context*);
+extern int context_new(lua_State*);
+extern int context_default(lua_State*);
+extern int context_dispose(lua_State*);
+extern int context_module_count(lua_State*);
+extern int context_tostring(lua_State*);
+
+#endif
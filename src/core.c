@@ -18,6 +18,14 @@
  * along with llb. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <lauxlib.h>
 #include <lua.h>
 
@@ -26,11 +34,21 @@
 #include <llvm-c/Core.h>
 #include <llvm-c/IRReader.h>
 
+#include "batch.h"
 #include "bb.h"
+#include "bitset.h"
+#include "builder.h"
+#include "context.h"
 #include "core.h"
+#include "domtree.h"
+#include "find.h"
 #include "function.h"
 #include "instruction.h"
+#include "jit.h"
+#include "lazy.h"
 #include "module.h"
+#include "passes.h"
+#include "stats.h"
 
 static int llb_error(lua_State* L, const char* err) {
     lua_pushnil(L);
@@ -38,14 +56,269 @@ static int llb_error(lua_State* L, const char* err) {
     return 2;
 }
 
+static int llb_llvmerror(lua_State* L, char* err) {
+    llb_error(L, err);
+    LLVMDisposeMessage(err);
+    return 2;
+}
+
+// ==================================================
+//
+//  pushes the object of a LLVM reference, a userdata of class tname.
+//  objects are interned on a weak table, so wrapping the same LLVM
+//  reference again returns the same userdata. NULL pushes nil.
+//
+// ==================================================
+void pushobject(lua_State* L, void* ref, const char* tname) {
+    if (ref == NULL) {
+        lua_pushnil(L);
+        return;
+    }
+    lua_getfield(L, LUA_REGISTRYINDEX, LLB_OBJECTS);
+    // a freed reference may be reused by an object of another class
+    if (lua_rawgetp(L, -1, ref) != LUA_TNIL &&
+        luaL_testudata(L, -1, tname) != NULL) {
+        lua_remove(L, -2);
+        STATS_COUNT(STATS_OBJECTSREUSED);
+        return;
+    }
+    lua_pop(L, 1);
+    STATS_COUNT(STATS_OBJECTSNEW);
+    newuserdata(L, ref, tname);
+    lua_pushvalue(L, -1);
+    lua_rawsetp(L, -3, ref);
+    lua_remove(L, -2);
+}
+
+// ==================================================
+//
+//  drops the interned object of a LLVM reference that is being freed
+//
+// ==================================================
+void forgetobject(lua_State* L, void* ref) {
+    lua_getfield(L, LUA_REGISTRYINDEX, LLB_OBJECTS);
+    lua_pushnil(L);
+    lua_rawsetp(L, -2, ref);
+    lua_pop(L, 1);
+}
+
+// ==================================================
+//
+//  drops the interned objects of the functions, arguments, blocks and
+//  instructions of a module that is being disposed, as LLVM may reuse
+//  their addresses for the values of another module
+//
+// ==================================================
+void forgetmodule(lua_State* L, LLVMModuleRef module) {
+    lua_getfield(L, LUA_REGISTRYINDEX, LLB_OBJECTS);
+    LLVMValueRef f = LLVMGetFirstFunction(module);
+    for (; f != NULL; f = LLVMGetNextFunction(f)) {
+        lua_pushnil(L);
+        lua_rawsetp(L, -2, f);
+        LLVMValueRef p = LLVMGetFirstParam(f);
+        for (; p != NULL; p = LLVMGetNextParam(p)) {
+            lua_pushnil(L);
+            lua_rawsetp(L, -2, p);
+        }
+        LLVMBasicBlockRef bb = LLVMGetFirstBasicBlock(f);
+        for (; bb != NULL; bb = LLVMGetNextBasicBlock(bb)) {
+            lua_pushnil(L);
+            lua_rawsetp(L, -2, bb);
+            LLVMValueRef inst = LLVMGetFirstInstruction(bb);
+            for (; inst != NULL; inst = LLVMGetNextInstruction(inst)) {
+                lua_pushnil(L);
+                lua_rawsetp(L, -2, inst);
+            }
+        }
+    }
+    lua_pop(L, 1);
+}
+
+// ==================================================
+//
+//  appends ref to the list on top of the stack if it has an interned
+//  object. objects is the index of the interned objects table.
+//
+// ==================================================
+static void recordobject(lua_State* L, int objects, void* ref) {
+    if (lua_rawgetp(L, objects, ref) != LUA_TNIL) {
+        lua_pushlightuserdata(L, ref);
+        lua_rawseti(L, -3, luaL_len(L, -3) + 1);
+    }
+    lua_pop(L, 1);
+}
+
+// ==================================================
+//
+//  pushes a table that maps each function of a module to the list of
+//  its interned objects: the function itself, its arguments, blocks
+//  and instructions. passes may delete functions, whose memory is then
+//  gone, so the list is taken before running them. see forgetdeleted.
+//
+// ==================================================
+void pushinterned(lua_State* L, LLVMModuleRef module) {
+    lua_newtable(L);
+    lua_getfield(L, LUA_REGISTRYINDEX, LLB_OBJECTS);
+    int objects = lua_gettop(L);
+    LLVMValueRef f = LLVMGetFirstFunction(module);
+    for (; f != NULL; f = LLVMGetNextFunction(f)) {
+        lua_newtable(L);
+        recordobject(L, objects, f);
+        LLVMValueRef p = LLVMGetFirstParam(f);
+        for (; p != NULL; p = LLVMGetNextParam(p)) {
+            recordobject(L, objects, p);
+        }
+        LLVMBasicBlockRef bb = LLVMGetFirstBasicBlock(f);
+        for (; bb != NULL; bb = LLVMGetNextBasicBlock(bb)) {
+            recordobject(L, objects, bb);
+            LLVMValueRef inst = LLVMGetFirstInstruction(bb);
+            for (; inst != NULL; inst = LLVMGetNextInstruction(inst)) {
+                recordobject(L, objects, inst);
+            }
+        }
+        if (lua_rawlen(L, -1) == 0) {
+            lua_pop(L, 1);
+        } else {
+            lua_rawsetp(L, objects - 1, f);
+        }
+    }
+    lua_pop(L, 1);
+}
+
+// ==================================================
+//
+//  drops the interned objects listed by pushinterned, at index i, of
+//  the functions that are no longer in the module, as LLVM may reuse
+//  their addresses for new values
+//
+// ==================================================
+void forgetdeleted(lua_State* L, LLVMModuleRef module, int i) {
+    i = lua_absindex(L, i);
+    LLVMValueRef f = LLVMGetFirstFunction(module);
+    for (; f != NULL; f = LLVMGetNextFunction(f)) {
+        lua_pushnil(L);
+        lua_rawsetp(L, i, f);
+    }
+    lua_getfield(L, LUA_REGISTRYINDEX, LLB_OBJECTS);
+    lua_pushnil(L);
+    while (lua_next(L, i) != 0) {
+        lua_Integer n = luaL_len(L, -1);
+        for (lua_Integer k = 1; k <= n; k++) {
+            lua_rawgeti(L, -1, k);
+            lua_pushnil(L);
+            lua_rawset(L, -5);
+        }
+        lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+}
+
+// ==================================================
+//
+//  bumps the epochs of a function after a change to its body.
+//  epochs[1] counts the changes to the IR, epochs[2] the ones that
+//  changed its blocks or terminators, when cfg is true. cached
+//  analyses are valid while the epochs they read stay the same,
+//  see function:analysis. the epochs live in the uservalue of the
+//  function object: without an object there is nothing cached.
+//
+// ==================================================
+void touchfunction(lua_State* L, LLVMValueRef function, int cfg) {
+    if (function == NULL) {
+        return;
+    }
+    lua_getfield(L, LUA_REGISTRYINDEX, LLB_OBJECTS);
+    if (lua_rawgetp(L, -1, function) == LUA_TNIL ||
+        luaL_testudata(L, -1, LLB_FUNCTION) == NULL) {
+        lua_pop(L, 2);
+        return;
+    }
+    if (lua_getuservalue(L, -1) == LUA_TNIL) {
+        lua_pop(L, 1);
+        lua_createtable(L, 2, 0);
+        lua_pushinteger(L, 0);
+        lua_rawseti(L, -2, 1);
+        lua_pushinteger(L, 0);
+        lua_rawseti(L, -2, 2);
+        lua_pushvalue(L, -1);
+        lua_setuservalue(L, -3);
+    }
+    for (int k = 1; k <= (cfg ? 2 : 1); k++) {
+        lua_rawgeti(L, -1, k);
+        lua_Integer epoch = lua_tointeger(L, -1);
+        lua_pop(L, 1);
+        lua_pushinteger(L, epoch + 1);
+        lua_rawseti(L, -2, k);
+    }
+    lua_pop(L, 3);
+}
+
+// ==================================================
+//
+//  bumps the epochs of the function of an instruction that was
+//  inserted or is about to be removed
+//
+// ==================================================
+void touchinstruction(lua_State* L, LLVMValueRef instruction) {
+    LLVMBasicBlockRef bb = LLVMGetInstructionParent(instruction);
+    if (bb != NULL) {
+        touchfunction(L, LLVMGetBasicBlockParent(bb),
+            LLVMIsATerminatorInst(instruction) != NULL);
+    }
+}
+
+// ==================================================
+//
+//  returns the lua file handle at index i, or NULL if it is absent
+//
+// ==================================================
+FILE* optfile(lua_State* L, int i) {
+    if (lua_isnoneornil(L, i)) {
+        return NULL;
+    }
+    luaL_Stream* stream = luaL_checkudata(L, i, LUA_FILEHANDLE);
+    if (stream->closef == NULL) {
+        luaL_argerror(L, i, "attempt to use a closed file");
+    }
+    return stream->f;
+}
+
+// ==================================================
+//
+//  pushes the results of a write to the file handle at index i,
+//  as file:write does: the file, or nil, the message and errno
+//
+// ==================================================
+int pushfile(lua_State* L, int i, int ok) {
+    if (!ok) {
+        return luaL_fileresult(L, 0, NULL);
+    }
+    lua_pushvalue(L, i);
+    return 1;
+}
+
+// ==================================================
+//
+//  writes an output to f, the file handle at index i, or pushes it as
+//  a string if f is NULL. returns the number of results, as in file:write
+//
+// ==================================================
+int pushoutput(lua_State* L, int i, FILE* f, const char* s, size_t len) {
+    if (f == NULL) {
+        lua_pushlstring(L, s, len);
+        return 1;
+    }
+    return pushfile(L, i, fwrite(s, 1, len, f) == len);
+}
+
 // ==================================================
 //
 // instantiates a new class on the lua registry
 //
 // ==================================================
 static int llb_newclass(lua_State* L) {
-    const char* tname = luaL_checkstring(L, 2);
-    tname = lua_pushfstring(L, "__llb_%s", tname);
+    const char* name = luaL_checkstring(L, 2);
+    const char* tname = lua_pushfstring(L, "__llb_%s", name);
     if (lua_gettable(L, LUA_REGISTRYINDEX) == LUA_TNIL) {
         return luaL_error(L, "unknown class");
     }
@@ -55,56 +328,206 @@ static int llb_newclass(lua_State* L) {
     lua_pushvalue(L, 1);
     lua_setfield(L, 1, "__index");
     lua_pushvalue(L, 1);
-    luaL_setfuncs(L, funcs, 0);
+    stats_setfuncs(L, name, funcs);
     lua_setfield(L, LUA_REGISTRYINDEX, tname);
     return 0;
 }
 
 // ==================================================
 //
-//  creates a llvm module from a .ll file
+//  a read-only file mapping, unmapped when collected
 //
 // ==================================================
-static int llb_load_ir(lua_State* L) {
-    const char* path = luaL_checkstring(L, 1);
-    LLVMContextRef ctx = LLVMContextCreate();
-    char* err;
+#define MAPPING ("__llb_mapping")
 
-    LLVMMemoryBufferRef memory_buffer;
-    if (LLVMCreateMemoryBufferWithContentsOfFile(path, &memory_buffer, &err)) {
-        return llb_error(L, err);
+struct mapping {
+    void* addr;
+    size_t size;
+};
+
+static int mapping_gc(lua_State* L) {
+    struct mapping* m = lua_touserdata(L, 1);
+    if (m->addr != NULL) {
+        munmap(m->addr, m->size);
+        m->addr = NULL;
+    }
+    return 0;
+}
+
+// ==================================================
+//
+//  maps the file at path and pushes its mapping.
+//  returns NULL with errno set on failure.
+//
+// ==================================================
+static struct mapping* pushmapping(lua_State* L, const char* path) {
+    struct mapping* m = lua_newuserdata(L, sizeof(struct mapping));
+    m->addr = NULL;
+    m->size = 0;
+    luaL_setmetatable(L, MAPPING);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
     }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        int e = errno;
+        close(fd);
+        errno = e;
+        return NULL;
+    }
+    if (st.st_size > 0) {
+        void* addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            int e = errno;
+            close(fd);
+            errno = e;
+            return NULL;
+        }
+        m->addr = addr;
+        m->size = st.st_size;
+    }
+    close(fd);
+    return m;
+}
 
+// ==================================================
+//
+//  creates a llvm module from a memory buffer, in the context on the
+//  top of the stack. lazy modules take ownership of the buffer, the
+//  memory behind it must be kept alive with module_keep.
+//
+// ==================================================
+enum { IR, BITCODE, LAZYBITCODE };
+
+static int parse(lua_State* L, LLVMMemoryBufferRef buffer, int kind) {
+    struct context* ctx = lua_touserdata(L, -1);
     LLVMModuleRef module;
-    if (LLVMParseIRInContext(ctx, memory_buffer, &module, &err)) {
-        return llb_error(L, err);
+    char* err;
+
+    switch (kind) {
+        case IR:
+            // takes ownership of the memory buffer
+            if (LLVMParseIRInContext(ctx->ref, buffer, &module, &err)) {
+                return llb_llvmerror(L, err);
+            }
+            break;
+        case BITCODE:
+            if (LLVMParseBitcodeInContext(ctx->ref, buffer, &module, &err)) {
+                LLVMDisposeMemoryBuffer(buffer);
+                return llb_llvmerror(L, err);
+            }
+            LLVMDisposeMemoryBuffer(buffer);
+            break;
+        default:
+            if (LLVMGetBitcodeModuleInContext(
+                    ctx->ref, buffer, &module, &err)) {
+                LLVMDisposeMemoryBuffer(buffer);
+                return llb_llvmerror(L, err);
+            }
+            break;
     }
 
-    return module_new(L, module);
+    return module_new(L, module, -1);
 }
 
 // ==================================================
 //
-//  creates a llvm module from a .bc file
+//  creates a llvm module from a .ll file.
+//  receives an optional context, the default context otherwise
 //
 // ==================================================
-static int llb_load_bitcode(lua_State* L) {
+static int llb_load_ir(lua_State* L) {
     const char* path = luaL_checkstring(L, 1);
+    context_opt(L, 2);
     char* err;
 
     LLVMMemoryBufferRef memory_buffer;
     if (LLVMCreateMemoryBufferWithContentsOfFile(path, &memory_buffer, &err)) {
-        return llb_error(L, err);
+        return llb_llvmerror(L, err);
     }
 
-    LLVMModuleRef module;
-    if (LLVMParseBitcode(memory_buffer, &module, &err)) {
-        LLVMDisposeMemoryBuffer(memory_buffer);
-        return llb_error(L, err);
+    return parse(L, memory_buffer, IR);
+}
+
+// ==================================================
+//
+//  creates a llvm module from a .bc file, mapped in memory.
+//  receives an optional context, the default context otherwise.
+//  lazy modules read function bodies only when they are first used,
+//  and keep the file mapped until they are disposed.
+//
+// ==================================================
+static int llb_load_bitcode(lua_State* L) {
+    const char* path = luaL_checkstring(L, 1);
+    int lazy = lua_toboolean(L, 3);
+    context_opt(L, 2);
+
+    struct mapping* m = pushmapping(L, path);
+    if (m == NULL) {
+        return llb_error(L, strerror(errno));
+    }
+    int mapping = lua_gettop(L);
+    lua_pushvalue(L, mapping - 1);
+
+    LLVMMemoryBufferRef memory_buffer = LLVMCreateMemoryBufferWithMemoryRange(
+        m->addr != NULL ? m->addr : "", m->size, path, 0);
+    if (parse(L, memory_buffer, lazy ? LAZYBITCODE : BITCODE) == 2) {
+        return 2;
     }
-    LLVMDisposeMemoryBuffer(memory_buffer);
 
-    return module_new(L, module);
+    if (lazy) {
+        lua_pushvalue(L, mapping);
+        module_keep(L, -2);
+    } else {
+        munmap(m->addr, m->size);
+        m->addr = NULL;
+    }
+    return 1;
+}
+
+// ==================================================
+//
+//  creates a llvm module from a string with IR, without copying it.
+//  receives an optional context, the default context otherwise
+//
+// ==================================================
+static int llb_parse_ir(lua_State* L) {
+    size_t len;
+    const char* s = luaL_checklstring(L, 1, &len);
+    context_opt(L, 2);
+
+    // lua strings are null terminated, as the IR parser requires
+    LLVMMemoryBufferRef memory_buffer =
+        LLVMCreateMemoryBufferWithMemoryRange(s, len, "string", 1);
+    return parse(L, memory_buffer, IR);
+}
+
+// ==================================================
+//
+//  creates a llvm module from a string with bitcode, without copying
+//  it. receives an optional context and the lazy flag, like
+//  load_bitcode. lazy modules keep the string alive.
+//
+// ==================================================
+static int llb_parse_bitcode(lua_State* L) {
+    size_t len;
+    const char* s = luaL_checklstring(L, 1, &len);
+    int lazy = lua_toboolean(L, 3);
+    context_opt(L, 2);
+
+    LLVMMemoryBufferRef memory_buffer =
+        LLVMCreateMemoryBufferWithMemoryRange(s, len, "string", 0);
+    if (parse(L, memory_buffer, lazy ? LAZYBITCODE : BITCODE) == 2) {
+        return 2;
+    }
+
+    if (lazy) {
+        lua_pushvalue(L, 1);
+        module_keep(L, -2);
+    }
+    return 1;
 }
 
 // ==================================================
@@ -115,6 +538,11 @@ static int llb_load_bitcode(lua_State* L) {
 static int llb_write_bitcode(lua_State* L) {
     LLVMModuleRef module = *(LLVMModuleRef*)luaL_checkudata(L, 1, LLB_MODULE);
     const char* path = luaL_checkstring(L, 2);
+    char* err;
+
+    if (lazy_materialize_all(module, &err)) {
+        return llb_llvmerror(L, err);
+    }
 
     if (LLVMWriteBitcodeToFile(module, path)) {
         return llb_error(L, "could not write bitcode to the output file");
@@ -124,8 +552,25 @@ static int llb_write_bitcode(lua_State* L) {
 }
 
 // clang-format off
+struct luaL_Reg context_mt[] = {
+    {"dispose", context_dispose},
+    {"module_count", context_module_count},
+    {"__gc", context_dispose},
+    {"__tostring", context_tostring},
+    {NULL, NULL}
+};
+
 struct luaL_Reg module_mt[] = {
+    {"context", module_context},
     {"get_builder", module_get_builder},
+    {"add_function", module_add_function},
+    {"find", find_module},
+    {"get_function", module_get_function},
+    {"to_bitcode", module_to_bitcode},
+    {"to_ir", module_to_ir},
+    {"run_passes", passes_module},
+    {"jit", jit_new},
+    {"functions", module_functions},
     {"__index", module_index},
     {"__pairs", module_pairs},
     {"__tostring", module_tostring},
@@ -134,14 +579,31 @@ struct luaL_Reg module_mt[] = {
 
 struct luaL_Reg func_mt[] = {
     {"basic_blocks", function_basic_blocks},
+    {"cfg", function_cfg},
+    {"idom", function_idom},
+    {"loops", function_loops},
+    {"liveness", function_liveness},
+    {"domtree", function_domtree},
+    {"epochs", function_epochs},
+    {"ssa_index", function_ssa_index},
+    {"df", function_df},
+    {"native_prunedssa", function_native_prunedssa},
+    {"params", function_params},
+    {"find", find_function},
+    {"to_ir", function_to_ir},
+    {"to_dot", function_to_dot},
+    {"run_passes", passes_function},
     {"__tostring", function_tostring},
     {NULL, NULL}
 };
 
 struct luaL_Reg bb_mt[] = {
     {"pointer", bb_pointer},
+    {"parent", bb_parent},
     {"successors", bb_successors},
     {"instructions", bb_instructions},
+    {"each_instruction", bb_each_instruction},
+    {"instruction_count", bb_instruction_count},
     {"first_instruction", bb_first_instruction},
     {"last_instruction", bb_last_instruction},
     {"build_phi", bb_build_phi},
@@ -153,7 +615,13 @@ struct luaL_Reg bb_mt[] = {
 struct luaL_Reg inst_mt[] = {
     {"pointer", instruction_pointer},
     {"operands", instruction_operands},
+    {"each_operand", instruction_each_operand},
+    {"operand_count", instruction_operand_count},
+    {"operand", instruction_operand},
     {"usages", instruction_usages},
+    {"each_usage", instruction_each_usage},
+    {"usage_count", instruction_usage_count},
+    {"opcode", instruction_opcode},
     {"is_alloca", instruction_is_alloca},
     {"is_store", instruction_is_store},
     {"delete", instruction_delete},
@@ -162,7 +630,54 @@ struct luaL_Reg inst_mt[] = {
     {NULL, NULL}
 };
 
+#define BUILDER_METHOD(name, fn, arg) {#name, builder_##name},
 struct luaL_Reg builder_mt[] = {
+    BUILDER_OPS(BUILDER_METHOD)
+    {"insert_block", builder_insert_block},
+    {"emit", builder_emit},
+    {"__gc", builder_gc},
+    {NULL, NULL}
+};
+#undef BUILDER_METHOD
+
+struct luaL_Reg bitset_mt[] = {
+    {"copy", bitset_copy},
+    {"add", bitset_add},
+    {"remove", bitset_remove},
+    {"pop", bitset_pop},
+    {"is_empty", bitset_is_empty},
+    {"size", bitset_size},
+    {"contains", bitset_contains},
+    {"union", bitset_union},
+    {"intersect", bitset_intersect},
+    {"difference", bitset_difference},
+    {"__eq", bitset_eq},
+    {"__add", bitset_add_mm},
+    {"__mul", bitset_mul_mm},
+    {"__sub", bitset_sub_mm},
+    {"__pairs", bitset_pairs},
+    {NULL, NULL}
+};
+
+struct luaL_Reg domtree_mt[] = {
+    {"idom", domtree_idom},
+    {"idoms", domtree_idoms},
+    {"depth", domtree_depth},
+    {"dominates", domtree_dominates},
+    {"children", domtree_children},
+    {"blocks", domtree_blocks},
+    {"insert_edge", domtree_insert_edge},
+    {"delete_edge", domtree_delete_edge},
+    {"__gc", domtree_gc},
+    {"__tostring", domtree_tostring},
+    {NULL, NULL}
+};
+
+struct luaL_Reg jit_mt[] = {
+    {"lookup", jit_lookup},
+    {"dispose", jit_dispose},
+    {"__gc", jit_dispose},
+    {"__tostring", jit_tostring},
     {NULL, NULL}
 };
 
@@ -178,26 +693,64 @@ int luaopen_core(lua_State* L) {
     const luaL_Reg lib_llb[] = {
         {"load_ir", llb_load_ir},
         {"load_bitcode", llb_load_bitcode},
+        {"parse_ir", llb_parse_ir},
+        {"parse_bitcode", llb_parse_bitcode},
         {"write_bitcode", llb_write_bitcode},
+        {"batch", batch_run},
+        {"stats", stats_get},
+#ifdef LLB_STATS
+        {"stats_clock", stats_clock},
+        {"stats_time", stats_time},
+        {"stats_count", stats_count},
+#endif
         {"dispose", module_dispose},
+        {"context", context_new},
+        {"default_context", context_default},
         {"get_builder", module_get_builder},
+        {"bitset", bitset_new},
+        {"jit", jit_new},
         {"newclass", llb_newclass},
         {NULL, NULL}
     };
     // clang-format on
 
+    lua_pushlightuserdata(L, context_mt);
     lua_pushlightuserdata(L, module_mt);
     lua_pushlightuserdata(L, func_mt);
     lua_pushlightuserdata(L, bb_mt);
     lua_pushlightuserdata(L, inst_mt);
     lua_pushlightuserdata(L, builder_mt);
+    lua_pushlightuserdata(L, bitset_mt);
+    lua_pushlightuserdata(L, jit_mt);
+    lua_pushlightuserdata(L, domtree_mt);
 
+    lua_setfield(L, LUA_REGISTRYINDEX, LLB_DOMTREE);
+    lua_setfield(L, LUA_REGISTRYINDEX, LLB_JIT);
+    lua_setfield(L, LUA_REGISTRYINDEX, LLB_BITSET);
     lua_setfield(L, LUA_REGISTRYINDEX, LLB_BUILDER);
     lua_setfield(L, LUA_REGISTRYINDEX, LLB_INSTRUCTION);
     lua_setfield(L, LUA_REGISTRYINDEX, LLB_BASICBLOCK);
     lua_setfield(L, LUA_REGISTRYINDEX, LLB_FUNCTION);
     lua_setfield(L, LUA_REGISTRYINDEX, LLB_MODULE);
+    lua_setfield(L, LUA_REGISTRYINDEX, LLB_CONTEXT);
+
+    luaL_newmetatable(L, MAPPING);
+    lua_pushcfunction(L, mapping_gc);
+    lua_setfield(L, -2, "__gc");
+    lua_pop(L, 1);
+
+    stats_open(L);
+    builder_open(L);
+
+    // interned objects, see pushobject
+    lua_newtable(L);
+    lua_newtable(L);
+    lua_pushstring(L, "v");
+    lua_setfield(L, -2, "__mode");
+    lua_setmetatable(L, -2);
+    lua_setfield(L, LUA_REGISTRYINDEX, LLB_OBJECTS);
 
     luaL_newlib(L, lib_llb);
+    find_open(L);
     return 1;
 }
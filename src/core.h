@@ -39,11 +39,50 @@
 //  metatable registry keys
 //
 // ==================================================
+#define LLB_CONTEXT ("__llb_context")
 #define LLB_MODULE ("__llb_module")
 #define LLB_FUNCTION ("__llb_function")
 #define LLB_BASICBLOCK ("__llb_basicblock")
 #define LLB_INSTRUCTION ("__llb_instruction")
 #define LLB_BUILDER ("__llb_builder")
+#define LLB_BITSET ("__llb_bitset")
+#define LLB_JIT ("__llb_jit")
+#define LLB_DOMTREE ("__llb_domtree")
+
+// ==================================================
+//
+//  registry key of the interned objects table
+//
+// ==================================================
+#define LLB_OBJECTS ("__llb_objects")
+
+// ==================================================
+//
+//  registry key of the default context
+//
+// ==================================================
+#define LLB_DEFAULTCONTEXT ("__llb_defaultcontext")
+
+// ==================================================
+//
+//  registry key of the statistics table, see stats.c
+//
+// ==================================================
+#define LLB_STATISTICS ("__llb_stats")
+
+// ==================================================
+//
+//  registry key of the instruction opcodes, see find.c
+//
+// ==================================================
+#define LLB_OPCODES ("__llb_opcodes")
+
+// ==================================================
+//
+//  registry key of the opcodes of builder:emit, see builder.c
+//
+// ==================================================
+#define LLB_BUILDEROPS ("__llb_builderops")
 
 // ==================================================
 //
@@ -53,6 +92,9 @@
 
 // clang-format off
 
+#define getcontext(L, i) \
+    ((struct context*)luaL_checkudata(L, i, LLB_CONTEXT))
+
 #define getmodule(L, i) \
     (*(LLVMModuleRef*)luaL_checkudata(L, i, LLB_MODULE))
 
@@ -74,4 +116,15 @@
 
 // clang-format on
 
+extern void pushobject(lua_State*, void*, const char*);
+extern void forgetobject(lua_State*, void*);
+extern void forgetmodule(lua_State*, LLVMModuleRef);
+extern void pushinterned(lua_State*, LLVMModuleRef);
+extern void forgetdeleted(lua_State*, LLVMModuleRef, int);
+extern void touchfunction(lua_State*, LLVMValueRef, int);
+extern void touchinstruction(lua_State*, LLVMValueRef);
+extern FILE* optfile(lua_State*, int);
+extern int pushfile(lua_State*, int, int);
+extern int pushoutput(lua_State*, int, FILE*, const char*, size_t);
+
 #endif
@@ -0,0 +1,162 @@
+/*
+ * Lua binding for LLVM C API.
+ * Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+ *
+ * This file is part of llb.
+ *
+ * llb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * llb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with llb. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <llvm-c/Core.h>
+
+#include "cfg.h"
+#include "defuse.h"
+#include "stats.h"
+
+struct defusekey {
+    LLVMValueRef value;
+    int code;
+};
+
+static int keycmp(const void* a, const void* b) {
+    LLVMValueRef x = ((const struct defusekey*)a)->value;
+    LLVMValueRef y = ((const struct defusekey*)b)->value;
+    return x < y ? -1 : x > y;
+}
+
+// ==================================================
+//
+// returns the code of an operand
+//
+// ==================================================
+static int code(const struct defusekey* keys, unsigned n, LLVMValueRef v) {
+    if (!LLVMIsAInstruction(v) && !LLVMIsAArgument(v)) {
+        return 0;
+    }
+    struct defusekey key = {v, 0};
+    struct defusekey* found =
+        bsearch(&key, keys, n, sizeof(struct defusekey), keycmp);
+    return found == NULL ? 0 : found->code;
+}
+
+// ==================================================
+//
+// builds the index in two walks over the instructions: the first
+// numbers them, the second reads their operands. the users are the
+// operand lists inverted.
+// returns 0 on success, -1 if out of memory.
+//
+// ==================================================
+int defuse_build(struct defuse* d, const struct cfg* g) {
+    STATS_START(start);
+    memset(d, 0, sizeof(struct defuse));
+    LLVMValueRef f = g->n > 0 ? LLVMGetBasicBlockParent(g->blocks[0]) : NULL;
+    d->nargs = f != NULL ? LLVMCountParams(f) : 0;
+    d->blockoff = malloc((g->n + 1) * sizeof(unsigned));
+    if (d->blockoff == NULL) {
+        return -1;
+    }
+    unsigned nops = 0;
+    d->blockoff[0] = 0;
+    for (unsigned b = 0; b < g->n; b++) {
+        for (LLVMValueRef inst = LLVMGetFirstInstruction(g->blocks[b]);
+             inst != NULL; inst = LLVMGetNextInstruction(inst)) {
+            d->n++;
+            nops += LLVMGetNumOperands(inst);
+        }
+        d->blockoff[b + 1] = d->n;
+    }
+
+    unsigned nkeys = d->n + d->nargs;
+    struct defusekey* keys = malloc((nkeys + 1) * sizeof(struct defusekey));
+    d->instructions = malloc((d->n + 1) * sizeof(LLVMValueRef));
+    d->opcode = malloc((d->n + 1) * sizeof(unsigned));
+    d->block = malloc((d->n + 1) * sizeof(unsigned));
+    d->opoff = malloc((d->n + 1) * sizeof(unsigned));
+    d->operand = malloc((nops + 1) * sizeof(int));
+    d->useoff = calloc(d->n + 1, sizeof(unsigned));
+    d->use = malloc((nops + 1) * sizeof(unsigned));
+    if (keys == NULL || d->instructions == NULL || d->opcode == NULL ||
+        d->block == NULL || d->opoff == NULL || d->operand == NULL ||
+        d->useoff == NULL || d->use == NULL) {
+        free(keys);
+        defuse_free(d);
+        return -1;
+    }
+
+    unsigned i = 0;
+    for (unsigned b = 0; b < g->n; b++) {
+        for (LLVMValueRef inst = LLVMGetFirstInstruction(g->blocks[b]);
+             inst != NULL; inst = LLVMGetNextInstruction(inst)) {
+            d->instructions[i] = inst;
+            d->opcode[i] = LLVMGetInstructionOpcode(inst);
+            d->block[i] = b;
+            keys[i] = (struct defusekey){inst, i + 1};
+            i++;
+        }
+    }
+    for (unsigned k = 0; k < d->nargs; k++) {
+        keys[d->n + k] = (struct defusekey){LLVMGetParam(f, k), -(int)k - 1};
+    }
+    qsort(keys, nkeys, sizeof(struct defusekey), keycmp);
+
+    unsigned e = 0;
+    for (i = 0; i < d->n; i++) {
+        d->opoff[i] = e;
+        int n = LLVMGetNumOperands(d->instructions[i]);
+        for (int k = 0; k < n; k++) {
+            int c = code(keys, nkeys, LLVMGetOperand(d->instructions[i], k));
+            d->operand[e++] = c;
+            if (c > 0) {
+                d->useoff[c]++;
+            }
+        }
+    }
+    d->opoff[d->n] = e;
+
+    // useoff[i + 1] counted the users of i, it becomes the insertion
+    // cursor of i, as in cfg_build
+    for (i = 0; i < d->n; i++) {
+        d->useoff[i + 1] += d->useoff[i];
+    }
+    for (i = d->n; i > 0; i--) {
+        d->useoff[i] = d->useoff[i - 1];
+    }
+    for (i = 0; i < d->n; i++) {
+        for (e = d->opoff[i]; e < d->opoff[i + 1]; e++) {
+            int c = d->operand[e];
+            if (c > 0) {
+                d->use[d->useoff[c]++] = i;
+            }
+        }
+    }
+
+    free(keys);
+    STATS_STOP(STATS_DEFUSE, start);
+    return 0;
+}
+
+void defuse_free(struct defuse* d) {
+    free(d->instructions);
+    free(d->opcode);
+    free(d->block);
+    free(d->blockoff);
+    free(d->opoff);
+    free(d->operand);
+    free(d->useoff);
+    free(d->use);
+}
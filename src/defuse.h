@@ -0,0 +1,52 @@
+/*
+ * Lua binding for LLVM C API.
+ * Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+ *
+ * This file is part of llb.
+ *
+ * llb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * llb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with llb. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LLB_DEFUSE_H
+#define _LLB_DEFUSE_H
+
+// ==================================================
+//
+//  def-use index of the instructions of a cfg, numbered densely in
+//  block order. operands are coded as in function:ssa_index: i > 0 is
+//  the instruction i - 1, -k is the argument k - 1 and 0 anything else.
+//  lists are CSR, as in struct cfg: the operands of i are
+//  operand[opoff[i] .. opoff[i + 1] - 1].
+//
+// ==================================================
+struct defuse {
+    unsigned n;
+    unsigned nargs;
+    LLVMValueRef* instructions;
+    unsigned* opcode;
+    // block[i] is the block of i, whose instructions are
+    // blockoff[block[i]] .. blockoff[block[i] + 1] - 1
+    unsigned* block;
+    unsigned* blockoff;
+    unsigned* opoff;
+    int* operand;
+    // the users of i, once per operand
+    unsigned* useoff;
+    unsigned* use;
+};
+
+extern int defuse_build(struct defuse*, const struct cfg*);
+extern void defuse_free(struct defuse*);
+
+#endif
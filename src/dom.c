@@ -0,0 +1,176 @@
+/*
+ * Lua binding for LLVM C API.
+ * Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+ *
+ * This file is part of llb.
+ *
+ * llb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * llb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with llb. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdlib.h>
+
+#include <llvm-c/Core.h>
+
+#include "cfg.h"
+#include "dom.h"
+#include "stats.h"
+
+// ==================================================
+//
+// walks both fingers up the dominator tree until they meet.
+// fingers are positions in reverse postorder.
+//
+// ==================================================
+static unsigned intersect(const unsigned* doms, unsigned a, unsigned b) {
+    while (a != b) {
+        while (a > b) {
+            a = doms[a];
+        }
+        while (b > a) {
+            b = doms[b];
+        }
+    }
+    return a;
+}
+
+// ==================================================
+//
+// computes the immediate dominators of a graph with the
+// Cooper-Harvey-Kennedy algorithm over reverse postorder.
+// idom[i] is the immediate dominator of block i, CFG_UNDEF for
+// the entry and for the blocks unreachable from it.
+// idom must have room for g->n elements.
+// returns 0 on success, -1 if out of memory.
+//
+// ==================================================
+int dom_idom(const struct cfg* g, unsigned* idom) {
+    STATS_START(start);
+    for (unsigned i = 0; i < g->n; i++) {
+        idom[i] = CFG_UNDEF;
+    }
+    if (g->nrpo == 0) {
+        return 0;
+    }
+
+    // doms[k] is the idom of rpo[k], as a position in rpo
+    unsigned* doms = malloc(g->nrpo * sizeof(unsigned));
+    if (doms == NULL) {
+        return -1;
+    }
+    for (unsigned k = 0; k < g->nrpo; k++) {
+        doms[k] = CFG_UNDEF;
+    }
+
+    doms[0] = 0;
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (unsigned k = 1; k < g->nrpo; k++) {
+            unsigned b = g->rpo[k];
+            unsigned new_idom = CFG_UNDEF;
+            for (unsigned e = g->predoff[b]; e < g->predoff[b + 1]; e++) {
+                unsigned p = g->order[g->pred[e]];
+                if (p == CFG_UNDEF || doms[p] == CFG_UNDEF) {
+                    continue;
+                }
+                new_idom =
+                    new_idom == CFG_UNDEF ? p : intersect(doms, p, new_idom);
+            }
+            if (doms[k] != new_idom) {
+                doms[k] = new_idom;
+                changed = 1;
+            }
+        }
+    }
+
+    for (unsigned k = 1; k < g->nrpo; k++) {
+        idom[g->rpo[k]] = g->rpo[doms[k]];
+    }
+
+    free(doms);
+    STATS_STOP(STATS_IDOM, start);
+    return 0;
+}
+
+// ==================================================
+//
+// computes the dominance frontier of a graph with the "runner"
+// algorithm (Cytron et al., as presented by Cooper-Harvey-Kennedy).
+// idom is the output of dom_idom.
+// the frontier is stored as CSR: df(i) = df[off[i] .. off[i + 1] - 1].
+// off must have room for g->n + 1 elements, *df is allocated and
+// must be released by the caller.
+// returns 0 on success, -1 if out of memory.
+//
+// ==================================================
+int dom_df(const struct cfg* g, const unsigned* idom, unsigned* off,
+    unsigned** df) {
+    STATS_START(start);
+    // mark[r] == b means b was already added to df(r)
+    unsigned* mark = malloc((g->n + 1) * sizeof(unsigned));
+    if (mark == NULL) {
+        return -1;
+    }
+
+    *df = NULL;
+    for (unsigned i = 0; i <= g->n; i++) {
+        off[i] = 0;
+    }
+
+    // first pass counts the frontier sizes, second pass fills them in
+    for (int pass = 0; pass < 2; pass++) {
+        for (unsigned i = 0; i < g->n; i++) {
+            mark[i] = CFG_UNDEF;
+        }
+        for (unsigned k = 0; k < g->nrpo; k++) {
+            unsigned b = g->rpo[k];
+            for (unsigned e = g->predoff[b]; e < g->predoff[b + 1]; e++) {
+                unsigned runner = g->pred[e];
+                if (g->order[runner] == CFG_UNDEF) {
+                    continue;
+                }
+                while (runner != CFG_UNDEF && runner != idom[b]) {
+                    if (mark[runner] != b) {
+                        mark[runner] = b;
+                        if (pass == 0) {
+                            off[runner + 1]++;
+                        } else {
+                            (*df)[off[runner + 1]++] = b;
+                        }
+                    }
+                    runner = idom[runner];
+                }
+            }
+        }
+        if (pass == 0) {
+            for (unsigned i = 0; i < g->n; i++) {
+                off[i + 1] += off[i];
+            }
+            *df = malloc((off[g->n] + 1) * sizeof(unsigned));
+            if (*df == NULL) {
+                free(mark);
+                return -1;
+            }
+            // the second pass uses off[i + 1] as the insertion cursor of i
+            for (unsigned i = g->n; i > 0; i--) {
+                off[i] = off[i - 1];
+            }
+        }
+    }
+
+    free(mark);
+    STATS_STOP(STATS_DF, start);
+    return 0;
+}
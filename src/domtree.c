@@ -0,0 +1,933 @@
+/*
+ * Lua binding for LLVM C API.
+ * Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+ *
+ * This file is part of llb.
+ *
+ * llb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * llb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with llb. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <lauxlib.h>
+#include <lua.h>
+
+#include <llvm-c/Core.h>
+
+#include "bb.h"
+#include "cfg.h"
+#include "core.h"
+#include "dom.h"
+#include "domtree.h"
+#include "stats.h"
+
+struct domkey {
+    LLVMBasicBlockRef bb;
+    unsigned i;
+};
+
+// ==================================================
+//
+// a growable array of unsigned, also used as a stack and as a heap
+//
+// ==================================================
+struct edges {
+    unsigned* a;
+    unsigned n;
+    unsigned cap;
+};
+
+// clang-format off
+
+#define getdomtree(L, i) \
+    ((struct domtree*)luaL_checkudata(L, i, LLB_DOMTREE))
+
+// clang-format on
+
+static int keycmp(const void* a, const void* b) {
+    LLVMBasicBlockRef x = ((const struct domkey*)a)->bb;
+    LLVMBasicBlockRef y = ((const struct domkey*)b)->bb;
+    return x < y ? -1 : x > y;
+}
+
+static int push(struct edges* v, unsigned x) {
+    if (v->n == v->cap) {
+        unsigned cap = v->cap == 0 ? 4 : 2 * v->cap;
+        unsigned* a = realloc(v->a, cap * sizeof(unsigned));
+        if (a == NULL) {
+            return -1;
+        }
+        v->a = a;
+        v->cap = cap;
+    }
+    v->a[v->n++] = x;
+    return 0;
+}
+
+static int contains(const struct edges* v, unsigned x) {
+    for (unsigned k = 0; k < v->n; k++) {
+        if (v->a[k] == x) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void removeedge(struct edges* v, unsigned x) {
+    for (unsigned k = 0; k < v->n; k++) {
+        if (v->a[k] == x) {
+            memmove(v->a + k, v->a + k + 1, (v->n - k - 1) * sizeof(unsigned));
+            v->n--;
+            return;
+        }
+    }
+}
+
+// ==================================================
+//
+// max-heap of blocks, ordered by their depth in the tree
+//
+// ==================================================
+static int heappush(struct edges* h, const unsigned* depth, unsigned x) {
+    if (push(h, x)) {
+        return -1;
+    }
+    for (unsigned k = h->n - 1; k > 0;) {
+        unsigned parent = (k - 1) / 2;
+        if (depth[h->a[parent]] >= depth[h->a[k]]) {
+            break;
+        }
+        unsigned tmp = h->a[parent];
+        h->a[parent] = h->a[k];
+        h->a[k] = tmp;
+        k = parent;
+    }
+    return 0;
+}
+
+static unsigned heappop(struct edges* h, const unsigned* depth) {
+    unsigned top = h->a[0];
+    h->a[0] = h->a[--h->n];
+    for (unsigned k = 0;;) {
+        unsigned max = k;
+        unsigned l = 2 * k + 1, r = 2 * k + 2;
+        if (l < h->n && depth[h->a[l]] > depth[h->a[max]]) {
+            max = l;
+        }
+        if (r < h->n && depth[h->a[r]] > depth[h->a[max]]) {
+            max = r;
+        }
+        if (max == k) {
+            break;
+        }
+        unsigned tmp = h->a[max];
+        h->a[max] = h->a[k];
+        h->a[k] = tmp;
+        k = max;
+    }
+    return top;
+}
+
+// ==================================================
+//
+// returns the index of a block, or CFG_UNDEF if it isn't in the tree
+//
+// ==================================================
+static unsigned find(const struct domtree* t, LLVMBasicBlockRef bb) {
+    struct domkey key = {bb, 0};
+    struct domkey* found =
+        bsearch(&key, t->keys, t->n, sizeof(struct domkey), keycmp);
+    return found == NULL ? CFG_UNDEF : found->i;
+}
+
+static int resize(void* p, size_t size) {
+    void* a = realloc(*(void**)p, size);
+    if (a == NULL) {
+        return -1;
+    }
+    *(void**)p = a;
+    return 0;
+}
+
+// ==================================================
+//
+// makes room for n blocks
+//
+// ==================================================
+static int reserve(struct domtree* t, unsigned n) {
+    if (n <= t->cap) {
+        return 0;
+    }
+    unsigned cap = t->cap == 0 ? 16 : 2 * t->cap;
+    cap = cap < n ? n : cap;
+    if (resize(&t->blocks, cap * sizeof(LLVMBasicBlockRef)) ||
+        resize(&t->keys, cap * sizeof(struct domkey)) ||
+        resize(&t->succ, cap * sizeof(struct edges)) ||
+        resize(&t->pred, cap * sizeof(struct edges)) ||
+        resize(&t->idom, cap * sizeof(unsigned)) ||
+        resize(&t->depth, cap * sizeof(unsigned)) ||
+        resize(&t->child, cap * sizeof(unsigned)) ||
+        resize(&t->next, cap * sizeof(unsigned)) ||
+        resize(&t->prev, cap * sizeof(unsigned)) ||
+        resize(&t->mark, cap * sizeof(unsigned)) ||
+        resize(&t->num, cap * sizeof(unsigned))) {
+        return -1;
+    }
+    t->cap = cap;
+    return 0;
+}
+
+// ==================================================
+//
+// adds a block without edges, unreachable until an edge reaches it.
+// returns its index, or CFG_UNDEF if out of memory.
+//
+// ==================================================
+static unsigned addblock(struct domtree* t, LLVMBasicBlockRef bb) {
+    if (reserve(t, t->n + 1)) {
+        return CFG_UNDEF;
+    }
+    unsigned i = t->n;
+    t->blocks[i] = bb;
+    t->succ[i] = t->pred[i] = (struct edges){0};
+    t->idom[i] = t->child[i] = t->next[i] = t->prev[i] = CFG_UNDEF;
+    t->depth[i] = 0;
+    t->mark[i] = 0;
+
+    // keeps the keys sorted
+    unsigned k = 0;
+    while (k < i && keycmp(&t->keys[k], &(struct domkey){bb, i}) < 0) {
+        k++;
+    }
+    memmove(t->keys + k + 1, t->keys + k, (i - k) * sizeof(struct domkey));
+    t->keys[k] = (struct domkey){bb, i};
+    t->n++;
+    return i;
+}
+
+// ==================================================
+//
+// moves block w under p in the tree
+//
+// ==================================================
+static void setidom(struct domtree* t, unsigned w, unsigned p) {
+    unsigned old = t->idom[w];
+    if (old != CFG_UNDEF) {
+        if (t->prev[w] != CFG_UNDEF) {
+            t->next[t->prev[w]] = t->next[w];
+        } else {
+            t->child[old] = t->next[w];
+        }
+        if (t->next[w] != CFG_UNDEF) {
+            t->prev[t->next[w]] = t->prev[w];
+        }
+    }
+    t->idom[w] = p;
+    t->prev[w] = t->next[w] = CFG_UNDEF;
+    if (p != CFG_UNDEF) {
+        t->next[w] = t->child[p];
+        if (t->child[p] != CFG_UNDEF) {
+            t->prev[t->child[p]] = w;
+        }
+        t->child[p] = w;
+    }
+}
+
+// ==================================================
+//
+// sets the tree from the immediate dominators of g, whose blocks
+// must be numbered as the tree's
+//
+// ==================================================
+static int settree(struct domtree* t, const struct cfg* g) {
+    if (dom_idom(g, t->idom)) {
+        return -1;
+    }
+    for (unsigned i = 0; i < t->n; i++) {
+        t->child[i] = t->next[i] = t->prev[i] = CFG_UNDEF;
+        t->depth[i] = 0;
+    }
+    // children are prepended, so they end up in block order
+    for (unsigned i = t->n; i > 0; i--) {
+        unsigned p = t->idom[i - 1];
+        t->idom[i - 1] = CFG_UNDEF;
+        setidom(t, i - 1, p);
+    }
+    for (unsigned k = 0; k < g->nrpo; k++) {
+        unsigned b = g->rpo[k];
+        t->depth[b] = t->idom[b] == CFG_UNDEF ? 1 : t->depth[t->idom[b]] + 1;
+    }
+    t->dirty = 0;
+    return 0;
+}
+
+// ==================================================
+//
+// recomputes the tree from its own edges
+//
+// ==================================================
+static int recalculate(struct domtree* t) {
+    struct cfg g;
+    unsigned nedges = 0;
+    for (unsigned i = 0; i < t->n; i++) {
+        nedges += t->succ[i].n;
+    }
+    LLVMBasicBlockRef* blocks = malloc((t->n + 1) * sizeof(LLVMBasicBlockRef));
+    unsigned* succoff = malloc((t->n + 1) * sizeof(unsigned));
+    unsigned* succ = malloc((nedges + 1) * sizeof(unsigned));
+    if (blocks == NULL || succoff == NULL || succ == NULL) {
+        free(blocks);
+        free(succoff);
+        free(succ);
+        return -1;
+    }
+    memcpy(blocks, t->blocks, t->n * sizeof(LLVMBasicBlockRef));
+    succoff[0] = 0;
+    for (unsigned i = 0; i < t->n; i++) {
+        const struct edges* e = &t->succ[i];
+        for (unsigned k = 0; k < e->n; k++) {
+            succ[succoff[i] + k] = e->a[k];
+        }
+        succoff[i + 1] = succoff[i] + e->n;
+    }
+
+    if (cfg_fromedges(&g, blocks, t->n, succoff, succ)) {
+        return -1;
+    }
+    STATS_COUNT(STATS_DOMTREERECOMPUTES);
+    int err = settree(t, &g);
+    cfg_free(&g);
+    return err;
+}
+
+static void flush(lua_State* L, struct domtree* t) {
+    if (t->dirty && recalculate(t)) {
+        throw(L, "out of memory");
+    }
+}
+
+// starts a new visit, clearing the marks when the stamps wrap around
+static void newstamp(struct domtree* t) {
+    if (++t->stamp == 0) {
+        memset(t->mark, 0, t->n * sizeof(unsigned));
+        t->stamp = 1;
+    }
+}
+
+// the nearest common ancestor of two reachable blocks
+static unsigned nca(const struct domtree* t, unsigned a, unsigned b) {
+    while (a != b) {
+        if (t->depth[a] < t->depth[b]) {
+            b = t->idom[b];
+        } else {
+            a = t->idom[a];
+        }
+    }
+    return a;
+}
+
+// ==================================================
+//
+// updates the tree after the insertion of the edge x -> y, both
+// reachable. the blocks whose idom changes are the ones reached from y
+// through blocks deeper than them and than nca(x, y) + 1. they are
+// found from the deepest up, then all of them become children of the
+// nearest common ancestor.
+//
+// ==================================================
+static int insert(struct domtree* t, unsigned x, unsigned y) {
+    unsigned a = nca(t, x, y);
+    if (a == y || a == t->idom[y]) {
+        return 0;
+    }
+
+    unsigned level = t->depth[a] + 1;
+    struct edges bucket = {0}, stack = {0}, affected = {0};
+    int err = 0;
+    newstamp(t);
+    t->mark[y] = t->stamp;
+    err |= heappush(&bucket, t->depth, y);
+    while (!err && bucket.n > 0) {
+        unsigned w = heappop(&bucket, t->depth);
+        unsigned current = t->depth[w];
+        err |= push(&affected, w);
+        // blocks deeper than w are unaffected, but lead to more blocks
+        for (;;) {
+            const struct edges* succ = &t->succ[w];
+            for (unsigned e = 0; !err && e < succ->n; e++) {
+                unsigned s = succ->a[e];
+                if (t->depth[s] <= level || t->mark[s] == t->stamp) {
+                    continue;
+                }
+                t->mark[s] = t->stamp;
+                if (t->depth[s] > current) {
+                    err |= push(&stack, s);
+                } else {
+                    err |= heappush(&bucket, t->depth, s);
+                }
+            }
+            if (err || stack.n == 0) {
+                break;
+            }
+            w = stack.a[--stack.n];
+        }
+    }
+
+    // the subtrees of the affected blocks move up, as a whole
+    for (unsigned k = 0; !err && k < affected.n; k++) {
+        setidom(t, affected.a[k], a);
+    }
+    stack.n = 0;
+    for (unsigned k = 0; !err && k < affected.n; k++) {
+        t->depth[affected.a[k]] = level;
+        err |= push(&stack, affected.a[k]);
+    }
+    while (!err && stack.n > 0) {
+        unsigned p = stack.a[--stack.n];
+        for (unsigned c = t->child[p]; c != CFG_UNDEF; c = t->next[c]) {
+            t->depth[c] = t->depth[p] + 1;
+            err |= push(&stack, c);
+        }
+    }
+
+    free(bucket.a);
+    free(stack.a);
+    free(affected.a);
+    return err ? -1 : 0;
+}
+
+// ==================================================
+//
+// a semi-NCA run over part of the graph, as LLVM's SemiNCAInfo.
+// the blocks visited are numbered from 1 in depth first preorder,
+// order[k] is the block numbered k and the other arrays are indexed by
+// number. 0 is no block, the parent of the first one.
+//
+// ==================================================
+struct snca {
+    struct edges order;
+    struct edges parent;
+    struct edges semi;
+    struct edges label;
+    struct edges idom;
+    struct edges stack;
+};
+
+static void sncafree(struct snca* s) {
+    free(s->order.a);
+    free(s->parent.a);
+    free(s->semi.a);
+    free(s->label.a);
+    free(s->idom.a);
+    free(s->stack.a);
+}
+
+static int sncainit(struct snca* s) {
+    s->order.n = s->parent.n = s->semi.n = s->label.n = s->idom.n = 0;
+    s->stack.n = 0;
+    return push(&s->order, CFG_UNDEF) || push(&s->parent, 0) ||
+        push(&s->semi, 0) || push(&s->label, 0) || push(&s->idom, 0);
+}
+
+// ==================================================
+//
+// numbers the blocks reached from root in depth first preorder, on a
+// new stamp. with newblocks, it descends to the unreachable blocks,
+// and appends the edges to reachable ones to found, as pairs.
+// otherwise it descends to the blocks deeper than level, and appends
+// the other blocks it reaches to found, if given.
+// returns 0 on success, -1 if out of memory.
+//
+// ==================================================
+static int dfs(struct domtree* t, struct snca* s, unsigned root,
+    int newblocks, unsigned level, struct edges* found) {
+    if (sncainit(s)) {
+        return -1;
+    }
+    newstamp(t);
+    // pairs of block and the number of its parent
+    if (push(&s->stack, root) || push(&s->stack, 0)) {
+        return -1;
+    }
+    while (s->stack.n > 0) {
+        unsigned parent = s->stack.a[--s->stack.n];
+        unsigned v = s->stack.a[--s->stack.n];
+        if (t->mark[v] == t->stamp) {
+            continue;
+        }
+        t->mark[v] = t->stamp;
+        unsigned k = t->num[v] = s->order.n;
+        if (push(&s->order, v) || push(&s->parent, parent) ||
+            push(&s->semi, k) || push(&s->label, k) || push(&s->idom, 0)) {
+            return -1;
+        }
+        const struct edges* succ = &t->succ[v];
+        for (unsigned e = 0; e < succ->n; e++) {
+            unsigned w = succ->a[e];
+            if (t->mark[w] == t->stamp) {
+                continue;
+            }
+            int descend = newblocks ? t->depth[w] == 0 : t->depth[w] > level;
+            if (descend) {
+                if (push(&s->stack, w) || push(&s->stack, k)) {
+                    return -1;
+                }
+            } else if (newblocks) {
+                if (push(found, v) || push(found, w)) {
+                    return -1;
+                }
+            } else if (found != NULL && !contains(found, w)) {
+                if (push(found, w)) {
+                    return -1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+// ==================================================
+//
+// the ancestor of v, in the forest of the numbers below linked, whose
+// semidominator is the least, compressing the path to it
+//
+// ==================================================
+static unsigned eval(struct snca* s, unsigned v, unsigned linked) {
+    unsigned* parent = s->parent.a;
+    unsigned* label = s->label.a;
+    const unsigned* semi = s->semi.a;
+    if (parent[v] < linked) {
+        return label[v];
+    }
+    // the stack has room for every number, see seminca
+    s->stack.n = 0;
+    do {
+        s->stack.a[s->stack.n++] = v;
+        v = parent[v];
+    } while (parent[v] >= linked);
+    unsigned p = v, plabel = label[p];
+    do {
+        v = s->stack.a[--s->stack.n];
+        parent[v] = parent[p];
+        if (semi[plabel] < semi[label[v]]) {
+            label[v] = plabel;
+        } else {
+            plabel = label[v];
+        }
+        p = v;
+    } while (s->stack.n > 0);
+    return label[v];
+}
+
+// ==================================================
+//
+// computes the immediate dominators of the blocks numbered by dfs,
+// as numbers, from the predecessors that dfs visited
+//
+// ==================================================
+static int seminca(struct domtree* t, struct snca* s) {
+    unsigned last = s->order.n - 1;
+    s->stack.n = 0;
+    for (unsigned k = 0; k <= last; k++) {
+        if (push(&s->stack, 0)) {
+            return -1;
+        }
+    }
+    unsigned* semi = s->semi.a;
+    unsigned* idom = s->idom.a;
+    for (unsigned k = 1; k <= last; k++) {
+        idom[k] = s->parent.a[k];
+    }
+    for (unsigned k = last; k >= 2; k--) {
+        unsigned w = s->order.a[k];
+        semi[k] = s->parent.a[k];
+        const struct edges* pred = &t->pred[w];
+        for (unsigned e = 0; e < pred->n; e++) {
+            unsigned p = pred->a[e];
+            if (t->mark[p] != t->stamp) {
+                continue;
+            }
+            unsigned u = eval(s, t->num[p], k + 1);
+            if (semi[u] < semi[k]) {
+                semi[k] = semi[u];
+            }
+        }
+    }
+    for (unsigned k = 2; k <= last; k++) {
+        unsigned c = idom[k];
+        while (c > semi[k]) {
+            c = idom[c];
+        }
+        idom[k] = c;
+    }
+    return 0;
+}
+
+// ==================================================
+//
+// moves the blocks numbered by dfs under their new immediate
+// dominators, the first one under p, and updates their depths
+//
+// ==================================================
+static void attach(struct domtree* t, const struct snca* s, unsigned p) {
+    unsigned last = s->order.n - 1;
+    const unsigned* order = s->order.a;
+    for (unsigned k = 1; k <= last; k++) {
+        unsigned b = order[k];
+        setidom(t, b, k == 1 ? p : order[s->idom.a[k]]);
+        t->depth[b] = t->idom[b] == CFG_UNDEF ? 1 : t->depth[t->idom[b]] + 1;
+    }
+}
+
+// ==================================================
+//
+// rebuilds the subtree of the reachable block r, after a deletion
+//
+// ==================================================
+static int rebuild(struct domtree* t, struct snca* s, unsigned r) {
+    unsigned p = t->idom[r];
+    if (dfs(t, s, r, 0, t->depth[r], NULL) || seminca(t, s)) {
+        return -1;
+    }
+    attach(t, s, p);
+    return 0;
+}
+
+// ==================================================
+//
+// updates the tree after the insertion of the edge x -> y, x reachable
+// and y not. the blocks that y reaches through unreachable blocks get
+// their own tree, attached under x, then the edges from them to the
+// blocks that were reachable are inserted one by one.
+//
+// ==================================================
+static int insertunreachable(struct domtree* t, unsigned x, unsigned y) {
+    struct snca s = {0};
+    struct edges found = {0};
+    int err = dfs(t, &s, y, 1, 0, &found) || seminca(t, &s);
+    if (!err) {
+        attach(t, &s, x);
+    }
+    for (unsigned k = 0; !err && k < found.n; k += 2) {
+        err = insert(t, found.a[k], found.a[k + 1]);
+    }
+    sncafree(&s);
+    free(found.a);
+    return err ? -1 : 0;
+}
+
+// ==================================================
+//
+// returns true if a reachable predecessor of y, but for the ones
+// it dominates, keeps it reachable
+//
+// ==================================================
+static int hassupport(const struct domtree* t, unsigned y) {
+    const struct edges* pred = &t->pred[y];
+    for (unsigned e = 0; e < pred->n; e++) {
+        unsigned p = pred->a[e];
+        if (t->depth[p] != 0 && nca(t, y, p) != y) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// ==================================================
+//
+// updates the tree after the deletion of the edge x -> y, both
+// reachable before it, as LLVM's DeleteReachable and DeleteUnreachable.
+// if y stays reachable, only the subtree of nca(x, y) can change and it
+// is rebuilt. otherwise the subtree of y becomes unreachable, and the
+// blocks it reached from below keep their reachability but may lose
+// dominators: the subtree of their nearest common ancestor with y is
+// rebuilt.
+//
+// ==================================================
+static int deleteedge(struct domtree* t, unsigned x, unsigned y) {
+    unsigned a = nca(t, x, y);
+    if (a == y) {
+        return 0;
+    }
+    struct snca s = {0};
+    int err = 0;
+    if (t->idom[y] != x || hassupport(t, y)) {
+        err = rebuild(t, &s, a);
+        sncafree(&s);
+        return err;
+    }
+
+    struct edges affected = {0};
+    unsigned top = y;
+    err = dfs(t, &s, y, 0, t->depth[y], &affected);
+    for (unsigned k = 0; !err && k < affected.n; k++) {
+        unsigned b = affected.a[k];
+        unsigned c = nca(t, b, y);
+        if (c != b && t->depth[c] < t->depth[top]) {
+            top = c;
+        }
+    }
+    // children first, so each block leaves the tree as a leaf
+    for (unsigned k = s.order.n - 1; !err && k >= 1; k--) {
+        unsigned b = s.order.a[k];
+        setidom(t, b, CFG_UNDEF);
+        t->depth[b] = 0;
+    }
+    if (!err && top != y) {
+        err = rebuild(t, &s, top);
+    }
+    sncafree(&s);
+    free(affected.a);
+    return err;
+}
+
+static unsigned checkblock(lua_State* L, struct domtree* t, int i) {
+    unsigned b = find(t, getbasicblock(L, i));
+    if (b == CFG_UNDEF) {
+        luaL_argerror(L, i, "basic block not in the tree");
+    }
+    return b;
+}
+
+// ==================================================
+//
+// pushes the dominator tree of a graph.
+// returns 0 on success, -1 if out of memory.
+//
+// ==================================================
+int domtree_push(lua_State* L, const struct cfg* g) {
+    struct domtree* t = lua_newuserdata(L, sizeof(struct domtree));
+    memset(t, 0, sizeof(struct domtree));
+    luaL_setmetatable(L, LLB_DOMTREE);
+    if (reserve(t, g->n)) {
+        return -1;
+    }
+
+    for (unsigned i = 0; i < g->n; i++) {
+        t->blocks[i] = g->blocks[i];
+        t->keys[i] = (struct domkey){g->blocks[i], i};
+        t->succ[i] = t->pred[i] = (struct edges){0};
+        t->mark[i] = 0;
+    }
+    t->n = g->n;
+    qsort(t->keys, t->n, sizeof(struct domkey), keycmp);
+    for (unsigned i = 0; i < g->n; i++) {
+        for (unsigned e = g->succoff[i]; e < g->succoff[i + 1]; e++) {
+            if (push(&t->succ[i], g->succ[e]) ||
+                push(&t->pred[g->succ[e]], i)) {
+                return -1;
+            }
+        }
+    }
+    return settree(t, g);
+}
+
+// ==================================================
+//
+// returns the immediate dominator of a basic block, nil for the
+// entry and for unreachable blocks
+//
+// ==================================================
+int domtree_idom(lua_State* L) {
+    struct domtree* t = getdomtree(L, 1);
+    flush(L, t);
+    unsigned b = checkblock(L, t, 2);
+    if (t->idom[b] == CFG_UNDEF) {
+        lua_pushnil(L);
+        return 1;
+    }
+    return bb_new(L, t->blocks[t->idom[b]]);
+}
+
+// ==================================================
+//
+// returns the immediate dominators of all the blocks in one call,
+// idom[i] => j, indexed as domtree:blocks, as in function:idom
+//
+// ==================================================
+int domtree_idoms(lua_State* L) {
+    struct domtree* t = getdomtree(L, 1);
+    flush(L, t);
+    lua_createtable(L, t->n, 0);
+    for (unsigned i = 0; i < t->n; i++) {
+        if (t->idom[i] != CFG_UNDEF) {
+            lua_pushinteger(L, t->idom[i] + 1);
+            lua_seti(L, -2, i + 1);
+        }
+    }
+    return 1;
+}
+
+// ==================================================
+//
+// returns the depth of a basic block in the tree, 1 for the entry
+// and 0 for unreachable blocks
+//
+// ==================================================
+int domtree_depth(lua_State* L) {
+    struct domtree* t = getdomtree(L, 1);
+    flush(L, t);
+    lua_pushinteger(L, t->depth[checkblock(L, t, 2)]);
+    return 1;
+}
+
+// ==================================================
+//
+// returns true if the basic block a dominates b.
+// unreachable blocks are dominated by every block
+//
+// ==================================================
+int domtree_dominates(lua_State* L) {
+    struct domtree* t = getdomtree(L, 1);
+    flush(L, t);
+    unsigned a = checkblock(L, t, 2);
+    unsigned b = checkblock(L, t, 3);
+    if (t->depth[b] == 0 || t->depth[a] == 0) {
+        lua_pushboolean(L, t->depth[b] == 0);
+        return 1;
+    }
+    while (t->depth[b] > t->depth[a]) {
+        b = t->idom[b];
+    }
+    lua_pushboolean(L, a == b);
+    return 1;
+}
+
+// ==================================================
+//
+// returns the basic blocks immediately dominated by a basic block
+//
+// ==================================================
+int domtree_children(lua_State* L) {
+    struct domtree* t = getdomtree(L, 1);
+    flush(L, t);
+    unsigned b = checkblock(L, t, 2);
+    lua_newtable(L);
+    lua_Integer k = 1;
+    for (unsigned c = t->child[b]; c != CFG_UNDEF; c = t->next[c]) {
+        bb_new(L, t->blocks[c]);
+        lua_seti(L, -2, k++);
+    }
+    return 1;
+}
+
+// ==================================================
+//
+// returns the basic blocks of the tree, blocks[1] being the entry
+// and blocks added by insert_edge coming last
+//
+// ==================================================
+int domtree_blocks(lua_State* L) {
+    struct domtree* t = getdomtree(L, 1);
+    lua_createtable(L, t->n, 0);
+    for (unsigned i = 0; i < t->n; i++) {
+        bb_new(L, t->blocks[i]);
+        lua_seti(L, -2, i + 1);
+    }
+    return 1;
+}
+
+// ==================================================
+//
+// notifies the insertion of the edge a -> b in the graph.
+// blocks that are not in the tree are added to it.
+//
+// ==================================================
+int domtree_insert_edge(lua_State* L) {
+    struct domtree* t = getdomtree(L, 1);
+    LLVMBasicBlockRef a = getbasicblock(L, 2);
+    LLVMBasicBlockRef b = getbasicblock(L, 3);
+    unsigned x = find(t, a);
+    x = x != CFG_UNDEF ? x : addblock(t, a);
+    unsigned y = x == CFG_UNDEF ? CFG_UNDEF : find(t, b);
+    y = y != CFG_UNDEF || x == CFG_UNDEF ? y : addblock(t, b);
+    if (x == CFG_UNDEF || y == CFG_UNDEF) {
+        return throw(L, "out of memory");
+    }
+    if (contains(&t->succ[x], y)) {
+        return 0;
+    }
+    if (push(&t->succ[x], y)) {
+        return throw(L, "out of memory");
+    }
+    if (push(&t->pred[y], x)) {
+        removeedge(&t->succ[x], y);
+        return throw(L, "out of memory");
+    }
+
+    // edges from unreachable blocks change nothing
+    if (t->dirty || t->depth[x] == 0) {
+        return 0;
+    }
+    STATS_START(start);
+    int err = t->depth[y] == 0 ? insertunreachable(t, x, y) : insert(t, x, y);
+    if (err) {
+        t->dirty = 1;
+    }
+    STATS_STOP(STATS_DOMTREE, start);
+    return 0;
+}
+
+// ==================================================
+//
+// notifies the deletion of the edge a -> b from the graph
+//
+// ==================================================
+int domtree_delete_edge(lua_State* L) {
+    struct domtree* t = getdomtree(L, 1);
+    unsigned x = find(t, getbasicblock(L, 2));
+    unsigned y = find(t, getbasicblock(L, 3));
+    if (x == CFG_UNDEF || y == CFG_UNDEF || !contains(&t->succ[x], y)) {
+        return 0;
+    }
+    removeedge(&t->succ[x], y);
+    removeedge(&t->pred[y], x);
+    if (t->dirty || t->depth[x] == 0) {
+        return 0;
+    }
+    STATS_START(start);
+    if (deleteedge(t, x, y)) {
+        t->dirty = 1;
+    }
+    STATS_STOP(STATS_DOMTREE, start);
+    return 0;
+}
+
+int domtree_gc(lua_State* L) {
+    struct domtree* t = getdomtree(L, 1);
+    for (unsigned i = 0; i < t->n; i++) {
+        free(t->succ[i].a);
+        free(t->pred[i].a);
+    }
+    free(t->blocks);
+    free(t->keys);
+    free(t->succ);
+    free(t->pred);
+    free(t->idom);
+    free(t->depth);
+    free(t->child);
+    free(t->next);
+    free(t->prev);
+    free(t->mark);
+    free(t->num);
+    memset(t, 0, sizeof(struct domtree));
+    return 0;
+}
+
+int domtree_tostring(lua_State* L) {
+    struct domtree* t = getdomtree(L, 1);
+    lua_pushfstring(L, "domtree: %p", t);
+    return 1;
+}
@@ -0,0 +1,73 @@
+/*
+ * Lua binding for LLVM C API.
+ * Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+ *
+ * This file is part of llb.
+ *
+ * llb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * llb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with llb. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LLB_DOMTREE_H
+#define _LLB_DOMTREE_H
+
+// ==================================================
+//
+// a dominator tree that follows the edits of its graph.
+// edits update the tree in place as LLVM's semi-NCA updater does:
+// edges between reachable blocks with the depth based search of
+// Georgiadis et al., edges to new blocks and deleted edges with
+// semi-NCA over the subtrees they affect. the tree is only recomputed
+// from its own edges, by the next query, after running out of memory.
+//
+// ==================================================
+struct domtree {
+    unsigned n, cap;
+    LLVMBasicBlockRef* blocks;
+    // blocks sorted by address
+    struct domkey* keys;
+    // successors and predecessors of each block, without duplicates
+    struct edges* succ;
+    struct edges* pred;
+    // idom[i] is CFG_UNDEF for the entry and for unreachable blocks
+    unsigned* idom;
+    // the entry has depth 1, unreachable blocks have depth 0
+    unsigned* depth;
+    // children lists: child[i] is the first child of i, next[i] and
+    // prev[i] are its siblings
+    unsigned* child;
+    unsigned* next;
+    unsigned* prev;
+    // mark[i] == stamp if i was visited by the current update
+    unsigned* mark;
+    unsigned stamp;
+    // preorder numbers of the blocks visited by a semi-NCA run
+    unsigned* num;
+    int dirty;
+};
+
+struct cfg;
+
+extern int domtree_push(lua_State*, const struct cfg*);
+extern int domtree_idom(lua_State*);
+extern int domtree_idoms(lua_State*);
+extern int domtree_depth(lua_State*);
+extern int domtree_dominates(lua_State*);
+extern int domtree_children(lua_State*);
+extern int domtree_blocks(lua_State*);
+extern int domtree_insert_edge(lua_State*);
+extern int domtree_delete_edge(lua_State*);
+extern int domtree_gc(lua_State*);
+extern int domtree_tostring(lua_State*);
+
+#endif
@@ -66,7 +66,8 @@ end
 
 --
 -- returns a graphviz representable format of a
--- imediate dominance graph
+-- imediate dominance graph, receives bbgraph:idom,
+-- idom[node] => the immediate dominator of node
 --
 function dot:idomgraph(idom, name)
     local file = {}
@@ -74,14 +75,100 @@ function dot:idomgraph(idom, name)
         .. ' function" {')
     table.insert(file, '\tlabel="Imediate Dominance graph for ' .. name
         .. ' function";\n')
-    for node, dominated in pairs(idom) do
+    local nodes = {}
+    for node, dominator in pairs(idom) do
+        nodes[node] = true
+        nodes[dominator] = true
+    end
+    for node in pairs(nodes) do
         table.insert(file, '\tNode' .. tostring(node.ref)
             .. ' [shape=record,label="{' .. tostring(node.ref) .. '}"];')
-        for d in pairs(dominated) do
-            if node.ref ~= d.ref then
-                table.insert(file, '\tNode' .. tostring(d.ref)
-                    .. ' -> ' .. 'Node' .. tostring(node.ref) .. ';')
-            end
+    end
+    for node, dominator in pairs(idom) do
+        if node ~= dominator then
+            table.insert(file, '\tNode' .. tostring(dominator.ref)
+                .. ' -> ' .. 'Node' .. tostring(node.ref) .. ';')
+        end
+    end
+    table.insert(file, '}')
+    return table.concat(file, '\n')
+end
+
+--
+-- escapes a block name for the label of a record
+--
+local function label(name)
+    return (name:gsub('[\\"{}|<>]', '\\%0'))
+end
+
+--
+-- returns a graphviz representable format of the
+-- loop nesting forest, receives function:cfg and function:loops.
+-- loops are nested clusters, back edges are bold and
+-- the blocks of irreducible regions are filled.
+-- nodes are named by the index of their block, as in function:to_dot
+--
+function dot:loopgraph(cfg, loops, name)
+    local file = {}
+    table.insert(file, 'digraph "Loops for ' .. name .. ' function" {')
+    table.insert(file, '\tlabel="Loops for ' .. name .. ' function";\n')
+
+    local irreducible, back = {}, {}
+    for _, region in ipairs(loops.irreducible) do
+        for _, i in ipairs(region.blocks) do
+            irreducible[i] = true
+        end
+    end
+    for _, loop in ipairs(loops.loops) do
+        for _, latch in ipairs(loop.latches) do
+            back[latch .. ">" .. loop.header] = true
+        end
+    end
+
+    -- members[l] => blocks whose innermost loop is l, 0 for no loop
+    local members = {}
+    for l = 0, #loops.loops do
+        members[l] = {}
+    end
+    for i in ipairs(cfg.blocks) do
+        table.insert(members[loops.loopof[i] or 0], i)
+    end
+
+    local function node(i, indent)
+        local attributes = irreducible[i] and ',style=filled' or ''
+        local name = tostring(cfg.blocks[i])
+        table.insert(file, indent .. 'Node' .. i
+            .. ' [shape=record,label="{'
+            .. (name == '' and tostring(i) or label(name)) .. '}"'
+            .. attributes .. '];')
+    end
+
+    local function cluster(l, indent)
+        local loop = loops.loops[l]
+        table.insert(file, indent .. 'subgraph cluster_loop' .. l .. ' {')
+        table.insert(file, indent .. '\tlabel="loop ' .. l .. ', depth '
+            .. loop.depth .. '";')
+        for _, i in ipairs(members[l]) do
+            node(i, indent .. '\t')
+        end
+        for _, child in ipairs(loop.children) do
+            cluster(child, indent .. '\t')
+        end
+        table.insert(file, indent .. '}')
+    end
+
+    for _, i in ipairs(members[0]) do
+        node(i, '\t')
+    end
+    for _, root in ipairs(loops.roots) do
+        cluster(root, '\t')
+    end
+
+    for i in ipairs(cfg.blocks) do
+        for k = cfg.succoff[i], cfg.succoff[i + 1] - 1 do
+            local s = cfg.succ[k]
+            table.insert(file, '\tNode' .. i .. ' -> Node' .. s
+                .. (back[i .. ">" .. s] and ' [style=bold]' or '') .. ';')
         end
     end
     table.insert(file, '}')
@@ -0,0 +1,322 @@
+/*
+ * Lua binding for LLVM C API.
+ * Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+ *
+ * This file is part of llb.
+ *
+ * llb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * llb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with llb. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <lauxlib.h>
+#include <lua.h>
+
+#include <llvm-c/Core.h>
+
+#include "bb.h"
+#include "core.h"
+#include "find.h"
+#include "function.h"
+#include "instruction.h"
+#include "lazy.h"
+
+// ==================================================
+//
+// the names of the opcodes, as written in the IR
+//
+// ==================================================
+#define MAXOPCODE (128)
+
+static const struct {
+    const char* name;
+    LLVMOpcode opcode;
+} opcodes[] = {
+    {"ret", LLVMRet},
+    {"br", LLVMBr},
+    {"switch", LLVMSwitch},
+    {"indirectbr", LLVMIndirectBr},
+    {"invoke", LLVMInvoke},
+    {"unreachable", LLVMUnreachable},
+    {"callbr", LLVMCallBr},
+    {"fneg", LLVMFNeg},
+    {"add", LLVMAdd},
+    {"fadd", LLVMFAdd},
+    {"sub", LLVMSub},
+    {"fsub", LLVMFSub},
+    {"mul", LLVMMul},
+    {"fmul", LLVMFMul},
+    {"udiv", LLVMUDiv},
+    {"sdiv", LLVMSDiv},
+    {"fdiv", LLVMFDiv},
+    {"urem", LLVMURem},
+    {"srem", LLVMSRem},
+    {"frem", LLVMFRem},
+    {"shl", LLVMShl},
+    {"lshr", LLVMLShr},
+    {"ashr", LLVMAShr},
+    {"and", LLVMAnd},
+    {"or", LLVMOr},
+    {"xor", LLVMXor},
+    {"alloca", LLVMAlloca},
+    {"load", LLVMLoad},
+    {"store", LLVMStore},
+    {"getelementptr", LLVMGetElementPtr},
+    {"trunc", LLVMTrunc},
+    {"zext", LLVMZExt},
+    {"sext", LLVMSExt},
+    {"fptoui", LLVMFPToUI},
+    {"fptosi", LLVMFPToSI},
+    {"uitofp", LLVMUIToFP},
+    {"sitofp", LLVMSIToFP},
+    {"fptrunc", LLVMFPTrunc},
+    {"fpext", LLVMFPExt},
+    {"ptrtoint", LLVMPtrToInt},
+    {"inttoptr", LLVMIntToPtr},
+    {"bitcast", LLVMBitCast},
+    {"addrspacecast", LLVMAddrSpaceCast},
+    {"icmp", LLVMICmp},
+    {"fcmp", LLVMFCmp},
+    {"phi", LLVMPHI},
+    {"call", LLVMCall},
+    {"select", LLVMSelect},
+    {"va_arg", LLVMVAArg},
+    {"extractelement", LLVMExtractElement},
+    {"insertelement", LLVMInsertElement},
+    {"shufflevector", LLVMShuffleVector},
+    {"extractvalue", LLVMExtractValue},
+    {"insertvalue", LLVMInsertValue},
+    {"freeze", LLVMFreeze},
+    {"fence", LLVMFence},
+    {"cmpxchg", LLVMAtomicCmpXchg},
+    {"atomicrmw", LLVMAtomicRMW},
+    {"resume", LLVMResume},
+    {"landingpad", LLVMLandingPad},
+    {"cleanupret", LLVMCleanupRet},
+    {"catchret", LLVMCatchRet},
+    {"catchpad", LLVMCatchPad},
+    {"cleanuppad", LLVMCleanupPad},
+    {"catchswitch", LLVMCatchSwitch},
+};
+
+#define NOPCODES (sizeof(opcodes) / sizeof(opcodes[0]))
+
+static const char* opcodename(LLVMOpcode opcode) {
+    for (unsigned i = 0; i < NOPCODES; i++) {
+        if (opcodes[i].opcode == opcode) {
+            return opcodes[i].name;
+        }
+    }
+    return "unknown";
+}
+
+// ==================================================
+//
+// reads the opcodes at index i, a name or an array of names and
+// integers, into a mask indexed by opcode
+//
+// ==================================================
+static void checkopcode(lua_State* L, int i, unsigned char* mask) {
+    lua_Integer opcode = 0;
+    if (lua_type(L, -1) == LUA_TNUMBER) {
+        opcode = lua_tointeger(L, -1);
+    } else if (lua_type(L, -1) == LUA_TSTRING) {
+        lua_getfield(L, LUA_REGISTRYINDEX, LLB_OPCODES);
+        lua_pushvalue(L, -2);
+        lua_rawget(L, -2);
+        opcode = lua_tointeger(L, -1);
+        lua_pop(L, 2);
+    }
+    if (opcode <= 0 || opcode >= MAXOPCODE) {
+        luaL_argerror(L, i, "invalid opcode");
+    }
+    mask[opcode] = 1;
+}
+
+static void checkopcodes(lua_State* L, int i, unsigned char* mask) {
+    for (int k = 0; k < MAXOPCODE; k++) {
+        mask[k] = 0;
+    }
+    if (lua_type(L, i) == LUA_TSTRING) {
+        lua_pushvalue(L, i);
+        checkopcode(L, i, mask);
+        lua_pop(L, 1);
+        return;
+    }
+    luaL_checktype(L, i, LUA_TTABLE);
+    lua_Integer n = luaL_len(L, i);
+    for (lua_Integer k = 1; k <= n; k++) {
+        lua_geti(L, i, k);
+        checkopcode(L, i, mask);
+        lua_pop(L, 1);
+    }
+}
+
+// ==================================================
+//
+// the results of find: an array of instructions, or tables of arrays
+// keyed by opcode name, basic block or function
+//
+// ==================================================
+enum { FLAT, BYOPCODE, BYBLOCK, BYFUNCTION };
+
+// in the order of the enum, from BYOPCODE
+static const char* const groups[] = {"opcode", "block", "function", NULL};
+
+static void append(lua_State* L, int t) {
+    lua_rawseti(L, t, lua_rawlen(L, t) + 1);
+}
+
+// an array for each opcode asked, even if nothing is found
+static void newresult(lua_State* L, const unsigned char* mask, int group) {
+    lua_newtable(L);
+    if (group != BYOPCODE) {
+        return;
+    }
+    for (int k = 0; k < MAXOPCODE; k++) {
+        if (mask[k]) {
+            lua_newtable(L);
+            lua_setfield(L, -2, opcodename(k));
+        }
+    }
+}
+
+// ==================================================
+//
+// adds the matching instructions of f to the result on top of the stack
+//
+// ==================================================
+static void scan(lua_State* L, LLVMValueRef f, const unsigned char* mask,
+    int group) {
+    int result = lua_gettop(L);
+    for (LLVMBasicBlockRef bb = LLVMGetFirstBasicBlock(f); bb != NULL;
+         bb = LLVMGetNextBasicBlock(bb)) {
+        // the array of the block is created on its first match
+        int array = group == BYBLOCK ? 0 : result;
+        for (LLVMValueRef inst = LLVMGetFirstInstruction(bb); inst != NULL;
+             inst = LLVMGetNextInstruction(inst)) {
+            LLVMOpcode opcode = LLVMGetInstructionOpcode(inst);
+            if (opcode >= MAXOPCODE || !mask[opcode]) {
+                continue;
+            }
+            if (group == BYOPCODE) {
+                lua_getfield(L, result, opcodename(opcode));
+                instruction_new(L, inst);
+                append(L, -2);
+                lua_pop(L, 1);
+                continue;
+            }
+            if (array == 0) {
+                bb_new(L, bb);
+                lua_newtable(L);
+                array = lua_gettop(L);
+            }
+            instruction_new(L, inst);
+            append(L, array);
+        }
+        if (group == BYBLOCK && array != 0) {
+            lua_rawset(L, result);
+        }
+    }
+}
+
+// ==================================================
+//
+// finds the instructions of a function with the given opcodes:
+// function:find({"load", "store"}) => {instruction}
+// function:find({"load", "store"}, "opcode") => {load = {...}, ...}
+// function:find({"load", "store"}, "block") => {[block] = {...}}
+// opcodes are names, as in the IR, or integers, see llb.opcodes.
+// only the instructions found are wrapped as objects.
+//
+// ==================================================
+int find_function(lua_State* L) {
+    LLVMValueRef f = function_checkbody(L, 1);
+    unsigned char mask[MAXOPCODE];
+    checkopcodes(L, 2, mask);
+    int group = lua_isnoneornil(L, 3)
+        ? FLAT
+        : luaL_checkoption(L, 3, NULL, groups) + BYOPCODE;
+    luaL_argcheck(L, group != BYFUNCTION, 3, "functions have one function");
+
+    newresult(L, mask, group);
+    scan(L, f, mask, group);
+    return 1;
+}
+
+// ==================================================
+//
+// finds the instructions of all the functions of a module, as
+// function:find. instructions may also be grouped by "function".
+//
+// ==================================================
+int find_module(lua_State* L) {
+    LLVMModuleRef module = getmodule(L, 1);
+    unsigned char mask[MAXOPCODE];
+    checkopcodes(L, 2, mask);
+    int group = lua_isnoneornil(L, 3)
+        ? FLAT
+        : luaL_checkoption(L, 3, NULL, groups) + BYOPCODE;
+
+    newresult(L, mask, group);
+    int result = lua_gettop(L);
+    for (LLVMValueRef f = LLVMGetFirstFunction(module); f != NULL;
+         f = LLVMGetNextFunction(f)) {
+        char* err;
+        if (lazy_materialize(f, &err)) {
+            lua_pushfstring(L, "[LLVM] %s", err);
+            LLVMDisposeMessage(err);
+            lua_error(L);
+        }
+        if (group != BYFUNCTION) {
+            scan(L, f, mask, group);
+            continue;
+        }
+        function_new(L, f);
+        lua_newtable(L);
+        scan(L, f, mask, FLAT);
+        if (lua_rawlen(L, -1) > 0) {
+            lua_rawset(L, result);
+        } else {
+            lua_pop(L, 2);
+        }
+    }
+    return 1;
+}
+
+// ==================================================
+//
+// the opcodes table, name => integer and integer => name
+//
+// ==================================================
+static void pushopcodes(lua_State* L) {
+    lua_createtable(L, MAXOPCODE, NOPCODES);
+    for (unsigned i = 0; i < NOPCODES; i++) {
+        lua_pushinteger(L, opcodes[i].opcode);
+        lua_setfield(L, -2, opcodes[i].name);
+        lua_pushstring(L, opcodes[i].name);
+        lua_rawseti(L, -2, opcodes[i].opcode);
+    }
+}
+
+// ==================================================
+//
+// sets llb.opcodes in the library on top of the stack, and a private
+// copy in the registry
+//
+// ==================================================
+void find_open(lua_State* L) {
+    pushopcodes(L);
+    lua_setfield(L, LUA_REGISTRYINDEX, LLB_OPCODES);
+    pushopcodes(L);
+    lua_setfield(L, -2, "opcodes");
+}
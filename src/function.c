@@ -20,31 +20,64 @@
 
 #include <lauxlib.h>
 #include <lua.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <llvm-c/Core.h>
 
 #include "bb.h"
+#include "bitset.h"
+#include "cfg.h"
 #include "core.h"
+#include "defuse.h"
+#include "dom.h"
+#include "domtree.h"
 #include "function.h"
+#include "graphviz.h"
+#include "instruction.h"
+#include "lazy.h"
+#include "live.h"
+#include "loop.h"
+#include "ssa.h"
+#include "stream.h"
 
 // ==================================================
 //
-// instantiates a new function object
+// instantiates a new function object, or reuses the interned one
 //
 // ==================================================
 int function_new(lua_State* L, LLVMValueRef function) {
-    newuserdata(L, function, LLB_FUNCTION);
+    pushobject(L, function, LLB_FUNCTION);
     return 1;
 }
 
+// ==================================================
+//
+// gets the function at index i, reading its body first if its module
+// was loaded lazily
+//
+// ==================================================
+LLVMValueRef function_checkbody(lua_State* L, int i) {
+    LLVMValueRef f = getfunction(L, i);
+    char* err;
+    if (lazy_materialize(f, &err)) {
+        lua_pushfstring(L, "[LLVM] %s", err);
+        LLVMDisposeMessage(err);
+        lua_error(L);
+    }
+    return f;
+}
+
 // ==================================================
 //
 // gets all function's basic blocks
 //
 // ==================================================
 int function_basic_blocks(lua_State* L) {
-    LLVMValueRef f = getfunction(L, 1);
+    LLVMValueRef f = function_checkbody(L, 1);
     unsigned size = LLVMCountBasicBlocks(f);
 
     lua_newtable(L);
@@ -67,6 +100,786 @@ int function_basic_blocks(lua_State* L) {
     return 1;
 }
 
+// ==================================================
+//
+// builds the graph of the basic blocks listed at index 2,
+// or of all the function's basic blocks if there is no list
+//
+// ==================================================
+static void checkcfg(lua_State* L, struct cfg* g) {
+    LLVMValueRef f = function_checkbody(L, 1);
+    if (lua_isnoneornil(L, 2)) {
+        if (cfg_fromfunction(g, f)) {
+            throw(L, "out of memory");
+        }
+        return;
+    }
+
+    luaL_checktype(L, 2, LUA_TTABLE);
+    unsigned n = luaL_len(L, 2);
+    LLVMBasicBlockRef* blocks = malloc((n + 1) * sizeof(LLVMBasicBlockRef));
+    if (blocks == NULL) {
+        throw(L, "out of memory");
+    }
+    for (unsigned i = 0; i < n; i++) {
+        lua_geti(L, 2, i + 1);
+        LLVMBasicBlockRef* bb = luaL_testudata(L, -1, LLB_BASICBLOCK);
+        lua_pop(L, 1);
+        if (bb == NULL) {
+            free(blocks);
+            luaL_argerror(L, 2, "expected a list of basic blocks");
+        }
+        blocks[i] = *bb;
+    }
+    if (cfg_build(g, blocks, n)) {
+        throw(L, "out of memory");
+    }
+}
+
+// ==================================================
+//
+// sets t[key] to an array with the n integers of a, plus 1
+//
+// ==================================================
+static void setarray(lua_State* L, const char* key, unsigned* a, unsigned n) {
+    lua_createtable(L, n, 0);
+    for (unsigned i = 0; i < n; i++) {
+        lua_pushinteger(L, a[i] + 1);
+        lua_seti(L, -2, i + 1);
+    }
+    lua_setfield(L, -2, key);
+}
+
+// ==================================================
+//
+// builds the control flow graph of the function's basic blocks.
+// receives an optional list of basic blocks, blocks[1] being the entry.
+// returns a table of integer indexed arrays:
+// blocks[i], the basic block of node i
+// succ[succoff[i] .. succoff[i + 1] - 1], the successors of i
+// pred[predoff[i] .. predoff[i + 1] - 1], the predecessors of i
+// rpo, the nodes reachable from the entry in reverse postorder
+// order[i], the position of i in rpo, nil if i is unreachable
+//
+// ==================================================
+int function_cfg(lua_State* L) {
+    struct cfg g;
+    checkcfg(L, &g);
+
+    lua_createtable(L, 0, 7);
+    lua_createtable(L, g.n, 0);
+    for (unsigned i = 0; i < g.n; i++) {
+        bb_new(L, g.blocks[i]);
+        lua_seti(L, -2, i + 1);
+    }
+    lua_setfield(L, -2, "blocks");
+    setarray(L, "succoff", g.succoff, g.n + 1);
+    setarray(L, "succ", g.succ, g.succoff[g.n]);
+    setarray(L, "predoff", g.predoff, g.n + 1);
+    setarray(L, "pred", g.pred, g.predoff[g.n]);
+    setarray(L, "rpo", g.rpo, g.nrpo);
+    lua_createtable(L, g.n, 0);
+    for (unsigned k = 0; k < g.nrpo; k++) {
+        lua_pushinteger(L, k + 1);
+        lua_seti(L, -2, g.rpo[k] + 1);
+    }
+    lua_setfield(L, -2, "order");
+
+    cfg_free(&g);
+    return 1;
+}
+
+// ==================================================
+//
+// computes the immediate dominators of the function's basic blocks.
+// receives an optional list of basic blocks, blocks[1] being the entry.
+// returns idom[i] => j, basic block j is the immediate dominator of i
+//
+// ==================================================
+int function_idom(lua_State* L) {
+    struct cfg g;
+    checkcfg(L, &g);
+
+    unsigned* idom = malloc((g.n + 1) * sizeof(unsigned));
+    if (idom == NULL || dom_idom(&g, idom)) {
+        free(idom);
+        cfg_free(&g);
+        return throw(L, "out of memory");
+    }
+
+    lua_createtable(L, g.n, 0);
+    for (unsigned i = 0; i < g.n; i++) {
+        if (idom[i] != CFG_UNDEF) {
+            lua_pushinteger(L, idom[i] + 1);
+            lua_seti(L, -2, i + 1);
+        }
+    }
+
+    free(idom);
+    cfg_free(&g);
+    return 1;
+}
+
+// ==================================================
+//
+// builds the def-use index of the function's instructions, numbered
+// densely in block order, in a single native walk.
+// receives an optional list of basic blocks, blocks[1] being the entry,
+// and an optional table of options:
+// instructions, to also get the instruction objects
+// returns a table with n, the number of instructions, nargs, the
+// number of arguments, and integer arrays:
+// blocks[b], the basic block of node b, as in function:cfg
+// opcode[i], the opcode of instruction i, see llb.opcodes
+// block[i], the block of i, the instructions of block b are
+//     blockoff[b] .. blockoff[b + 1] - 1
+// operand[opoff[i] .. opoff[i + 1] - 1], the operands of i: j > 0 is
+//     the instruction j, -k the argument k, 0 anything else
+// use[useoff[i] .. useoff[i + 1] - 1], the users of i, once per operand
+// instructions[i], the instruction i, if asked
+//
+// ==================================================
+int function_ssa_index(lua_State* L) {
+    struct cfg g;
+    checkcfg(L, &g);
+    int instructions = 0;
+    if (!lua_isnoneornil(L, 3)) {
+        luaL_checktype(L, 3, LUA_TTABLE);
+        lua_getfield(L, 3, "instructions");
+        instructions = lua_toboolean(L, -1);
+        lua_pop(L, 1);
+    }
+
+    struct defuse d;
+    if (defuse_build(&d, &g)) {
+        cfg_free(&g);
+        return throw(L, "out of memory");
+    }
+
+    lua_createtable(L, 0, 12);
+    lua_createtable(L, g.n, 0);
+    for (unsigned b = 0; b < g.n; b++) {
+        bb_new(L, g.blocks[b]);
+        lua_seti(L, -2, b + 1);
+    }
+    lua_setfield(L, -2, "blocks");
+    lua_pushinteger(L, d.n);
+    lua_setfield(L, -2, "n");
+    lua_pushinteger(L, d.nargs);
+    lua_setfield(L, -2, "nargs");
+
+    lua_createtable(L, d.n, 0);
+    for (unsigned i = 0; i < d.n; i++) {
+        lua_pushinteger(L, d.opcode[i]);
+        lua_seti(L, -2, i + 1);
+    }
+    lua_setfield(L, -2, "opcode");
+    setarray(L, "block", d.block, d.n);
+    setarray(L, "blockoff", d.blockoff, g.n + 1);
+    setarray(L, "opoff", d.opoff, d.n + 1);
+    lua_createtable(L, d.opoff[d.n], 0);
+    for (unsigned e = 0; e < d.opoff[d.n]; e++) {
+        lua_pushinteger(L, d.operand[e]);
+        lua_seti(L, -2, e + 1);
+    }
+    lua_setfield(L, -2, "operand");
+    setarray(L, "useoff", d.useoff, d.n + 1);
+    setarray(L, "use", d.use, d.useoff[d.n]);
+
+    if (instructions) {
+        lua_createtable(L, d.n, 0);
+        for (unsigned i = 0; i < d.n; i++) {
+            instruction_new(L, d.instructions[i]);
+            lua_seti(L, -2, i + 1);
+        }
+        lua_setfield(L, -2, "instructions");
+    }
+
+    defuse_free(&d);
+    cfg_free(&g);
+    return 1;
+}
+
+// ==================================================
+//
+// builds a dominator tree of the function's basic blocks, that is
+// kept up to date by notifying it of the edges inserted and deleted.
+// receives an optional list of basic blocks, blocks[1] being the entry.
+//
+// ==================================================
+int function_domtree(lua_State* L) {
+    struct cfg g;
+    checkcfg(L, &g);
+    int err = domtree_push(L, &g);
+    cfg_free(&g);
+    return err ? throw(L, "out of memory") : 1;
+}
+
+// ==================================================
+//
+// finds the natural loops of the function's basic blocks, their
+// nesting forest and the irreducible regions of the graph.
+// receives an optional list of basic blocks, blocks[1] being the entry.
+// blocks are numbered as in function:cfg, loops as in loops[l]:
+// blocks[i], the basic block of node i
+// loops[l] = {header, parent, depth, preheader, blocks, latches, exits,
+//     children}, parent and preheader may be nil
+// roots, the outermost loops
+// loopof[i], the innermost loop of block i, or nil
+// depth[i], the loop nesting depth of block i, 0 outside of loops
+// irreducible[r] = {blocks, entries}, regions with more than one entry
+//
+// ==================================================
+static void setindex(lua_State* L, const char* key, unsigned i) {
+    if (i != CFG_UNDEF) {
+        lua_pushinteger(L, i + 1);
+        lua_setfield(L, -2, key);
+    }
+}
+
+int function_loops(lua_State* L) {
+    struct cfg g;
+    checkcfg(L, &g);
+
+    struct loops loops;
+    unsigned* idom = malloc((g.n + 1) * sizeof(unsigned));
+    if (idom == NULL || dom_idom(&g, idom) ||
+        loop_build(&loops, &g, idom)) {
+        free(idom);
+        cfg_free(&g);
+        return throw(L, "out of memory");
+    }
+
+    lua_createtable(L, 0, 6);
+    lua_createtable(L, g.n, 0);
+    for (unsigned i = 0; i < g.n; i++) {
+        bb_new(L, g.blocks[i]);
+        lua_seti(L, -2, i + 1);
+    }
+    lua_setfield(L, -2, "blocks");
+
+    lua_createtable(L, loops.n, 0);
+    for (unsigned l = 0; l < loops.n; l++) {
+        lua_createtable(L, 0, 8);
+        setindex(L, "header", loops.header[l]);
+        setindex(L, "parent", loops.parent[l]);
+        setindex(L, "preheader", loops.preheader[l]);
+        lua_pushinteger(L, loops.depth[l]);
+        lua_setfield(L, -2, "depth");
+        unsigned* off = loops.bodyoff;
+        setarray(L, "blocks", loops.body + off[l], off[l + 1] - off[l]);
+        off = loops.latchoff;
+        setarray(L, "latches", loops.latch + off[l], off[l + 1] - off[l]);
+        off = loops.exitoff;
+        setarray(L, "exits", loops.exit + off[l], off[l + 1] - off[l]);
+        lua_newtable(L);
+        lua_setfield(L, -2, "children");
+        lua_seti(L, -2, l + 1);
+    }
+    // parents come first, children are appended in order
+    lua_newtable(L);
+    for (unsigned l = 0; l < loops.n; l++) {
+        lua_pushinteger(L, l + 1);
+        if (loops.parent[l] == CFG_UNDEF) {
+            lua_seti(L, -2, lua_rawlen(L, -2) + 1);
+            continue;
+        }
+        lua_geti(L, -3, loops.parent[l] + 1);
+        lua_getfield(L, -1, "children");
+        lua_rotate(L, -3, -1);
+        lua_rawseti(L, -2, lua_rawlen(L, -2) + 1);
+        lua_pop(L, 2);
+    }
+    lua_setfield(L, -3, "roots");
+    lua_setfield(L, -2, "loops");
+
+    lua_createtable(L, g.n, 0);
+    lua_createtable(L, g.n, 0);
+    for (unsigned i = 0; i < g.n; i++) {
+        unsigned l = loops.loopof[i];
+        lua_pushinteger(L, l == CFG_UNDEF ? 0 : loops.depth[l]);
+        lua_seti(L, -2, i + 1);
+        if (l != CFG_UNDEF) {
+            lua_pushinteger(L, l + 1);
+            lua_seti(L, -3, i + 1);
+        }
+    }
+    lua_setfield(L, -3, "depth");
+    lua_setfield(L, -2, "loopof");
+
+    lua_createtable(L, loops.nregions, 0);
+    for (unsigned r = 0; r < loops.nregions; r++) {
+        lua_createtable(L, 0, 2);
+        unsigned* off = loops.regionoff;
+        setarray(L, "blocks", loops.region + off[r], off[r + 1] - off[r]);
+        off = loops.entryoff;
+        setarray(L, "entries", loops.entry + off[r], off[r + 1] - off[r]);
+        lua_seti(L, -2, r + 1);
+    }
+    lua_setfield(L, -2, "irreducible");
+
+    loop_free(&loops);
+    free(idom);
+    cfg_free(&g);
+    return 1;
+}
+
+// ==================================================
+//
+// computes the liveness of the function's values.
+// receives an optional list of basic blocks, blocks[1] being the entry,
+// and an optional table of options:
+// instructions, to also get the values live after each instruction
+// blocks are numbered as in function:cfg. the sets are bitsets over
+// the values or allocas lists:
+// blocks[i], the basic block of node i
+// values, the arguments and the instructions with a result, other than
+//     the allocas below
+// live_in[i], live_out[i], the values live at the entry and exit of i
+// ranges[value], the blocks where the value is live, in order
+// pressure[i], the most values live at once in block i
+// allocas, the allocas that are only loaded from and stored to
+// allocas_in[i], allocas_out[i], the allocas whose stored value may
+//     still be loaded at the entry and exit of i
+// live_after[instruction], the values live right after it, if asked
+//
+// ==================================================
+static void setsets(lua_State* L, const char* key, int universe,
+                    const uint64_t* sets, unsigned n, unsigned nwords) {
+    lua_createtable(L, n, 0);
+    for (unsigned i = 0; i < n; i++) {
+        bitset_push(L, universe, sets + i * nwords);
+        lua_seti(L, -2, i + 1);
+    }
+    lua_setfield(L, -2, key);
+}
+
+static int setliveafter(lua_State* L, const struct cfg* g,
+                        const struct live* lv, int values) {
+    uint64_t* set = malloc((lv->nwords + 1) * sizeof(uint64_t));
+    if (set == NULL) {
+        return -1;
+    }
+    lua_newtable(L);
+    for (unsigned b = 0; b < g->n; b++) {
+        memcpy(set, lv->out + b * lv->nwords, lv->nwords * sizeof(uint64_t));
+        for (LLVMValueRef inst = LLVMGetLastInstruction(g->blocks[b]);
+             inst != NULL; inst = LLVMGetPreviousInstruction(inst)) {
+            instruction_new(L, inst);
+            bitset_push(L, values, set);
+            lua_settable(L, -3);
+            live_step(lv, inst, set);
+        }
+    }
+    lua_setfield(L, -2, "live_after");
+    free(set);
+    return 0;
+}
+
+int function_liveness(lua_State* L) {
+    struct cfg g;
+    checkcfg(L, &g);
+    int instructions = 0;
+    if (!lua_isnoneornil(L, 3)) {
+        luaL_checktype(L, 3, LUA_TTABLE);
+        lua_getfield(L, 3, "instructions");
+        instructions = lua_toboolean(L, -1);
+        lua_pop(L, 1);
+    }
+
+    struct live lv;
+    if (live_build(&lv, &g)) {
+        cfg_free(&g);
+        return throw(L, "out of memory");
+    }
+
+    // the universes of the bitsets stay below the result
+    lua_createtable(L, lv.nvalues, 0);
+    for (unsigned v = 0; v < lv.nvalues; v++) {
+        instruction_new(L, lv.values[v]);
+        lua_seti(L, -2, v + 1);
+    }
+    int values = lua_gettop(L);
+    lua_createtable(L, lv.nallocas, 0);
+    for (unsigned a = 0; a < lv.nallocas; a++) {
+        instruction_new(L, lv.values[lv.nvalues + a]);
+        lua_seti(L, -2, a + 1);
+    }
+    int allocas = lua_gettop(L);
+
+    lua_createtable(L, 0, 11);
+    lua_createtable(L, g.n, 0);
+    for (unsigned i = 0; i < g.n; i++) {
+        bb_new(L, g.blocks[i]);
+        lua_seti(L, -2, i + 1);
+    }
+    lua_setfield(L, -2, "blocks");
+    lua_pushvalue(L, values);
+    lua_setfield(L, -2, "values");
+    lua_pushvalue(L, allocas);
+    lua_setfield(L, -2, "allocas");
+
+    unsigned nw = lv.nwords;
+    setsets(L, "live_in", values, lv.in, g.n, nw);
+    setsets(L, "live_out", values, lv.out, g.n, nw);
+    unsigned base = lv.slotbase / 64;
+    setsets(L, "allocas_in", allocas, lv.in + base, g.n, nw);
+    setsets(L, "allocas_out", allocas, lv.out + base, g.n, nw);
+    lua_createtable(L, g.n, 0);
+    for (unsigned i = 0; i < g.n; i++) {
+        lua_pushinteger(L, lv.pressure[i]);
+        lua_seti(L, -2, i + 1);
+    }
+    lua_setfield(L, -2, "pressure");
+
+    // ranges are filled block by block, through the lists of values
+    lua_createtable(L, 0, lv.nvalues);
+    for (unsigned v = 0; v < lv.nvalues; v++) {
+        lua_geti(L, values, v + 1);
+        lua_newtable(L);
+        lua_settable(L, -3);
+    }
+    for (unsigned b = 0; b < g.n; b++) {
+        const uint64_t* span = lv.span + b * nw;
+        for (unsigned w = 0; w < base; w++) {
+            for (uint64_t x = span[w]; x != 0; x &= x - 1) {
+                lua_geti(L, values, w * 64 + __builtin_ctzll(x) + 1);
+                lua_gettable(L, -2);
+                lua_pushinteger(L, b + 1);
+                lua_seti(L, -2, lua_rawlen(L, -2) + 1);
+                lua_pop(L, 1);
+            }
+        }
+    }
+    lua_setfield(L, -2, "ranges");
+
+    int err = instructions && setliveafter(L, &g, &lv, values);
+    live_free(&lv);
+    cfg_free(&g);
+    return err ? throw(L, "out of memory") : 1;
+}
+
+// ==================================================
+//
+// computes the dominance frontier of the function's basic blocks.
+// receives an optional list of basic blocks, blocks[1] being the entry.
+// returns the frontier in compact form, off and df:
+// df(i) = {df[off[i]], ..., df[off[i + 1] - 1]}
+//
+// ==================================================
+int function_df(lua_State* L) {
+    struct cfg g;
+    checkcfg(L, &g);
+
+    unsigned* df = NULL;
+    unsigned* idom = malloc((g.n + 1) * sizeof(unsigned));
+    unsigned* off = malloc((g.n + 1) * sizeof(unsigned));
+    if (idom == NULL || off == NULL || dom_idom(&g, idom) ||
+        dom_df(&g, idom, off, &df)) {
+        free(idom);
+        free(off);
+        cfg_free(&g);
+        return throw(L, "out of memory");
+    }
+
+    lua_createtable(L, g.n + 1, 0);
+    for (unsigned i = 0; i <= g.n; i++) {
+        lua_pushinteger(L, off[i] + 1);
+        lua_seti(L, -2, i + 1);
+    }
+    lua_createtable(L, off[g.n], 0);
+    for (unsigned k = 0; k < off[g.n]; k++) {
+        lua_pushinteger(L, df[k] + 1);
+        lua_seti(L, -2, k + 1);
+    }
+
+    free(df);
+    free(idom);
+    free(off);
+    cfg_free(&g);
+    return 2;
+}
+
+// ==================================================
+//
+// transforms the IR to its pruned SSA form, natively.
+// produces the same IR as function.lua's prunedssa.
+// receives an optional builder.
+//
+// ==================================================
+int function_native_prunedssa(lua_State* L) {
+    LLVMValueRef f = function_checkbody(L, 1);
+    touchfunction(L, f, 0);
+    LLVMBuilderRef* builder = luaL_testudata(L, 2, LLB_BUILDER);
+    if (builder != NULL) {
+        if (ssa_prunedssa(f, *builder)) {
+            return throw(L, "out of memory");
+        }
+        return 0;
+    }
+
+    LLVMModuleRef module = LLVMGetGlobalParent(f);
+    LLVMBuilderRef b = LLVMCreateBuilderInContext(LLVMGetModuleContext(module));
+    int err = ssa_prunedssa(f, b);
+    LLVMDisposeBuilder(b);
+    if (err) {
+        return throw(L, "out of memory");
+    }
+    return 0;
+}
+
+// ==================================================
+//
+// returns the epochs of a function: the number of changes made to its
+// IR through llb, and of the ones that changed its control flow graph
+//
+// ==================================================
+int function_epochs(lua_State* L) {
+    luaL_checkudata(L, 1, LLB_FUNCTION);
+    if (lua_getuservalue(L, 1) == LUA_TNIL) {
+        lua_pushinteger(L, 0);
+        lua_pushinteger(L, 0);
+        return 2;
+    }
+    lua_rawgeti(L, -1, 1);
+    lua_rawgeti(L, -2, 2);
+    return 2;
+}
+
+// ==================================================
+//
+// gets the parameters of a function
+//
+// ==================================================
+int function_params(lua_State* L) {
+    LLVMValueRef f = getfunction(L, 1);
+    unsigned n = LLVMCountParams(f);
+    lua_createtable(L, n, 0);
+    for (unsigned i = 0; i < n; i++) {
+        instruction_new(L, LLVMGetParam(f, i));
+        lua_seti(L, -2, i + 1);
+    }
+    return 1;
+}
+
+// ==================================================
+//
+// returns the textual IR of a function as a string, or streams it to
+// the file handle given, through its file descriptor
+//
+// ==================================================
+int function_to_ir(lua_State* L) {
+    LLVMValueRef f = function_checkbody(L, 1);
+    FILE* file = optfile(L, 2);
+    if (file != NULL) {
+        int ok = fflush(file) == 0 &&
+            stream_function_ir(f, fileno(file)) == 0;
+        return pushfile(L, 2, ok);
+    }
+    char* ir = LLVMPrintValueToString(f);
+    int n = pushoutput(L, 2, NULL, ir, strlen(ir));
+    LLVMDisposeMessage(ir);
+    return n;
+}
+
+static const char* const graphs[] = {"cfg", "domtree", "loops", NULL};
+
+static int writefile(void* ud, const char* s, size_t len) {
+    return fwrite(s, 1, len, ud) != len;
+}
+
+static int writebuffer(void* ud, const char* s, size_t len) {
+    luaL_addlstring(ud, s, len);
+    return 0;
+}
+
+static void checkdotoptions(lua_State* L, int i, struct graphviz* gv) {
+    luaL_checktype(L, i, LUA_TTABLE);
+    if (lua_getfield(L, i, "graph") != LUA_TNIL) {
+        const char* graph = lua_tostring(L, -1);
+        for (gv->kind = 0; graphs[gv->kind] != NULL; gv->kind++) {
+            if (graph != NULL && strcmp(graph, graphs[gv->kind]) == 0) {
+                break;
+            }
+        }
+        luaL_argcheck(L, graphs[gv->kind] != NULL, i,
+            "graph must be cfg, domtree or loops");
+    }
+    lua_getfield(L, i, "instructions");
+    gv->instructions = lua_toboolean(L, -1);
+    if (lua_getfield(L, i, "color") != LUA_TNIL) {
+        const char* color = lua_tostring(L, -1);
+        luaL_argcheck(L, color != NULL && strcmp(color, "depth") == 0, i,
+            "color must be depth");
+        gv->depth = 1;
+    }
+    if (lua_getfield(L, i, "name") != LUA_TNIL) {
+        luaL_argcheck(L, lua_type(L, -1) == LUA_TSTRING, i,
+            "name must be a string");
+        gv->name = lua_tostring(L, -1);
+    }
+    int type = lua_getfield(L, i, "weights");
+    luaL_argcheck(L, type == LUA_TNIL || type == LUA_TTABLE, i,
+        "weights must be a table");
+    type = lua_getfield(L, i, "edge_weights");
+    luaL_argcheck(L, type == LUA_TNIL || type == LUA_TTABLE, i,
+        "edge_weights must be a table");
+    luaL_argcheck(L, type == LUA_TNIL || gv->kind != GRAPHVIZ_DOMTREE, i,
+        "edge_weights need the cfg");
+    lua_pop(L, 6);
+}
+
+// ==================================================
+//
+// the arrays of a graph being written by function:to_dot. they are
+// held by a userdata, so they are released even if reading the options
+// or the output raises an error.
+//
+// ==================================================
+#define DOTGRAPH "llb.dotgraph"
+
+struct dotgraph {
+    struct cfg g;
+    struct loops loops;
+    int hasloops;
+    unsigned* idom;
+    double* weight;
+    double* edgeweight;
+};
+
+static void dotgraph_free(struct dotgraph* d) {
+    if (d->hasloops) {
+        loop_free(&d->loops);
+        d->hasloops = 0;
+    }
+    free(d->edgeweight);
+    free(d->weight);
+    free(d->idom);
+    d->edgeweight = NULL;
+    d->weight = NULL;
+    d->idom = NULL;
+    cfg_free(&d->g);
+}
+
+static int dotgraph_gc(lua_State* L) {
+    dotgraph_free(lua_touserdata(L, 1));
+    return 0;
+}
+
+static struct dotgraph* pushdotgraph(lua_State* L) {
+    struct dotgraph* d = lua_newuserdata(L, sizeof(struct dotgraph));
+    memset(d, 0, sizeof(struct dotgraph));
+    if (luaL_newmetatable(L, DOTGRAPH)) {
+        lua_pushcfunction(L, dotgraph_gc);
+        lua_setfield(L, -2, "__gc");
+    }
+    lua_setmetatable(L, -2);
+    return d;
+}
+
+// ==================================================
+//
+// reads t[1] .. t[n] of the table t at option key, if it is present.
+// the entries that are not numbers have no weight. returns -1 if out
+// of memory.
+//
+// ==================================================
+static int optweights(
+    lua_State* L, int i, const char* key, unsigned n, double** w) {
+    *w = NULL;
+    if (lua_getfield(L, i, key) == LUA_TNIL) {
+        lua_pop(L, 1);
+        return 0;
+    }
+    *w = malloc((n + 1) * sizeof(double));
+    if (*w == NULL) {
+        lua_pop(L, 1);
+        return -1;
+    }
+    for (unsigned k = 0; k < n; k++) {
+        int isnum;
+        lua_geti(L, -1, k + 1);
+        double x = lua_tonumberx(L, -1, &isnum);
+        (*w)[k] = isnum ? x : NAN;
+        lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+    return 0;
+}
+
+// ==================================================
+//
+// writes a graph of the function in the graphviz dot format to the
+// file handle given, or returns it as a string. the file is written
+// line by line, keeping only the graph's arrays in memory.
+// receives an optional table of options:
+// graph, "cfg" (the default), "domtree" or "loops", the cfg with a
+//     cluster per loop, as dot:loopgraph
+// instructions, to list the instructions of each block
+// color = "depth", to shade the blocks and edges by their loop depth
+// weights[b] and edge_weights[k], to shade the blocks and the cfg's
+//     edges instead, indexed as in function:cfg
+// name, for the title, the function's name by default
+// back edges are bold once loops are known
+//
+// ==================================================
+int function_to_dot(lua_State* L) {
+    LLVMValueRef f = function_checkbody(L, 1);
+    FILE* file = optfile(L, 2);
+    struct graphviz gv = {GRAPHVIZ_CFG, LLVMGetValueName(f)};
+    if (!lua_isnoneornil(L, 3)) {
+        checkdotoptions(L, 3, &gv);
+    }
+
+    struct dotgraph* d = pushdotgraph(L);
+    if (cfg_fromfunction(&d->g, f)) {
+        return throw(L, "out of memory");
+    }
+    struct cfg* g = &d->g;
+    gv.g = g;
+
+    int err = 0;
+    if (gv.kind != GRAPHVIZ_CFG || gv.depth) {
+        d->idom = malloc((g->n + 1) * sizeof(unsigned));
+        err = d->idom == NULL || dom_idom(g, d->idom);
+        gv.idom = d->idom;
+    }
+    if (!err && (gv.kind == GRAPHVIZ_LOOPS || gv.depth)) {
+        err = loop_build(&d->loops, g, d->idom);
+        d->hasloops = !err;
+        gv.loops = err ? NULL : &d->loops;
+    }
+    if (!err && !lua_isnoneornil(L, 3)) {
+        err = optweights(L, 3, "weights", g->n, &d->weight) ||
+            optweights(L, 3, "edge_weights", g->succoff[g->n],
+                &d->edgeweight);
+        gv.weight = d->weight;
+        gv.edgeweight = d->edgeweight;
+    }
+
+    luaL_Buffer b;
+    if (!err && file != NULL) {
+        gv.write = writefile;
+        gv.ud = file;
+        err = graphviz_write(&gv);
+    } else if (!err) {
+        luaL_buffinit(L, &b);
+        gv.write = writebuffer;
+        gv.ud = &b;
+        err = graphviz_write(&gv);
+    }
+
+    dotgraph_free(d);
+    if (err < 0 || (err && file == NULL)) {
+        return throw(L, "out of memory");
+    }
+    if (file != NULL) {
+        return pushfile(L, 2, !err);
+    }
+    luaL_pushresult(&b);
+    return 1;
+}
+
 // ==================================================
 //
 // __tostring metamethod
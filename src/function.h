@@ -22,7 +22,20 @@
 #define _LLB_FUNCTION_H
 
 extern int function_new(lua_State*, LLVMValueRef);
+extern LLVMValueRef function_checkbody(lua_State*, int);
 extern int function_basic_blocks(lua_State*);
+extern int function_cfg(lua_State*);
+extern int function_idom(lua_State*);
+extern int function_loops(lua_State*);
+extern int function_liveness(lua_State*);
+extern int function_domtree(lua_State*);
+extern int function_ssa_index(lua_State*);
+extern int function_df(lua_State*);
+extern int function_native_prunedssa(lua_State*);
+extern int function_epochs(lua_State*);
+extern int function_params(lua_State*);
+extern int function_to_ir(lua_State*);
+extern int function_to_dot(lua_State*);
 extern int function_tostring(lua_State*);
 
 #endif
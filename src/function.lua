@@ -18,8 +18,10 @@
 -- along with llb. If not, see <http://www.gnu.org/licenses/>.
 --
 
+local core = require "core"
 local set = require "set"
 local bbgraph = require "bbgraph"
+local stats = require "stats"
 
 local fn = {}
 
@@ -40,10 +42,97 @@ end
 
 --
 -- computes the predecessors-sucessors graph of a function
+-- see bbgraph.new for "dense"
 --
-function fn:bbgraph(bbs)
+function fn:bbgraph(bbs, dense)
     local bbs = bbs or self:basic_blocks()
-    return bbgraph.new(bbs)
+    return bbgraph.new(bbs, dense)
+end
+
+-----------------------------------------------------
+--
+--  analyses cache
+--
+-----------------------------------------------------
+
+-- analyses[name] = {epoch, compute}, the result of compute(f) stays
+-- valid while the epoch it depends on doesn't change: "cfg" for the
+-- analyses of the graph, "ir" for the ones that read the instructions
+local analyses = {
+    cfg = {"cfg", function(f) return f:cfg() end},
+    bbgraph = {"cfg", function(f) return f:bbgraph() end},
+    domtree = {"cfg", function(f) return f:domtree() end},
+    idom = {"cfg", function(f) return f:analysis("bbgraph"):idom() end},
+    ridom = {"cfg", function(f)
+        return f:analysis("bbgraph"):ridom(f:analysis("idom"))
+    end},
+    dom = {"cfg", function(f)
+        return f:analysis("bbgraph"):dom(f:analysis("idom"))
+    end},
+    df = {"cfg", function(f) return f:analysis("bbgraph"):df() end},
+    loops = {"cfg", function(f) return f:loops() end},
+    liveness = {"ir", function(f) return f:liveness() end},
+}
+
+-- cache[function][name] => {ir, cfg, result}
+local cache = setmetatable({}, {__mode = "k"})
+
+--
+-- returns the result of an analysis of the function, computed once and
+-- kept until the function changes (see function:epochs). the graph
+-- analyses survive changes that leave the blocks and terminators alone.
+-- results are shared, they must not be modified.
+--
+function fn:analysis(name)
+    local analysis = analyses[name]
+    if analysis == nil then
+        error("unknown analysis '" .. tostring(name) .. "'", 2)
+    end
+    local ir, cfg = self:epochs()
+    local entries = cache[self]
+    if entries == nil then
+        entries = {}
+        cache[self] = entries
+    end
+    local entry = entries[name]
+    if entry ~= nil and entry.cfg == cfg and
+        (analysis[1] == "cfg" or entry.ir == ir) then
+        stats.count("analysis.hits")
+        return entry.result
+    end
+    stats.count("analysis.misses")
+    local result = analysis[2](self)
+    entries[name] = {ir = ir, cfg = cfg, result = result}
+    return result
+end
+
+--
+-- marks the cached analysis "name" as up to date with the function, as
+-- after changes the caller also applied to its result (i.e. through
+-- domtree:insert_edge), so it survives them. if result is given, only
+-- a cached result that is the same object is marked.
+-- bbgraph:insert_edge and bbgraph:delete_edge preserve their graph.
+--
+function fn:preserve(name, result)
+    if analyses[name] == nil then
+        error("unknown analysis '" .. tostring(name) .. "'", 2)
+    end
+    local entry = cache[self] and cache[self][name]
+    if entry ~= nil and (result == nil or entry.result == result) then
+        entry.ir, entry.cfg = self:epochs()
+    end
+end
+
+--
+-- drops the cached analysis "name", or all of them, after changes made
+-- without llb (i.e. by another binding of the same module)
+--
+function fn:invalidate(name)
+    if name == nil then
+        cache[self] = nil
+    elseif cache[self] ~= nil then
+        cache[self][name] = nil
+    end
 end
 
 -----------------------------------------------------
@@ -56,37 +145,46 @@ end
 -- returns instructions, block_instructions 
 -- instructions = set<instruction>
 -- block_instructions[block] => {instruction}
+-- the def-use information comes from function:ssa_index, in one call
 -- 
 local function mapinstructions(bbgraph)
+    local refs = {}
+    for i, block in ipairs(bbgraph) do
+        refs[i] = block.ref
+    end
+    local index = refs[1]:parent():ssa_index(refs, {instructions = true})
+    local opcode, operand, opoff = index.opcode, index.operand, index.opoff
+    local STORE, ALLOCA = core.opcodes.store, core.opcodes.alloca
+
     local instructions = set.new()
-    local block_instructions, auxmap = {}, {}
-    for _, block in ipairs(bbgraph) do
+    local block_instructions, list = {}, {}
+    for b, block in ipairs(bbgraph) do
         block_instructions[block] = {}
-        for _, reference in ipairs(block.ref:instructions()) do
+        for i = index.blockoff[b], index.blockoff[b + 1] - 1 do
             local instruction = {
                 block = block,
-                ref = reference,
+                ref = index.instructions[i],
                 stores = set.new()
             }
             instructions:add(instruction)
             table.insert(block_instructions[block], instruction)
-            auxmap[reference:pointer()] = instruction
+            list[i] = instruction
         end
     end
-    for instruction in pairs(instructions) do
-        if instruction.ref:is_store() then
+    for i, instruction in ipairs(list) do
+        if opcode[i] == STORE then
             instruction.is_store = true
-            local operands = instruction.ref:operands()
-            local found = auxmap[operands[1]:pointer()]
-            instruction.value = found ~= nil and found or {ref = operands[1]}
-            instruction.alloca = assert(auxmap[operands[2]:pointer()])
-        elseif instruction.ref:is_alloca() then
+            local value = operand[opoff[i]]
+            instruction.value = value > 0 and list[value]
+                or {ref = instruction.ref:operand(1)}
+            instruction.alloca = assert(list[operand[opoff[i] + 1]])
+        elseif opcode[i] == ALLOCA then
             instruction.is_alloca = true
         end
-        for _, usage in ipairs(instruction.ref:usages()) do
-            local usage_instruction = auxmap[usage]
-            if usage_instruction.ref:is_store() then
-                instruction.stores:add(usage_instruction)
+        for k = index.useoff[i], index.useoff[i + 1] - 1 do
+            local user = index.use[k]
+            if opcode[user] == STORE then
+                instruction.stores:add(list[user])
             end
         end
     end
@@ -141,31 +239,18 @@ local function bbdomassignments(bbassignments, idom)
 end
 
 -- 
--- calculatesthe set of alloca instructions that need a phi for each block
+-- calculates the set of alloca instructions that need a phi for each block
 -- returns t[block] => set<alloca>
 -- 
 local function bbphis(bbgraph, allocas)
-    -- t[alloca] = set<block>
-    local t = {}
+    -- defs[alloca] = set<block>
+    local defs = {}
     for alloca in pairs(allocas) do
-        -- if S is the set of nodes that store in the alloca
-        local S = alloca.stores:map(function(store) return store.block end)
-        -- DF+(S) is the set of nodes that need phi-functions for the alloca
-        t[alloca] = bbgraph:dfplus(S)
-    end
-
-    -- mirroring
-    local mirror = {}
-    for _, block in ipairs(bbgraph) do
-        mirror[block] = set.new()
+        -- S is the set of nodes that store in the alloca
+        defs[alloca] = alloca.stores:map(function(store) return store.block end)
     end
-    for alloca, blocks in pairs(t) do
-        for block in pairs(blocks) do
-            mirror[block]:add(alloca)
-        end
-    end
-
-    return mirror
+    -- DF+(S) is the set of nodes that need phi-functions for the alloca
+    return bbgraph:phis(defs)
 end
 
 -- 
@@ -177,9 +262,9 @@ local function dfs(t, entry)
             before(block)
         end
         for successor in pairs(t[block]) do
-            local pre = pre == nil or pre()
-            tdfs(successor, before, after)
-            if post ~= nil then post(pre) end
+            local saved = pre ~= nil and pre()
+            tdfs(successor, before, after, pre, post)
+            if post ~= nil then post(saved) end
         end
         if after ~= nil then
             after(block)
@@ -192,15 +277,28 @@ end
 
 --
 -- transforms the IR to its pruned SSA form
+-- the graph analyses come from the cache unless a graph is given, the
+-- transformation doesn't change the graph so they stay valid
 --
 function fn:prunedssa(builder, bbgraph)
-    local bbgraph = bbgraph or self:bbgraph()
-    local idom = bbgraph:idom()
-    local ridom = bbgraph:ridom(idom)
+    local start = stats.clock()
+    local idom, ridom
+    if bbgraph == nil then
+        bbgraph = self:analysis("bbgraph")
+        idom, ridom = self:analysis("idom"), self:analysis("ridom")
+    else
+        idom = bbgraph:idom()
+        ridom = bbgraph:ridom(idom)
+    end
+    stats.time("prunedssa.idom", start)
 
     -- instructions = set<instruction>
     -- block_instructions[block] => {instruction}
+    start = stats.clock()
     local instructions, block_instructions = mapinstructions(bbgraph)
+    stats.time("prunedssa.mapinstructions", start)
+
+    start = stats.clock()
     -- bbassignments[block][alloca] => {store instruction}
     local bbassignments = bbassignments(block_instructions)
     -- bbdomassignments(block, alloca) => assignment
@@ -226,9 +324,21 @@ function fn:prunedssa(builder, bbgraph)
             bbassignments[block][alloca] = bbassignments[block][alloca][1]
         end
     end
+    stats.time("prunedssa.assignments", start)
+
+    start = stats.clock()
 
     -- set of alloca instructions
     local allocas = instructions:filter(function(e) return e.is_alloca end)
+    -- list of alloca instructions, in program order
+    local allocalist = {}
+    for _, block in ipairs(bbgraph) do
+        for _, instruction in ipairs(block_instructions[block]) do
+            if instruction.is_alloca then
+                table.insert(allocalist, instruction)
+            end
+        end
+    end
     -- bbphis[block] => set<alloca>
     local bbphis = bbphis(bbgraph, allocas)
     -- ridomdfs(f, pre, post) from entry
@@ -239,15 +349,21 @@ function fn:prunedssa(builder, bbgraph)
 
     -- places the required phi instructions for each block
     -- removes the associated locally restricted load instructions
-    ridomdfs(function(block)
-        for alloca in pairs(bbphis[block]) do
+    -- phis are created in block order, then alloca order, so the
+    -- resulting IR is deterministic (see function:native_prunedssa)
+    for _, block in ipairs(bbgraph) do
+        for _, alloca in ipairs(allocalist) do
+            if not bbphis[block]:contains(alloca) then
+                goto continue
+            end
             local phi = block.ref:build_phi(builder, alloca.ref)
+            stats.count("prunedssa.phis")
             if phis[block] == nil then phis[block] = {} end
             phis[block][alloca] = phi
             local boundary
             if bbassignments[block][alloca] ~= nil then
                 -- there is a store instruction in the block
-                boundary = bbassignments[block][alloca]
+                boundary = bbassignments[block][alloca].ref
             else
                 -- there isn't a store instruction in the block
                 -- bbassignments must be updated
@@ -257,31 +373,55 @@ function fn:prunedssa(builder, bbgraph)
                 bbassignments[block][alloca] = phi_instruction
             end
             block.ref:replace_between(phi, boundary, phi, alloca.ref)
+            ::continue::
         end
-    end)
+    end
+
+    stats.time("prunedssa.phis", start)
+
+    -- position[block] => index of the block in bbgraph
+    local position = {}
+    for i, block in ipairs(bbgraph) do
+        position[block] = i
+    end
 
     -- adds the incoming (value, block) tuples to the phi instructions 
+    -- in predecessor order, once per edge from the predecessor
+    start = stats.clock()
     ridomdfs(function(block)
         for alloca in pairs(bbphis[block]) do
-            local t = {}
+            local predecessors = {}
             for predecessor in pairs(block.predecessors) do
+                table.insert(predecessors, predecessor)
+            end
+            table.sort(predecessors, function(a, b)
+                return position[a] < position[b]
+            end)
+            local t = {}
+            for _, predecessor in ipairs(predecessors) do
                 local last = bbassignments[predecessor][alloca]
                 local assignment = last or bbdomassignments(predecessor, alloca)
                 local incoming = {predecessor.ref}
                 if assignment ~= nil then
                     table.insert(incoming, 1, assignment.value.ref)
                 end
-                table.insert(t, incoming)
+                for _, successor in ipairs(predecessor.ref:successors()) do
+                    if successor == block.ref then
+                        table.insert(t, incoming)
+                    end
+                end
             end
             phis[block][alloca]:add_incoming(alloca.ref, t)
         end
     end)
+    stats.time("prunedssa.incoming", start)
 
     -- auxiliary map
     -- previous_map[alloca] => assignment
     local previous_map = {}
 
     -- replaces the remaining assignments and loads between blocks
+    start = stats.clock()
     ridomdfs(function(block) -- before
         for alloca in pairs(allocas) do
             local previous = previous_map[alloca]
@@ -327,6 +467,7 @@ function fn:prunedssa(builder, bbgraph)
     end, function(pre) --post
         previous_map = pre
     end)
+    stats.time("prunedssa.rename", start)
 
     -- deletes all alloca instructions
     allocas:map(function(e) e.ref:delete() end)
@@ -0,0 +1,426 @@
+/*
+ * Lua binding for LLVM C API.
+ * Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+ *
+ * This file is part of llb.
+ *
+ * llb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * llb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with llb. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <llvm-c/Core.h>
+
+#include "cfg.h"
+#include "graphviz.h"
+#include "loop.h"
+#include "stats.h"
+
+#define MAXINDENT 32
+#define NSHADES 9
+
+static const char* const titles[] = {"CFG", "Dominator tree", "Loops"};
+
+struct out {
+    const struct graphviz* gv;
+    int err;
+    // the range of the weights, for the shades of blocks and edges
+    double lo, hi, edgelo, edgehi;
+    // the blocks of irreducible regions, for GRAPHVIZ_LOOPS
+    unsigned char* irreducible;
+};
+
+static void put(struct out* o, const char* s, size_t len) {
+    if (!o->err && len > 0 && o->gv->write(o->gv->ud, s, len)) {
+        o->err = 1;
+    }
+}
+
+// ==================================================
+//
+// writes a formatted piece of a line. pieces are short,
+// strings of arbitrary length are written with putescaped.
+//
+// ==================================================
+static void format(struct out* o, const char* fmt, ...) {
+    char buf[128];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    put(o, buf, n < sizeof(buf) ? n : sizeof(buf) - 1);
+}
+
+static void indent(struct out* o, unsigned n) {
+    static const char tabs[] =
+        "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
+    put(o, tabs, n < MAXINDENT ? n : MAXINDENT);
+}
+
+// ==================================================
+//
+// writes s inside a quoted string. in record labels the record
+// delimiters are escaped too and line breaks are left justified.
+//
+// ==================================================
+static void putescaped(struct out* o, const char* s, int record) {
+    const char* run = s;
+    for (; *s != '\0'; s++) {
+        if (*s == '\n') {
+            put(o, run, s - run);
+            put(o, record ? "\\l" : "\\n", 2);
+            run = s + 1;
+        } else if (*s == '"' || *s == '\\' ||
+            (record && strchr("{}|<>", *s) != NULL)) {
+            put(o, run, s - run);
+            put(o, "\\", 1);
+            run = s;
+        }
+    }
+    put(o, run, s - run);
+}
+
+static void title(struct out* o) {
+    const struct graphviz* gv = o->gv;
+    put(o, titles[gv->kind], strlen(titles[gv->kind]));
+    put(o, " for ", 5);
+    putescaped(o, gv->name, 0);
+    put(o, " function", 9);
+}
+
+// ==================================================
+//
+// loop nesting, l being a loop or CFG_UNDEF for none
+//
+// ==================================================
+static unsigned loopof(const struct graphviz* gv, unsigned b) {
+    return gv->loops == NULL ? CFG_UNDEF : gv->loops->loopof[b];
+}
+
+static unsigned depthof(const struct loops* loops, unsigned l) {
+    return l == CFG_UNDEF ? 0 : loops->depth[l];
+}
+
+// the innermost loop containing both a and b
+static unsigned common(const struct loops* loops, unsigned a, unsigned b) {
+    while (depthof(loops, a) > depthof(loops, b)) {
+        a = loops->parent[a];
+    }
+    while (depthof(loops, b) > depthof(loops, a)) {
+        b = loops->parent[b];
+    }
+    while (a != b) {
+        a = loops->parent[a];
+        b = loops->parent[b];
+    }
+    return a;
+}
+
+// the edge s -> h goes from the body of the loop of h to its header
+static int isback(const struct graphviz* gv, unsigned s, unsigned h) {
+    unsigned l = loopof(gv, h);
+    return l != CFG_UNDEF && gv->loops->header[l] == h &&
+        common(gv->loops, loopof(gv, s), l) == l;
+}
+
+// ==================================================
+//
+// colors, as shades of graphviz's blues9 scheme. 0 is no color,
+// the lightest ones are skipped so every shade is visible.
+//
+// ==================================================
+static void range(const double* w, unsigned n, double* lo, double* hi) {
+    *lo = INFINITY;
+    *hi = -INFINITY;
+    for (unsigned i = 0; w != NULL && i < n; i++) {
+        if (!isnan(w[i])) {
+            *lo = w[i] < *lo ? w[i] : *lo;
+            *hi = w[i] > *hi ? w[i] : *hi;
+        }
+    }
+}
+
+static unsigned depthshade(unsigned depth) {
+    if (depth == 0) {
+        return 0;
+    }
+    return 2 * depth + 1 < NSHADES ? 2 * depth + 1 : NSHADES;
+}
+
+static unsigned weightshade(double w, double lo, double hi) {
+    if (hi == lo) {
+        return NSHADES;
+    }
+    return 2 + (unsigned)((NSHADES - 2) * (w - lo) / (hi - lo));
+}
+
+static unsigned blockshade(const struct out* o, unsigned b) {
+    const struct graphviz* gv = o->gv;
+    if (gv->weight != NULL && !isnan(gv->weight[b])) {
+        return weightshade(gv->weight[b], o->lo, o->hi);
+    }
+    if (gv->depth) {
+        return depthshade(depthof(gv->loops, loopof(gv, b)));
+    }
+    return 0;
+}
+
+// k is the edge in succ[], CFG_UNDEF for the edges of trees
+static unsigned edgeshade(
+    const struct out* o, unsigned s, unsigned d, unsigned k) {
+    const struct graphviz* gv = o->gv;
+    if (gv->edgeweight != NULL && k != CFG_UNDEF &&
+        !isnan(gv->edgeweight[k])) {
+        return weightshade(gv->edgeweight[k], o->edgelo, o->edgehi);
+    }
+    if (gv->depth) {
+        const struct loops* loops = gv->loops;
+        return depthshade(
+            depthof(loops, common(loops, loopof(gv, s), loopof(gv, d))));
+    }
+    return 0;
+}
+
+// ==================================================
+//
+// writes a block, and its instructions if asked. the text of each
+// instruction is released once written.
+//
+// ==================================================
+static void node(struct out* o, unsigned b, unsigned depth) {
+    const struct graphviz* gv = o->gv;
+    LLVMBasicBlockRef bb = gv->g->blocks[b];
+    const char* name = LLVMGetBasicBlockName(bb);
+
+    indent(o, depth);
+    format(o, "Node%u [shape=record,label=\"{", b + 1);
+    if (*name == '\0') {
+        format(o, "%u", b + 1);
+    } else {
+        putescaped(o, name, 1);
+    }
+    if (gv->instructions) {
+        put(o, ":\\l", 3);
+        LLVMValueRef instruction = LLVMGetFirstInstruction(bb);
+        for (; instruction != NULL && !o->err;
+             instruction = LLVMGetNextInstruction(instruction)) {
+            char* text = LLVMPrintValueToString(instruction);
+            putescaped(o, text, 1);
+            LLVMDisposeMessage(text);
+            put(o, "\\l", 2);
+        }
+    }
+    put(o, "}\"", 2);
+
+    int irreducible = o->irreducible != NULL && o->irreducible[b];
+    unsigned shade = blockshade(o, b);
+    if (shade != 0) {
+        format(o, ",style=%s,fillcolor=%u",
+            irreducible ? "\"filled,bold\"" : "filled", shade);
+    } else if (irreducible) {
+        put(o, ",style=filled", 13);
+    }
+    put(o, "];\n", 3);
+}
+
+static void edge(
+    struct out* o, unsigned s, unsigned d, unsigned k, int back) {
+    unsigned shade = edgeshade(o, s, d, k);
+    format(o, "\tNode%u -> Node%u", s + 1, d + 1);
+    if (back && shade != 0) {
+        format(o, " [style=bold,color=%u]", shade);
+    } else if (back) {
+        put(o, " [style=bold]", 13);
+    } else if (shade != 0) {
+        format(o, " [color=%u]", shade);
+    }
+    put(o, ";\n", 2);
+}
+
+// ==================================================
+//
+// writes the blocks as nested clusters, one per loop, walking the
+// loop nesting forest with an explicit stack
+//
+// ==================================================
+struct forest {
+    // the blocks whose innermost loop is l, l = n for the ones of no loop
+    unsigned* memberoff;
+    unsigned* member;
+    unsigned* childoff;
+    unsigned* child;
+    unsigned* stack;
+    unsigned* cursor;
+};
+
+static void freeforest(struct forest* f) {
+    free(f->memberoff);
+    free(f->member);
+    free(f->childoff);
+    free(f->child);
+    free(f->stack);
+    free(f->cursor);
+}
+
+static int buildforest(struct forest* f, const struct graphviz* gv) {
+    const struct loops* loops = gv->loops;
+    unsigned n = gv->g->n, nl = loops->n;
+    f->memberoff = calloc(nl + 2, sizeof(unsigned));
+    f->member = malloc((n + 1) * sizeof(unsigned));
+    f->childoff = calloc(nl + 2, sizeof(unsigned));
+    f->child = malloc((nl + 1) * sizeof(unsigned));
+    f->stack = malloc((nl + 1) * sizeof(unsigned));
+    f->cursor = malloc((nl + 1) * sizeof(unsigned));
+    if (f->memberoff == NULL || f->member == NULL || f->childoff == NULL ||
+        f->child == NULL || f->stack == NULL || f->cursor == NULL) {
+        freeforest(f);
+        return -1;
+    }
+
+    for (unsigned b = 0; b < n; b++) {
+        unsigned l = loops->loopof[b];
+        f->memberoff[(l == CFG_UNDEF ? nl : l) + 1]++;
+    }
+    for (unsigned l = 0; l < nl; l++) {
+        if (loops->parent[l] != CFG_UNDEF) {
+            f->childoff[loops->parent[l] + 1]++;
+        }
+    }
+    for (unsigned l = 0; l <= nl; l++) {
+        f->memberoff[l + 1] += f->memberoff[l];
+        f->childoff[l + 1] += f->childoff[l];
+    }
+    memcpy(f->cursor, f->memberoff, (nl + 1) * sizeof(unsigned));
+    for (unsigned b = 0; b < n; b++) {
+        unsigned l = loops->loopof[b];
+        f->member[f->cursor[l == CFG_UNDEF ? nl : l]++] = b;
+    }
+    memcpy(f->cursor, f->childoff, (nl + 1) * sizeof(unsigned));
+    for (unsigned l = 0; l < nl; l++) {
+        if (loops->parent[l] != CFG_UNDEF) {
+            f->child[f->cursor[loops->parent[l]]++] = l;
+        }
+    }
+    return 0;
+}
+
+static void opencluster(struct out* o, const struct forest* f, unsigned l) {
+    unsigned depth = o->gv->loops->depth[l];
+    indent(o, depth);
+    format(o, "subgraph cluster_loop%u {\n", l + 1);
+    indent(o, depth + 1);
+    format(o, "label=\"loop %u, depth %u\";\n", l + 1, depth);
+    for (unsigned k = f->memberoff[l]; k < f->memberoff[l + 1]; k++) {
+        node(o, f->member[k], depth + 1);
+    }
+}
+
+static int clusters(struct out* o) {
+    const struct loops* loops = o->gv->loops;
+    struct forest f;
+    if (buildforest(&f, o->gv)) {
+        return -1;
+    }
+
+    unsigned nl = loops->n;
+    for (unsigned k = f.memberoff[nl]; k < f.memberoff[nl + 1]; k++) {
+        node(o, f.member[k], 1);
+    }
+    for (unsigned root = 0; root < nl && !o->err; root++) {
+        if (loops->parent[root] != CFG_UNDEF) {
+            continue;
+        }
+        unsigned sp = 0;
+        f.stack[0] = root;
+        f.cursor[root] = f.childoff[root];
+        opencluster(o, &f, root);
+        while (sp != CFG_UNDEF && !o->err) {
+            unsigned l = f.stack[sp];
+            if (f.cursor[l] < f.childoff[l + 1]) {
+                unsigned c = f.child[f.cursor[l]++];
+                f.stack[++sp] = c;
+                f.cursor[c] = f.childoff[c];
+                opencluster(o, &f, c);
+            } else {
+                indent(o, loops->depth[l]);
+                put(o, "}\n", 2);
+                sp--;
+            }
+        }
+    }
+
+    freeforest(&f);
+    return 0;
+}
+
+int graphviz_write(const struct graphviz* gv) {
+    STATS_START(start);
+    const struct cfg* g = gv->g;
+    struct out o = {gv, 0};
+    range(gv->weight, g->n, &o.lo, &o.hi);
+    range(gv->edgeweight, g->succoff[g->n], &o.edgelo, &o.edgehi);
+    if (gv->kind == GRAPHVIZ_LOOPS) {
+        const struct loops* loops = gv->loops;
+        o.irreducible = calloc(g->n + 1, 1);
+        if (o.irreducible == NULL) {
+            return -1;
+        }
+        for (unsigned k = 0; k < loops->regionoff[loops->nregions]; k++) {
+            o.irreducible[loops->region[k]] = 1;
+        }
+    }
+
+    put(&o, "digraph \"", 9);
+    title(&o);
+    put(&o, "\" {\n\tlabel=\"", 12);
+    title(&o);
+    put(&o, "\";\n", 3);
+    if (gv->depth || gv->weight != NULL || gv->edgeweight != NULL) {
+        put(&o, "\tnode [colorscheme=blues9];\n", 28);
+        put(&o, "\tedge [colorscheme=blues9];\n", 28);
+    }
+    put(&o, "\n", 1);
+
+    int err = 0;
+    if (gv->kind == GRAPHVIZ_LOOPS) {
+        err = clusters(&o);
+    } else {
+        for (unsigned b = 0; b < g->n; b++) {
+            node(&o, b, 1);
+        }
+    }
+
+    for (unsigned b = 0; b < g->n && !err && !o.err; b++) {
+        if (gv->kind == GRAPHVIZ_DOMTREE) {
+            unsigned i = gv->idom[b];
+            if (i != CFG_UNDEF && i != b) {
+                edge(&o, i, b, CFG_UNDEF, 0);
+            }
+            continue;
+        }
+        for (unsigned k = g->succoff[b]; k < g->succoff[b + 1]; k++) {
+            unsigned s = g->succ[k];
+            edge(&o, b, s, k, gv->loops != NULL && isback(gv, b, s));
+        }
+    }
+    put(&o, "}\n", 2);
+
+    free(o.irreducible);
+    STATS_STOP(STATS_GRAPHVIZ, start);
+    return err ? err : o.err;
+}
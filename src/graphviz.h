@@ -0,0 +1,62 @@
+/*
+ * Lua binding for LLVM C API.
+ * Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+ *
+ * This file is part of llb.
+ *
+ * llb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * llb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with llb. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LLB_GRAPHVIZ_H
+#define _LLB_GRAPHVIZ_H
+
+enum {
+    GRAPHVIZ_CFG,
+    GRAPHVIZ_DOMTREE,
+    GRAPHVIZ_LOOPS
+};
+
+// ==================================================
+//
+//  streams a graph of a cfg in the graphviz dot format through write,
+//  line by line, so only the graph's arrays are kept in memory.
+//  nodes are named Node<i>, i being the 1-based index of the block.
+//  weights are NAN for the blocks or edges that have none.
+//
+// ==================================================
+struct graphviz {
+    int kind;
+    const char* name;
+    const struct cfg* g;
+    // the immediate dominators, for GRAPHVIZ_DOMTREE
+    const unsigned* idom;
+    // the loop nesting forest, for GRAPHVIZ_LOOPS, back edges and
+    // depth colors, or NULL
+    const struct loops* loops;
+    // lists the instructions of each block in its label
+    int instructions;
+    // colors the blocks and edges by the depth of their innermost loop
+    int depth;
+    // weight[b], and edgeweight[k] for the edge succ[k], or NULL
+    const double* weight;
+    const double* edgeweight;
+    // returns nonzero if the output failed
+    int (*write)(void*, const char*, size_t);
+    void* ud;
+};
+
+// returns 0, -1 if out of memory or 1 if the output failed
+extern int graphviz_write(const struct graphviz*);
+
+#endif
@@ -30,11 +30,11 @@
 
 // ==================================================
 //
-// instantiates a new instruction object
+// instantiates a new instruction object, or reuses the interned one
 //
 // ==================================================
 int instruction_new(lua_State* L, LLVMValueRef instruction) {
-    newuserdata(L, instruction, LLB_INSTRUCTION);
+    pushobject(L, instruction, LLB_INSTRUCTION);
     return 1;
 }
 
@@ -59,12 +59,63 @@ int instruction_operands(lua_State* L) {
     int num_operands = LLVMGetNumOperands(instruction);
     lua_newtable(L);
     for (int i = 0; i < num_operands; i++) {
-        newuserdata(L, LLVMGetOperand(instruction, i), LLB_INSTRUCTION);
+        instruction_new(L, LLVMGetOperand(instruction, i));
         lua_seti(L, -2, i + 1);
     }
     return 1;
 }
 
+// ==================================================
+//
+// iterates over the operands of a instruction without building a table:
+// for i, operand in instruction:each_operand() do ... end
+//
+// ==================================================
+static int instruction_operand_iterator(lua_State* L) {
+    LLVMValueRef instruction = getinstruction(L, 1);
+    lua_Integer i = luaL_checkinteger(L, 2);
+    if (i >= LLVMGetNumOperands(instruction)) {
+        return 0;
+    }
+    lua_pushinteger(L, i + 1);
+    instruction_new(L, LLVMGetOperand(instruction, i));
+    return 2;
+}
+
+int instruction_each_operand(lua_State* L) {
+    luaL_checkudata(L, 1, LLB_INSTRUCTION);
+    lua_pushcfunction(L, instruction_operand_iterator);
+    lua_pushvalue(L, 1);
+    lua_pushinteger(L, 0);
+    return 3;
+}
+
+// ==================================================
+//
+// gets the number of operands of a instruction
+//
+// ==================================================
+int instruction_operand_count(lua_State* L) {
+    LLVMValueRef instruction = getinstruction(L, 1);
+    lua_pushinteger(L, LLVMGetNumOperands(instruction));
+    return 1;
+}
+
+// ==================================================
+//
+// gets the i-th operand of a instruction, or nil
+//
+// ==================================================
+int instruction_operand(lua_State* L) {
+    LLVMValueRef instruction = getinstruction(L, 1);
+    lua_Integer i = luaL_checkinteger(L, 2);
+    if (i < 1 || i > LLVMGetNumOperands(instruction)) {
+        lua_pushnil(L);
+        return 1;
+    }
+    return instruction_new(L, LLVMGetOperand(instruction, i - 1));
+}
+
 // ==================================================
 //
 // creates a table with all the usages of a instruction
@@ -77,13 +128,74 @@ int instruction_usages(lua_State* L) {
     for (LLVMUseRef use = LLVMGetFirstUse(instruction); use != NULL;
          use = LLVMGetNextUse(use)) {
         LLVMValueRef used_in = LLVMGetUser(use);
-        lua_pushlightuserdata(L, used_in);
+        instruction_new(L, used_in);
         lua_seti(L, -2, i + 1);
         i++;
     }
     return 1;
 }
 
+// ==================================================
+//
+// iterator of instruction_each_usage.
+// the next use is fetched before yielding the current user.
+//
+// ==================================================
+static int instruction_usage_iterator(lua_State* L) {
+    LLVMUseRef use = lua_touserdata(L, lua_upvalueindex(1));
+    if (use == NULL) {
+        return 0;
+    }
+    lua_pushlightuserdata(L, LLVMGetNextUse(use));
+    lua_replace(L, lua_upvalueindex(1));
+    return instruction_new(L, LLVMGetUser(use));
+}
+
+// ==================================================
+//
+// iterates over the usages of a instruction without building a table:
+// for user in instruction:each_usage() do ... end
+//
+// ==================================================
+int instruction_each_usage(lua_State* L) {
+    LLVMValueRef instruction = getinstruction(L, 1);
+    lua_pushlightuserdata(L, LLVMGetFirstUse(instruction));
+    lua_pushcclosure(L, instruction_usage_iterator, 1);
+    return 1;
+}
+
+// ==================================================
+//
+// counts the usages of a instruction
+//
+// ==================================================
+int instruction_usage_count(lua_State* L) {
+    LLVMValueRef instruction = getinstruction(L, 1);
+    lua_Integer n = 0;
+    for (LLVMUseRef use = LLVMGetFirstUse(instruction); use != NULL;
+         use = LLVMGetNextUse(use)) {
+        n++;
+    }
+    lua_pushinteger(L, n);
+    return 1;
+}
+
+// ==================================================
+//
+// gets the opcode of an instruction, as in llb.opcodes.
+// other values, as constants and arguments, have opcode 0.
+//
+// ==================================================
+int instruction_opcode(lua_State* L) {
+    LLVMValueRef instruction = getinstruction(L, 1);
+    lua_Integer opcode = 0;
+    if (LLVMIsAInstruction(instruction)) {
+        opcode = LLVMGetInstructionOpcode(instruction);
+    }
+    lua_pushinteger(L, opcode);
+    return 1;
+}
+
 int instruction_is_alloca(lua_State* L) {
     LLVMValueRef instruction = getinstruction(L, 1);
     lua_pushboolean(L, LLVMIsAAllocaInst(instruction) ? 1 : 0);
@@ -103,6 +215,8 @@ int instruction_is_store(lua_State* L) {
 // ==================================================
 int instruction_delete(lua_State* L) {
     LLVMValueRef instruction = getinstruction(L, 1);
+    touchinstruction(L, instruction);
+    forgetobject(L, instruction);
     LLVMInstructionEraseFromParent(instruction);
     return 1;
 }
@@ -145,6 +259,7 @@ int instruction_add_incoming(lua_State* L) {
     }
 
     LLVMAddIncoming(phi, incoming_values, incoming_blocks, size);
+    touchinstruction(L, phi);
     return 0;
 }
 
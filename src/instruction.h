@@ -24,7 +24,13 @@
 extern int instruction_new(lua_State*, LLVMValueRef);
 extern int instruction_pointer(lua_State*);
 extern int instruction_operands(lua_State*);
+extern int instruction_each_operand(lua_State*);
+extern int instruction_operand_count(lua_State*);
+extern int instruction_operand(lua_State*);
 extern int instruction_usages(lua_State*);
+extern int instruction_each_usage(lua_State*);
+extern int instruction_usage_count(lua_State*);
+extern int instruction_opcode(lua_State*);
 extern int instruction_is_alloca(lua_State*);
 extern int instruction_is_store(lua_State*);
 extern int instruction_delete(lua_State*);
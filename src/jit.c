@@ -0,0 +1,511 @@
+/*
+ * Lua binding for LLVM C API.
+ * Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+ *
+ * This file is part of llb.
+ *
+ * llb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * llb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with llb. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <lauxlib.h>
+#include <lua.h>
+
+#include <llvm-c/BitReader.h>
+#include <llvm-c/BitWriter.h>
+#include <llvm-c/Core.h>
+#include <llvm-c/Error.h>
+#include <llvm-c/LLJIT.h>
+#include <llvm-c/Orc.h>
+#include <llvm-c/Target.h>
+#include <llvm-c/TargetMachine.h>
+#include <llvm-c/Transforms/PassBuilder.h>
+
+#include "core.h"
+#include "jit.h"
+#include "lazy.h"
+#include "orc.h"
+
+// ==================================================
+//
+// functions are called through trampolines, added to the snapshot of
+// the module, that receive the arguments and the result as int64_t
+// arrays. a signature has a letter for the result and for each argument:
+// v(oid), b(oolean), i(nteger), f(loat), d(ouble) and p(ointer).
+//
+// ==================================================
+#define TRAMPOLINE ("llb.call.")
+#define MAXARGS (16)
+
+static char typeletter(LLVMTypeRef type) {
+    switch (LLVMGetTypeKind(type)) {
+        case LLVMVoidTypeKind:
+            return 'v';
+        case LLVMIntegerTypeKind:
+            if (LLVMGetIntTypeWidth(type) == 1) {
+                return 'b';
+            }
+            return LLVMGetIntTypeWidth(type) <= 64 ? 'i' : 0;
+        case LLVMFloatTypeKind:
+            return 'f';
+        case LLVMDoubleTypeKind:
+            return 'd';
+        case LLVMPointerTypeKind:
+            return 'p';
+        default:
+            return 0;
+    }
+}
+
+// returns 0 if the function can not be called from lua
+static int signature(LLVMValueRef f, char* sig) {
+    LLVMTypeRef type = LLVMGlobalGetValueType(f);
+    unsigned n = LLVMCountParamTypes(type);
+    if (LLVMIsFunctionVarArg(type) || n > MAXARGS) {
+        return 0;
+    }
+    LLVMTypeRef params[MAXARGS];
+    LLVMGetParamTypes(type, params);
+    if ((sig[0] = typeletter(LLVMGetReturnType(type))) == 0) {
+        return 0;
+    }
+    for (unsigned i = 0; i < n; i++) {
+        sig[i + 1] = typeletter(params[i]);
+        if (sig[i + 1] == 0 || sig[i + 1] == 'v') {
+            return 0;
+        }
+    }
+    sig[n + 1] = '\0';
+    return 1;
+}
+
+// converts an i64 to a value of type
+static LLVMValueRef fromint64(LLVMBuilderRef builder, LLVMValueRef value,
+    LLVMTypeRef type, char letter) {
+    LLVMContextRef ctx = LLVMGetTypeContext(type);
+    switch (letter) {
+        case 'b':
+        case 'i':
+            if (LLVMGetIntTypeWidth(type) == 64) {
+                return value;
+            }
+            return LLVMBuildTrunc(builder, value, type, "");
+        case 'f':
+            value = LLVMBuildBitCast(
+                builder, value, LLVMDoubleTypeInContext(ctx), "");
+            return LLVMBuildFPTrunc(builder, value, type, "");
+        case 'd':
+            return LLVMBuildBitCast(builder, value, type, "");
+        default:
+            return LLVMBuildIntToPtr(builder, value, type, "");
+    }
+}
+
+// converts a value of type to an i64
+static LLVMValueRef toint64(LLVMBuilderRef builder, LLVMValueRef value,
+    LLVMTypeRef type, char letter) {
+    LLVMTypeRef i64 = LLVMInt64TypeInContext(LLVMGetTypeContext(type));
+    switch (letter) {
+        case 'b':
+            return LLVMBuildZExt(builder, value, i64, "");
+        case 'i':
+            if (LLVMGetIntTypeWidth(type) == 64) {
+                return value;
+            }
+            return LLVMBuildSExt(builder, value, i64, "");
+        case 'f':
+            value = LLVMBuildFPExt(builder, value,
+                LLVMDoubleTypeInContext(LLVMGetTypeContext(type)), "");
+            // fall through
+        case 'd':
+            return LLVMBuildBitCast(builder, value, i64, "");
+        default:
+            return LLVMBuildPtrToInt(builder, value, i64, "");
+    }
+}
+
+// ==================================================
+//
+// adds the trampoline of f, as `void (i64* args, i64* result)`
+//
+// ==================================================
+static void addtrampoline(LLVMModuleRef module, LLVMBuilderRef builder,
+    LLVMValueRef f, const char* sig) {
+    LLVMContextRef ctx = LLVMGetModuleContext(module);
+    LLVMTypeRef i64 = LLVMInt64TypeInContext(ctx);
+    LLVMTypeRef i64ptr = LLVMPointerType(i64, 0);
+    LLVMTypeRef params[] = {i64ptr, i64ptr};
+    LLVMTypeRef type =
+        LLVMFunctionType(LLVMVoidTypeInContext(ctx), params, 2, 0);
+
+    size_t len;
+    const char* name = LLVMGetValueName2(f, &len);
+    char trampolinename[sizeof(TRAMPOLINE) + len];
+    memcpy(trampolinename, TRAMPOLINE, sizeof(TRAMPOLINE) - 1);
+    memcpy(trampolinename + sizeof(TRAMPOLINE) - 1, name, len + 1);
+    LLVMValueRef trampoline = LLVMAddFunction(module, trampolinename, type);
+    LLVMPositionBuilderAtEnd(
+        builder, LLVMAppendBasicBlockInContext(ctx, trampoline, "entry"));
+
+    LLVMTypeRef ftype = LLVMGlobalGetValueType(f);
+    unsigned n = LLVMCountParamTypes(ftype);
+    LLVMTypeRef types[MAXARGS];
+    LLVMValueRef args[MAXARGS];
+    LLVMGetParamTypes(ftype, types);
+    for (unsigned i = 0; i < n; i++) {
+        LLVMValueRef index = LLVMConstInt(i64, i, 0);
+        LLVMValueRef ptr = LLVMBuildGEP2(
+            builder, i64, LLVMGetParam(trampoline, 0), &index, 1, "");
+        LLVMValueRef arg = LLVMBuildLoad2(builder, i64, ptr, "");
+        args[i] = fromint64(builder, arg, types[i], sig[i + 1]);
+    }
+
+    LLVMValueRef result = LLVMBuildCall2(builder, ftype, f, args, n, "");
+    if (sig[0] != 'v') {
+        result =
+            toint64(builder, result, LLVMGetReturnType(ftype), sig[0]);
+        LLVMBuildStore(builder, result, LLVMGetParam(trampoline, 1));
+    }
+    LLVMBuildRetVoid(builder);
+}
+
+// ==================================================
+//
+// adds the trampolines of the functions defined in the module, and
+// their signatures to the table on the top of the stack
+//
+// ==================================================
+static void addtrampolines(lua_State* L, LLVMModuleRef module) {
+    LLVMBuilderRef builder =
+        LLVMCreateBuilderInContext(LLVMGetModuleContext(module));
+    LLVMValueRef f = LLVMGetFirstFunction(module);
+    // trampolines are appended, the last function is the last original
+    LLVMValueRef last = LLVMGetLastFunction(module);
+    for (; f != NULL; f = LLVMGetNextFunction(f)) {
+        char sig[MAXARGS + 2];
+        if (!LLVMIsDeclaration(f) && signature(f, sig)) {
+            lua_pushstring(L, sig);
+            lua_setfield(L, -2, LLVMGetValueName(f));
+            addtrampoline(module, builder, f, sig);
+        }
+        if (f == last) {
+            break;
+        }
+    }
+    LLVMDisposeBuilder(builder);
+}
+
+static int jiterror(lua_State* L, LLVMErrorRef e) {
+    char* err = LLVMGetErrorMessage(e);
+    lua_pushnil(L);
+    lua_pushfstring(L, "[LLVM] %s", err);
+    LLVMDisposeErrorMessage(err);
+    return 2;
+}
+
+static int messageerror(lua_State* L, char* err) {
+    lua_pushnil(L);
+    lua_pushfstring(L, "[LLVM] %s", err);
+    LLVMDisposeMessage(err);
+    return 2;
+}
+
+// ==================================================
+//
+// a target machine for the host, at an optimization level
+//
+// ==================================================
+static LLVMTargetMachineRef hostmachine(int level, char** err) {
+    char* triple = LLVMGetDefaultTargetTriple();
+    LLVMTargetRef target;
+    if (LLVMGetTargetFromTriple(triple, &target, err)) {
+        LLVMDisposeMessage(triple);
+        return NULL;
+    }
+    char* cpu = LLVMGetHostCPUName();
+    char* features = LLVMGetHostCPUFeatures();
+    LLVMTargetMachineRef tm = LLVMCreateTargetMachine(target, triple, cpu,
+        features, (LLVMCodeGenOptLevel)level, LLVMRelocPIC,
+        LLVMCodeModelJITDefault);
+    LLVMDisposeMessage(features);
+    LLVMDisposeMessage(cpu);
+    LLVMDisposeMessage(triple);
+    return tm;
+}
+
+static void checkoptions(lua_State* L, int i, int* level, int* lazy) {
+    *level = 2;
+    *lazy = 0;
+    if (lua_isnoneornil(L, i)) {
+        return;
+    }
+    luaL_checktype(L, i, LUA_TTABLE);
+    if (lua_getfield(L, i, "opt_level") != LUA_TNIL) {
+        int isnum;
+        *level = lua_tointegerx(L, -1, &isnum);
+        luaL_argcheck(L, isnum && *level >= 0 && *level <= 3, i,
+            "opt_level must be 0, 1, 2 or 3");
+    }
+    lua_getfield(L, i, "lazy");
+    *lazy = lua_toboolean(L, -1);
+    lua_pop(L, 2);
+}
+
+// ==================================================
+//
+// creates an execution engine from a snapshot of a module, later
+// changes to the module are not seen by the engine. options are
+// opt_level, from 0 to 3 (defaults to 2), for both the IR pipeline and
+// the code generator, and lazy, to compile each function only when it
+// is first called instead of the whole module on the first lookup.
+//
+// ==================================================
+int jit_new(lua_State* L) {
+    LLVMModuleRef module = getmodule(L, 1);
+    int level, lazy;
+    checkoptions(L, 2, &level, &lazy);
+
+    struct jit* jit = lua_newuserdata(L, sizeof(struct jit));
+    jit->ref = NULL;
+    luaL_setmetatable(L, LLB_JIT);
+    lua_newtable(L);
+
+    char* err;
+    if (lazy_materialize_all(module, &err)) {
+        return messageerror(L, err);
+    }
+
+    LLVMInitializeNativeTarget();
+    LLVMInitializeNativeAsmPrinter();
+
+    // the engine owns its context, the module is copied through bitcode
+    LLVMOrcThreadSafeContextRef tsc = LLVMOrcCreateNewThreadSafeContext();
+    LLVMMemoryBufferRef buffer = LLVMWriteBitcodeToMemoryBuffer(module);
+    LLVMModuleRef snapshot;
+    if (LLVMParseBitcodeInContext2(
+            LLVMOrcThreadSafeContextGetContext(tsc), buffer, &snapshot)) {
+        LLVMDisposeMemoryBuffer(buffer);
+        LLVMOrcDisposeThreadSafeContext(tsc);
+        return luaL_error(L, "cannot copy the module");
+    }
+    LLVMDisposeMemoryBuffer(buffer);
+    LLVMOrcThreadSafeModuleRef tsm =
+        LLVMOrcCreateNewThreadSafeModule(snapshot, tsc);
+    LLVMOrcDisposeThreadSafeContext(tsc);
+
+    addtrampolines(L, snapshot);
+    LLVMErrorRef e = NULL;
+    if (level > 0) {
+        char pipeline[] = "default<O0>";
+        pipeline[9] += level;
+        LLVMPassBuilderOptionsRef options = LLVMCreatePassBuilderOptions();
+        e = LLVMRunPasses(snapshot, pipeline, NULL, options);
+        LLVMDisposePassBuilderOptions(options);
+    }
+    if (e != NULL) {
+        LLVMOrcDisposeThreadSafeModule(tsm);
+        return jiterror(L, e);
+    }
+
+    LLVMTargetMachineRef tm = hostmachine(level, &err);
+    if (tm == NULL) {
+        LLVMOrcDisposeThreadSafeModule(tsm);
+        return messageerror(L, err);
+    }
+    LLVMOrcJITTargetMachineBuilderRef tmb =
+        LLVMOrcJITTargetMachineBuilderCreateFromTargetMachine(tm);
+    if (lazy) {
+        if (orc_createlazy(&jit->ref, tmb, &err)) {
+            LLVMOrcDisposeThreadSafeModule(tsm);
+            return messageerror(L, err);
+        }
+    } else {
+        LLVMOrcLLJITBuilderRef builder = LLVMOrcCreateLLJITBuilder();
+        LLVMOrcLLJITBuilderSetJITTargetMachineBuilder(builder, tmb);
+        if ((e = LLVMOrcCreateLLJIT(&jit->ref, builder)) != NULL) {
+            LLVMOrcDisposeThreadSafeModule(tsm);
+            return jiterror(L, e);
+        }
+    }
+
+    // jitted code may call functions of the process, as libc's
+    LLVMOrcJITDylibRef dylib = LLVMOrcLLJITGetMainJITDylib(jit->ref);
+    LLVMOrcDefinitionGeneratorRef generator;
+    e = LLVMOrcCreateDynamicLibrarySearchGeneratorForProcess(
+        &generator, LLVMOrcLLJITGetGlobalPrefix(jit->ref), NULL, NULL);
+    if (e != NULL) {
+        LLVMOrcDisposeThreadSafeModule(tsm);
+        return jiterror(L, e);
+    }
+    LLVMOrcJITDylibAddGenerator(dylib, generator);
+
+    // both take ownership of the module
+    if (lazy) {
+        if (orc_addlazy(jit->ref, tsm, &err)) {
+            return messageerror(L, err);
+        }
+    } else if ((e = LLVMOrcLLJITAddLLVMIRModule(jit->ref, dylib, tsm))) {
+        return jiterror(L, e);
+    }
+
+    lua_setuservalue(L, -2);
+    return 1;
+}
+
+static struct jit* checkjit(lua_State* L, int i) {
+    struct jit* jit = luaL_checkudata(L, i, LLB_JIT);
+    if (jit->ref == NULL) {
+        luaL_argerror(L, i, "disposed engine");
+    }
+    return jit;
+}
+
+// ==================================================
+//
+// calls a jitted function, the upvalues are its engine, trampoline
+// and signature
+//
+// ==================================================
+static int jit_call(lua_State* L) {
+    checkjit(L, lua_upvalueindex(1));
+    void (*trampoline)(int64_t*, int64_t*) =
+        (void (*)(int64_t*, int64_t*))lua_touserdata(
+            L, lua_upvalueindex(2));
+    const char* sig = lua_tostring(L, lua_upvalueindex(3));
+    int n = strlen(sig) - 1;
+    if (lua_gettop(L) != n) {
+        return luaL_error(L, "expected %d arguments, got %d", n,
+            lua_gettop(L));
+    }
+
+    int64_t args[MAXARGS];
+    int64_t result = 0;
+    for (int i = 0; i < n; i++) {
+        double d;
+        switch (sig[i + 1]) {
+            case 'b':
+                args[i] = lua_isboolean(L, i + 1)
+                    ? lua_toboolean(L, i + 1)
+                    : luaL_checkinteger(L, i + 1);
+                break;
+            case 'i':
+                args[i] = luaL_checkinteger(L, i + 1);
+                break;
+            case 'f':
+            case 'd':
+                d = luaL_checknumber(L, i + 1);
+                memcpy(&args[i], &d, sizeof(d));
+                break;
+            default:
+                switch (lua_type(L, i + 1)) {
+                    case LUA_TNIL:
+                        args[i] = 0;
+                        break;
+                    case LUA_TNUMBER:
+                        args[i] = luaL_checkinteger(L, i + 1);
+                        break;
+                    case LUA_TSTRING:
+                        // the string is alive until the call returns
+                        args[i] = (intptr_t)lua_tostring(L, i + 1);
+                        break;
+                    case LUA_TLIGHTUSERDATA:
+                    case LUA_TUSERDATA:
+                        args[i] = (intptr_t)lua_touserdata(L, i + 1);
+                        break;
+                    default:
+                        return luaL_argerror(L, i + 1, "expected a pointer");
+                }
+        }
+    }
+
+    trampoline(args, &result);
+
+    double d;
+    switch (sig[0]) {
+        case 'v':
+            return 0;
+        case 'b':
+            lua_pushboolean(L, result != 0);
+            return 1;
+        case 'i':
+            lua_pushinteger(L, result);
+            return 1;
+        case 'f':
+        case 'd':
+            memcpy(&d, &result, sizeof(d));
+            lua_pushnumber(L, d);
+            return 1;
+        default:
+            if (result == 0) {
+                lua_pushnil(L);
+            } else {
+                lua_pushlightuserdata(L, (void*)(intptr_t)result);
+            }
+            return 1;
+    }
+}
+
+// ==================================================
+//
+// returns a lua function that calls the jitted function name, or nil
+// if the module does not define it or its signature is not supported.
+// arguments and results may be integers, booleans, numbers and
+// pointers, that are passed as nil, integers, strings or userdata and
+// returned as nil or light userdata.
+//
+// ==================================================
+int jit_lookup(lua_State* L) {
+    struct jit* jit = checkjit(L, 1);
+    const char* name = luaL_checkstring(L, 2);
+    lua_getuservalue(L, 1);
+    if (lua_getfield(L, -1, name) == LUA_TNIL) {
+        return 1;
+    }
+
+    LLVMOrcExecutorAddress address;
+    lua_pushfstring(L, "%s%s", TRAMPOLINE, name);
+    LLVMErrorRef e =
+        LLVMOrcLLJITLookup(jit->ref, &address, lua_tostring(L, -1));
+    if (e != NULL) {
+        return jiterror(L, e);
+    }
+    lua_pop(L, 1);
+
+    lua_pushvalue(L, 1);
+    lua_pushlightuserdata(L, (void*)(intptr_t)address);
+    lua_rotate(L, -3, 2);
+    lua_pushcclosure(L, jit_call, 3);
+    return 1;
+}
+
+int jit_dispose(lua_State* L) {
+    struct jit* jit = luaL_checkudata(L, 1, LLB_JIT);
+    if (jit->ref != NULL) {
+        LLVMConsumeError(LLVMOrcDisposeLLJIT(jit->ref));
+        jit->ref = NULL;
+    }
+    return 0;
+}
+
+int jit_tostring(lua_State* L) {
+    struct jit* jit = luaL_checkudata(L, 1, LLB_JIT);
+    if (jit->ref == NULL) {
+        lua_pushstring(L, "jit (disposed)");
+    } else {
+        lua_pushfstring(L, "jit: %p", jit->ref);
+    }
+    return 1;
+}
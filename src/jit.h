@@ -0,0 +1,40 @@
+/*
+ * Lua binding for LLVM C API.
+ * Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+ *
+ * This file is part of llb.
+ *
+ * llb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * llb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with llb. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LLB_JIT_H
+#define _LLB_JIT_H
+
+#include <llvm-c/LLJIT.h>
+
+// ==================================================
+//
+// an execution engine, with a snapshot of a module
+//
+// ==================================================
+struct jit {
+    LLVMOrcLLJITRef ref;
+};
+
+extern int jit_new(lua_State*);
+extern int jit_lookup(lua_State*);
+extern int jit_dispose(lua_State*);
+extern int jit_tostring(lua_State*);
+
+#endif
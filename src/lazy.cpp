@@ -0,0 +1,49 @@
+/*
+ * Lua binding for LLVM C API.
+ * Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+ *
+ * This file is part of llb.
+ *
+ * llb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * llb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with llb. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// the C API can load modules lazily but cannot materialize them
+
+#include <llvm/IR/GlobalValue.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/Error.h>
+
+#include "lazy.h"
+
+using namespace llvm;
+
+static int seterror(Error e, char** err) {
+    if (!e) {
+        return 0;
+    }
+    *err = LLVMCreateMessage(toString(std::move(e)).c_str());
+    return 1;
+}
+
+int lazy_materialize(LLVMValueRef f, char** err) {
+    GlobalValue* gv = unwrap<GlobalValue>(f);
+    if (!gv->isMaterializable()) {
+        return 0;
+    }
+    return seterror(gv->materialize(), err);
+}
+
+int lazy_materialize_all(LLVMModuleRef module, char** err) {
+    return seterror(unwrap(module)->materializeAll(), err);
+}
@@ -0,0 +1,45 @@
+/*
+ * Lua binding for LLVM C API.
+ * Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+ *
+ * This file is part of llb.
+ *
+ * llb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * llb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with llb. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LLB_LAZY_H
+#define _LLB_LAZY_H
+
+#include <llvm-c/Core.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ==================================================
+//
+// reads the body of a function of a lazily loaded module, or all of
+// them. does nothing on already materialized functions.
+// return 0 on success, otherwise err is set and must be disposed with
+// LLVMDisposeMessage.
+//
+// ==================================================
+extern int lazy_materialize(LLVMValueRef, char** err);
+extern int lazy_materialize_all(LLVMModuleRef, char** err);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
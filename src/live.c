@@ -0,0 +1,332 @@
+/*
+ * Lua binding for LLVM C API.
+ * Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+ *
+ * This file is part of llb.
+ *
+ * llb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * llb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with llb. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <llvm-c/Core.h>
+
+#include "cfg.h"
+#include "live.h"
+#include "ssa.h"
+#include "stats.h"
+
+#define NWORDS(n) (((n) + 63) / 64)
+#define BIT(i) ((uint64_t)1 << ((i) % 64))
+
+struct livekey {
+    LLVMValueRef value;
+    unsigned i;
+};
+
+static int keycmp(const void* a, const void* b) {
+    LLVMValueRef x = ((const struct livekey*)a)->value;
+    LLVMValueRef y = ((const struct livekey*)b)->value;
+    return x < y ? -1 : x > y;
+}
+
+// ==================================================
+//
+// returns the bit of v in the sorted keys, or CFG_UNDEF
+//
+// ==================================================
+static unsigned find(const struct livekey* keys, unsigned n, LLVMValueRef v) {
+    struct livekey key = {v, 0};
+    struct livekey* found =
+        bsearch(&key, keys, n, sizeof(struct livekey), keycmp);
+    return found == NULL ? CFG_UNDEF : found->i;
+}
+
+static unsigned regbit(const struct live* lv, LLVMValueRef v) {
+    return find(lv->keys, lv->nvalues, v);
+}
+
+static unsigned slotbit(const struct live* lv, LLVMValueRef v) {
+    if (lv->nallocas == 0 || !LLVMIsAAllocaInst(v)) {
+        return CFG_UNDEF;
+    }
+    return find(lv->slotkeys, lv->nallocas, v);
+}
+
+// ==================================================
+//
+// numbers the registers and the promotable allocas of the cfg. the
+// allocas are only slots: their addresses are not register pressure.
+//
+// ==================================================
+static int collect(struct live* lv, const struct cfg* g) {
+    LLVMValueRef f = g->n > 0 ? LLVMGetBasicBlockParent(g->blocks[0]) : NULL;
+    unsigned nparams = f != NULL ? LLVMCountParams(f) : 0;
+    unsigned n = nparams;
+    unsigned nallocas = 0;
+    for (unsigned b = 0; b < g->n; b++) {
+        for (LLVMValueRef inst = LLVMGetFirstInstruction(g->blocks[b]);
+             inst != NULL; inst = LLVMGetNextInstruction(inst)) {
+            if (LLVMIsAAllocaInst(inst) && ssa_ispromotable(inst)) {
+                nallocas++;
+            } else if (LLVMGetTypeKind(LLVMTypeOf(inst)) != LLVMVoidTypeKind) {
+                n++;
+            }
+        }
+    }
+
+    lv->values = malloc((n + nallocas + 1) * sizeof(LLVMValueRef));
+    lv->keys = malloc((n + 1) * sizeof(struct livekey));
+    lv->slotkeys = malloc((nallocas + 1) * sizeof(struct livekey));
+    if (lv->values == NULL || lv->keys == NULL || lv->slotkeys == NULL) {
+        return -1;
+    }
+
+    for (unsigned i = 0; i < nparams; i++) {
+        lv->values[i] = LLVMGetParam(f, i);
+    }
+    unsigned i = nparams;
+    unsigned a = 0;
+    for (unsigned b = 0; b < g->n; b++) {
+        for (LLVMValueRef inst = LLVMGetFirstInstruction(g->blocks[b]);
+             inst != NULL; inst = LLVMGetNextInstruction(inst)) {
+            if (LLVMIsAAllocaInst(inst) && ssa_ispromotable(inst)) {
+                lv->values[n + a++] = inst;
+            } else if (LLVMGetTypeKind(LLVMTypeOf(inst)) != LLVMVoidTypeKind) {
+                lv->values[i++] = inst;
+            }
+        }
+    }
+    for (i = 0; i < n; i++) {
+        lv->keys[i] = (struct livekey){lv->values[i], i};
+    }
+    lv->slotbase = NWORDS(n) * 64;
+    for (a = 0; a < nallocas; a++) {
+        lv->slotkeys[a] = (struct livekey){lv->values[n + a], lv->slotbase + a};
+    }
+    qsort(lv->keys, n, sizeof(struct livekey), keycmp);
+    qsort(lv->slotkeys, nallocas, sizeof(struct livekey), keycmp);
+
+    lv->nvalues = n;
+    lv->nallocas = nallocas;
+    lv->nwords = NWORDS(n) + NWORDS(nallocas);
+    return 0;
+}
+
+// ==================================================
+//
+// turns the values live after an instruction into the values live
+// before it: its definitions die, its uses become live. the operands
+// of phis are live on the incoming edges, not before the phi.
+//
+// ==================================================
+void live_step(const struct live* lv, LLVMValueRef inst, uint64_t* set) {
+    unsigned bit = regbit(lv, inst);
+    if (bit != CFG_UNDEF) {
+        set[bit / 64] &= ~BIT(bit);
+    }
+    if (LLVMIsAPHINode(inst)) {
+        return;
+    }
+
+    if (LLVMIsAStoreInst(inst)) {
+        bit = slotbit(lv, LLVMGetOperand(inst, 1));
+        if (bit != CFG_UNDEF) {
+            set[bit / 64] &= ~BIT(bit);
+        }
+    } else if (LLVMIsALoadInst(inst)) {
+        bit = slotbit(lv, LLVMGetOperand(inst, 0));
+        if (bit != CFG_UNDEF) {
+            set[bit / 64] |= BIT(bit);
+        }
+    }
+
+    int n = LLVMGetNumOperands(inst);
+    for (int i = 0; i < n; i++) {
+        bit = regbit(lv, LLVMGetOperand(inst, i));
+        if (bit != CFG_UNDEF) {
+            set[bit / 64] |= BIT(bit);
+        }
+    }
+}
+
+// ==================================================
+//
+// counts the registers of a set, leaving the slots out
+//
+// ==================================================
+unsigned live_count(const struct live* lv, const uint64_t* set) {
+    unsigned count = 0;
+    for (unsigned w = 0; w < NWORDS(lv->nvalues); w++) {
+        count += __builtin_popcountll(set[w]);
+    }
+    return count;
+}
+
+// ==================================================
+//
+// computes the local sets of each block:
+// use, the values read before any definition in the block
+// def, the values defined in the block, phis included
+// and adds the phi operands to the live out set of their edge
+//
+// ==================================================
+static void local(struct live* lv, const struct cfg* g, uint64_t* use,
+                  uint64_t* def) {
+    unsigned nw = lv->nwords;
+    for (unsigned b = 0; b < g->n; b++) {
+        uint64_t* u = use + b * nw;
+        uint64_t* d = def + b * nw;
+        for (LLVMValueRef inst = LLVMGetLastInstruction(g->blocks[b]);
+             inst != NULL; inst = LLVMGetPreviousInstruction(inst)) {
+            live_step(lv, inst, u);
+            unsigned bit = regbit(lv, inst);
+            if (bit == CFG_UNDEF && LLVMIsAStoreInst(inst)) {
+                bit = slotbit(lv, LLVMGetOperand(inst, 1));
+            }
+            if (bit != CFG_UNDEF) {
+                d[bit / 64] |= BIT(bit);
+            }
+            if (!LLVMIsAPHINode(inst)) {
+                continue;
+            }
+            unsigned n = LLVMCountIncoming(inst);
+            for (unsigned k = 0; k < n; k++) {
+                unsigned p =
+                    cfg_index(g, LLVMGetIncomingBlock(inst, k));
+                bit = regbit(lv, LLVMGetIncomingValue(inst, k));
+                if (p != CFG_UNDEF && bit != CFG_UNDEF) {
+                    lv->out[p * nw + bit / 64] |= BIT(bit);
+                }
+            }
+        }
+    }
+}
+
+// ==================================================
+//
+// in(b) = use(b) | (out(b) & ~def(b))
+// out(b) = phiuses(b) | in(s) for each successor s
+// iterated in postorder, then over the unreachable blocks, until the
+// sets stop growing. the sets only grow, so out is updated in place.
+//
+// ==================================================
+static void solve(struct live* lv, const struct cfg* g, const uint64_t* use,
+                  const uint64_t* def, unsigned* order) {
+    unsigned nw = lv->nwords;
+    unsigned k = 0;
+    for (unsigned i = g->nrpo; i > 0; i--) {
+        order[k++] = g->rpo[i - 1];
+    }
+    for (unsigned b = 0; b < g->n; b++) {
+        if (g->order[b] == CFG_UNDEF) {
+            order[k++] = b;
+        }
+    }
+
+    for (int changed = 1; changed;) {
+        changed = 0;
+        for (k = 0; k < g->n; k++) {
+            unsigned b = order[k];
+            uint64_t* in = lv->in + b * nw;
+            uint64_t* out = lv->out + b * nw;
+            for (unsigned e = g->succoff[b]; e < g->succoff[b + 1]; e++) {
+                const uint64_t* s = lv->in + g->succ[e] * nw;
+                for (unsigned w = 0; w < nw; w++) {
+                    out[w] |= s[w];
+                }
+            }
+            for (unsigned w = 0; w < nw; w++) {
+                uint64_t x = use[b * nw + w] | (out[w] & ~def[b * nw + w]);
+                changed |= x != in[w];
+                in[w] = x;
+            }
+        }
+    }
+}
+
+// ==================================================
+//
+// walks each block backwards from its live out set, to find where
+// each value is live and the register pressure of the block
+//
+// ==================================================
+static void span(struct live* lv, const struct cfg* g, uint64_t* set) {
+    unsigned nw = lv->nwords;
+    for (unsigned b = 0; b < g->n; b++) {
+        uint64_t* sp = lv->span + b * nw;
+        memcpy(set, lv->out + b * nw, nw * sizeof(uint64_t));
+        memcpy(sp, set, nw * sizeof(uint64_t));
+        unsigned pressure = live_count(lv, set);
+        for (LLVMValueRef inst = LLVMGetLastInstruction(g->blocks[b]);
+             inst != NULL; inst = LLVMGetPreviousInstruction(inst)) {
+            live_step(lv, inst, set);
+            unsigned count = live_count(lv, set);
+            pressure = count > pressure ? count : pressure;
+            for (unsigned w = 0; w < nw; w++) {
+                sp[w] |= set[w];
+            }
+        }
+        lv->pressure[b] = pressure;
+    }
+}
+
+int live_build(struct live* lv, const struct cfg* g) {
+    memset(lv, 0, sizeof(struct live));
+    STATS_START(start);
+    if (collect(lv, g)) {
+        live_free(lv);
+        return -1;
+    }
+
+    size_t size = (size_t)g->n * lv->nwords + 1;
+    lv->in = calloc(size, sizeof(uint64_t));
+    lv->out = calloc(size, sizeof(uint64_t));
+    lv->span = calloc(size, sizeof(uint64_t));
+    lv->pressure = malloc((g->n + 1) * sizeof(unsigned));
+    uint64_t* use = calloc(size, sizeof(uint64_t));
+    uint64_t* def = calloc(size, sizeof(uint64_t));
+    unsigned* order = malloc((g->n + 1) * sizeof(unsigned));
+    if (lv->in == NULL || lv->out == NULL || lv->span == NULL ||
+        lv->pressure == NULL || use == NULL || def == NULL || order == NULL) {
+        free(use);
+        free(def);
+        free(order);
+        live_free(lv);
+        return -1;
+    }
+
+    local(lv, g, use, def);
+    solve(lv, g, use, def, order);
+    // the first block's use set is a scratch set from here on
+    span(lv, g, use);
+
+    free(use);
+    free(def);
+    free(order);
+    STATS_STOP(STATS_LIVENESS, start);
+    return 0;
+}
+
+void live_free(struct live* lv) {
+    free(lv->values);
+    free(lv->keys);
+    free(lv->slotkeys);
+    free(lv->in);
+    free(lv->out);
+    free(lv->span);
+    free(lv->pressure);
+}
@@ -0,0 +1,59 @@
+/*
+ * Lua binding for LLVM C API.
+ * Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+ *
+ * This file is part of llb.
+ *
+ * llb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * llb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with llb. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LLB_LIVE_H
+#define _LLB_LIVE_H
+
+// ==================================================
+//
+//  liveness of the values of a cfg, by backward dataflow over dense
+//  bitsets. the registers are the function's arguments and the
+//  instructions with a result, other than the promotable allocas. those
+//  are tracked as memory slots instead: loads use them and stores define
+//  them, so the same engine answers for IR before and after SSA
+//  construction.
+//  registers are bits [0, nvalues), the slot of alloca a is the bit
+//  slotbase + a. the sets of block i are x[i * nwords .. + nwords - 1].
+//
+// ==================================================
+struct live {
+    unsigned nvalues;
+    unsigned nallocas;
+    // values[0 .. nvalues - 1] are the registers, in program order,
+    // values[nvalues + a] is the a-th promotable alloca
+    LLVMValueRef* values;
+    struct livekey* keys;
+    struct livekey* slotkeys;
+    unsigned slotbase;
+    unsigned nwords;
+    uint64_t* in;
+    uint64_t* out;
+    // values live at some point of the block
+    uint64_t* span;
+    // the most registers live at once in the block
+    unsigned* pressure;
+};
+
+extern int live_build(struct live*, const struct cfg*);
+extern void live_step(const struct live*, LLVMValueRef, uint64_t*);
+extern unsigned live_count(const struct live*, const uint64_t*);
+extern void live_free(struct live*);
+
+#endif
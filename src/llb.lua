@@ -24,11 +24,15 @@ local llb = require "core"
 -- creates all objects classes
 --
 do
+    llb.newclass({}, "context")
     llb.newclass({}, "module")
     llb.newclass(require("function"), "function")
     llb.newclass({}, "basicblock")
     llb.newclass({}, "instruction")
     llb.newclass({}, "builder")
+    llb.newclass(require("bitset"), "bitset")
+    llb.newclass({}, "jit")
+    llb.newclass({}, "domtree")
 end
 
 return llb
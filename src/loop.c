@@ -0,0 +1,327 @@
+/*
+ * Lua binding for LLVM C API.
+ * Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+ *
+ * This file is part of llb.
+ *
+ * llb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * llb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with llb. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+
+#include <llvm-c/Core.h>
+
+#include "cfg.h"
+#include "loop.h"
+#include "stats.h"
+
+// ==================================================
+//
+// a growable array of unsigned
+//
+// ==================================================
+struct vec {
+    unsigned* a;
+    unsigned n;
+    unsigned cap;
+};
+
+static int push(struct vec* v, unsigned x) {
+    if (v->n == v->cap) {
+        unsigned cap = v->cap == 0 ? 16 : 2 * v->cap;
+        unsigned* a = realloc(v->a, cap * sizeof(unsigned));
+        if (a == NULL) {
+            return -1;
+        }
+        v->a = a;
+        v->cap = cap;
+    }
+    v->a[v->n++] = x;
+    return 0;
+}
+
+// ==================================================
+//
+// a dominates b, both reachable. the dominators of b come before it
+// in reverse postorder, so the walk stops past a.
+//
+// ==================================================
+static int dominates(
+    const struct cfg* g, const unsigned* idom, unsigned a, unsigned b) {
+    while (b != CFG_UNDEF && g->order[b] > g->order[a]) {
+        b = idom[b];
+    }
+    return b == a;
+}
+
+struct builder {
+    const struct cfg* g;
+    const unsigned* idom;
+    struct vec header, parent, depth, preheader;
+    struct vec bodyoff, body, latchoff, latch, exitoff, exit;
+    struct vec regionoff, region, entryoff, entry;
+    unsigned* loopof;
+    // stamps of the current loop or region, indexed by block
+    unsigned* mark;
+    unsigned* seen;
+    unsigned* stack;
+};
+
+// ==================================================
+//
+// adds the natural loop of header h, if it has back edges.
+// blocks are marked with the number of the loop.
+//
+// ==================================================
+static int addloop(struct builder* b, unsigned h) {
+    const struct cfg* g = b->g;
+    unsigned l = b->header.n;
+    unsigned nlatches = b->latch.n;
+    for (unsigned e = g->predoff[h]; e < g->predoff[h + 1]; e++) {
+        unsigned p = g->pred[e];
+        if (g->order[p] != CFG_UNDEF && dominates(g, b->idom, h, p) &&
+            push(&b->latch, p)) {
+            return -1;
+        }
+    }
+    if (b->latch.n == nlatches) {
+        return 0;
+    }
+
+    // the body: the blocks that reach a latch without passing by h
+    unsigned first = b->body.n, top = 0;
+    b->mark[h] = l;
+    if (push(&b->body, h)) {
+        return -1;
+    }
+    for (unsigned k = nlatches; k < b->latch.n; k++) {
+        unsigned p = b->latch.a[k];
+        if (b->mark[p] != l) {
+            b->mark[p] = l;
+            b->stack[top++] = p;
+        }
+    }
+    while (top > 0) {
+        unsigned x = b->stack[--top];
+        if (push(&b->body, x)) {
+            return -1;
+        }
+        for (unsigned e = g->predoff[x]; e < g->predoff[x + 1]; e++) {
+            unsigned p = g->pred[e];
+            if (g->order[p] != CFG_UNDEF && b->mark[p] != l) {
+                b->mark[p] = l;
+                b->stack[top++] = p;
+            }
+        }
+    }
+
+    // the enclosing loops were added before, inner loops come later
+    unsigned parent = b->loopof[h];
+    unsigned depth = parent == CFG_UNDEF ? 1 : b->depth.a[parent] + 1;
+    for (unsigned k = first; k < b->body.n; k++) {
+        b->loopof[b->body.a[k]] = l;
+    }
+
+    for (unsigned k = first; k < b->body.n; k++) {
+        unsigned x = b->body.a[k];
+        for (unsigned e = g->succoff[x]; e < g->succoff[x + 1]; e++) {
+            unsigned s = g->succ[e];
+            if (b->mark[s] != l && b->seen[s] != l) {
+                b->seen[s] = l;
+                if (push(&b->exit, s)) {
+                    return -1;
+                }
+            }
+        }
+    }
+
+    unsigned preheader = CFG_UNDEF, outside = 0;
+    for (unsigned e = g->predoff[h]; e < g->predoff[h + 1]; e++) {
+        unsigned p = g->pred[e];
+        if (g->order[p] != CFG_UNDEF && b->mark[p] != l) {
+            preheader = p;
+            outside++;
+        }
+    }
+    if (outside != 1 ||
+        g->succoff[preheader + 1] - g->succoff[preheader] != 1) {
+        preheader = CFG_UNDEF;
+    }
+
+    if (push(&b->header, h) || push(&b->parent, parent) ||
+        push(&b->depth, depth) || push(&b->preheader, preheader) ||
+        push(&b->bodyoff, b->body.n) || push(&b->latchoff, b->latch.n) ||
+        push(&b->exitoff, b->exit.n)) {
+        return -1;
+    }
+    return 0;
+}
+
+// ==================================================
+//
+// finds the strongly connected components with Kosaraju's algorithm,
+// walking the predecessors in reverse postorder, and adds the ones
+// that have a retreating edge whose target does not dominate its source
+//
+// ==================================================
+static int addregions(struct builder* b) {
+    const struct cfg* g = b->g;
+    for (unsigned i = 0; i < g->n; i++) {
+        b->mark[i] = CFG_UNDEF;
+        b->seen[i] = CFG_UNDEF;
+    }
+
+    unsigned nscc = 0;
+    for (unsigned k = 0; k < g->nrpo; k++) {
+        unsigned root = g->rpo[k];
+        if (b->mark[root] != CFG_UNDEF) {
+            continue;
+        }
+        // the component of root, in stack[0 .. n - 1]
+        unsigned scc = nscc++, n = 0, top = 0;
+        b->mark[root] = scc;
+        b->stack[top++] = root;
+        while (top > n) {
+            unsigned x = b->stack[n++];
+            for (unsigned e = g->predoff[x]; e < g->predoff[x + 1]; e++) {
+                unsigned p = g->pred[e];
+                if (g->order[p] != CFG_UNDEF && b->mark[p] == CFG_UNDEF) {
+                    b->mark[p] = scc;
+                    b->stack[top++] = p;
+                }
+            }
+        }
+
+        int irreducible = 0;
+        for (unsigned i = 0; i < n && !irreducible; i++) {
+            unsigned x = b->stack[i];
+            for (unsigned e = g->succoff[x]; e < g->succoff[x + 1]; e++) {
+                unsigned s = g->succ[e];
+                if (b->mark[s] == scc && g->order[s] <= g->order[x] &&
+                    !dominates(g, b->idom, s, x)) {
+                    irreducible = 1;
+                    break;
+                }
+            }
+        }
+        if (!irreducible) {
+            continue;
+        }
+
+        for (unsigned i = 0; i < n; i++) {
+            unsigned x = b->stack[i];
+            if (push(&b->region, x)) {
+                return -1;
+            }
+            int isentry = x == 0;
+            for (unsigned e = g->predoff[x]; e < g->predoff[x + 1]; e++) {
+                unsigned p = g->pred[e];
+                isentry |= g->order[p] != CFG_UNDEF && b->mark[p] != scc;
+            }
+            if (isentry && push(&b->entry, x)) {
+                return -1;
+            }
+        }
+        if (push(&b->regionoff, b->region.n) ||
+            push(&b->entryoff, b->entry.n)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// ==================================================
+//
+// finds the natural loops of a graph, their nesting, and its
+// irreducible regions. idom is the output of dom_idom.
+// returns 0 on success, -1 if out of memory.
+//
+// ==================================================
+int loop_build(
+    struct loops* loops, const struct cfg* g, const unsigned* idom) {
+    STATS_START(start);
+    struct builder b = {.g = g, .idom = idom};
+    b.loopof = malloc((g->n + 1) * sizeof(unsigned));
+    b.mark = malloc((g->n + 1) * sizeof(unsigned));
+    b.seen = malloc((g->n + 1) * sizeof(unsigned));
+    b.stack = malloc((g->n + 1) * sizeof(unsigned));
+    int err = b.loopof == NULL || b.mark == NULL || b.seen == NULL ||
+        b.stack == NULL || push(&b.bodyoff, 0) || push(&b.latchoff, 0) ||
+        push(&b.exitoff, 0) || push(&b.regionoff, 0) ||
+        push(&b.entryoff, 0);
+    for (unsigned i = 0; !err && i < g->n; i++) {
+        b.loopof[i] = CFG_UNDEF;
+        b.mark[i] = CFG_UNDEF;
+        b.seen[i] = CFG_UNDEF;
+    }
+    for (unsigned k = 0; !err && k < g->nrpo; k++) {
+        err = addloop(&b, g->rpo[k]);
+    }
+    if (!err) {
+        err = addregions(&b);
+    }
+
+    free(b.mark);
+    free(b.seen);
+    free(b.stack);
+    *loops = (struct loops){
+        .n = b.header.n,
+        .header = b.header.a,
+        .parent = b.parent.a,
+        .depth = b.depth.a,
+        .preheader = b.preheader.a,
+        .bodyoff = b.bodyoff.a,
+        .body = b.body.a,
+        .latchoff = b.latchoff.a,
+        .latch = b.latch.a,
+        .exitoff = b.exitoff.a,
+        .exit = b.exit.a,
+        .loopof = b.loopof,
+        .nregions = b.regionoff.n > 0 ? b.regionoff.n - 1 : 0,
+        .regionoff = b.regionoff.a,
+        .region = b.region.a,
+        .entryoff = b.entryoff.a,
+        .entry = b.entry.a,
+    };
+    if (err) {
+        loop_free(loops);
+        return -1;
+    }
+    STATS_STOP(STATS_LOOPS, start);
+    return 0;
+}
+
+// ==================================================
+//
+// releases all memory held by the loops
+//
+// ==================================================
+void loop_free(struct loops* loops) {
+    free(loops->header);
+    free(loops->parent);
+    free(loops->depth);
+    free(loops->preheader);
+    free(loops->bodyoff);
+    free(loops->body);
+    free(loops->latchoff);
+    free(loops->latch);
+    free(loops->exitoff);
+    free(loops->exit);
+    free(loops->loopof);
+    free(loops->regionoff);
+    free(loops->region);
+    free(loops->entryoff);
+    free(loops->entry);
+    *loops = (struct loops){0};
+}
@@ -0,0 +1,65 @@
+/*
+ * Lua binding for LLVM C API.
+ * Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+ *
+ * This file is part of llb.
+ *
+ * llb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * llb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with llb. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LLB_LOOP_H
+#define _LLB_LOOP_H
+
+// ==================================================
+//
+//  natural loops and their nesting forest, over a cfg.
+//  loops are numbered by the reverse postorder of their headers, so
+//  a loop comes after the loops that contain it. lists are CSR, as in
+//  struct cfg: the body of l is body[bodyoff[l] .. bodyoff[l + 1] - 1].
+//
+// ==================================================
+struct loops {
+    unsigned n;
+    unsigned* header;
+    // the innermost loop containing l, CFG_UNDEF for outermost loops
+    unsigned* parent;
+    // 1 for outermost loops
+    unsigned* depth;
+    // the only predecessor of the header outside of the loop, if its
+    // only successor is the header, otherwise CFG_UNDEF
+    unsigned* preheader;
+    // the blocks of the loop, including the ones of nested loops
+    unsigned* bodyoff;
+    unsigned* body;
+    // the sources of the back edges to the header
+    unsigned* latchoff;
+    unsigned* latch;
+    // the blocks outside of the loop with a predecessor in it
+    unsigned* exitoff;
+    unsigned* exit;
+    // the innermost loop of each block of the cfg, CFG_UNDEF if none
+    unsigned* loopof;
+    // strongly connected regions with retreating edges that are not
+    // back edges, and their entry blocks
+    unsigned nregions;
+    unsigned* regionoff;
+    unsigned* region;
+    unsigned* entryoff;
+    unsigned* entry;
+};
+
+extern int loop_build(struct loops*, const struct cfg*, const unsigned*);
+extern void loop_free(struct loops*);
+
+#endif
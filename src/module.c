@@ -18,13 +18,20 @@
  * along with llb. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <string.h>
+
 #include <lauxlib.h>
 #include <lua.h>
 
+#include <llvm-c/BitWriter.h>
 #include <llvm-c/Core.h>
 
+#include "builder.h"
+#include "context.h"
 #include "core.h"
 #include "function.h"
+#include "lazy.h"
+#include "stream.h"
 
 // ==================================================
 //
@@ -35,7 +42,9 @@ static int internal_modgc(lua_State* L) {
     lua_pushnil(L);
     while (lua_next(L, 1) != 0) {
         LLVMDisposeModule(*(LLVMModuleRef*)lua_touserdata(L, -2));
-        lua_pop(L, 1);
+        lua_getuservalue(L, -2);
+        context_release(lua_touserdata(L, -1));
+        lua_pop(L, 2);
     }
     return 0;
 }
@@ -55,13 +64,17 @@ static void buildmodstable(lua_State* L) {
 
 // ==================================================
 //
-// instantiates a new module object.
+// instantiates a new module object of the context at index ctx.
 // holds a reference table on the registry to free all modules
 // automatically when a lua state is closed.
 //
 // ==================================================
-int module_new(lua_State* L, LLVMModuleRef module) {
+int module_new(lua_State* L, LLVMModuleRef module, int ctx) {
+    ctx = lua_absindex(L, ctx);
+    context_retain(lua_touserdata(L, ctx));
     newuserdata(L, module, LLB_MODULE);
+    lua_pushvalue(L, ctx);
+    lua_setuservalue(L, -2);
     if (lua_getfield(L, LUA_REGISTRYINDEX, "internal_modules") == LUA_TNIL) {
         lua_pop(L, 1);
         buildmodstable(L);
@@ -80,64 +93,129 @@ int module_new(lua_State* L, LLVMModuleRef module) {
 
 // ==================================================
 //
-//  disposes a module explicitly
+// keeps the value on the top of the stack alive while the module at
+// index i is not disposed, as the memory of a lazily loaded module.
+// pops the value.
+//
+// ==================================================
+void module_keep(lua_State* L, int i) {
+    i = lua_absindex(L, i);
+    lua_getfield(L, LUA_REGISTRYINDEX, "internal_modules");
+    lua_pushvalue(L, i);
+    lua_pushvalue(L, -3);
+    lua_rawset(L, -3);
+    lua_pop(L, 2);
+}
+
+// ==================================================
+//
+//  disposes a module explicitly. the objects of its values are dropped,
+//  so the ones of a later module never alias them
 //
 // ==================================================
 int module_dispose(lua_State* L) {
     LLVMModuleRef module = getmodule(L, 1);
     lua_getfield(L, LUA_REGISTRYINDEX, "internal_modules");
     lua_pushvalue(L, 1);
+    if (lua_rawget(L, -2) == LUA_TNIL) {
+        return 0;
+    }
+    lua_pushvalue(L, 1);
     lua_pushnil(L);
-    lua_settable(L, -3);
+    lua_rawset(L, -4);
+    forgetmodule(L, module);
     LLVMDisposeModule(module);
+    lua_getuservalue(L, 1);
+    context_release(lua_touserdata(L, -1));
     return 0;
 }
 
 // ==================================================
 //
-// iterates over all functions in a module
+// returns the context of a module
+//
+// ==================================================
+int module_context(lua_State* L) {
+    luaL_checkudata(L, 1, LLB_MODULE);
+    lua_getuservalue(L, 1);
+    return 1;
+}
+
+static const char* const functionfilters[] = {
+    "all", "definitions", "declarations", NULL};
+
+// ==================================================
+//
+// iterator of module_pairs and module_functions.
+// upvalue 1 is the cursor, the next function to visit. upvalue 2 is
+// the filter (see functionfilters), upvalue 3 tells if the name of
+// the function is yielded before it.
+// the cursor moves before the current function is yielded, so each
+// step costs O(1) and unnamed or duplicated names are not a problem.
 //
 // ==================================================
 static int module_iterator(lua_State* L) {
-    LLVMModuleRef module = getmodule(L, 1);
-    if (lua_isnil(L, 2)) {
-        LLVMValueRef f = LLVMGetFirstFunction(module);
-        const char* fname = LLVMGetValueName(f);
-        lua_pushstring(L, fname);
-        function_new(L, f);
-    } else {
-        const char* key = luaL_checkstring(L, 2);
-        LLVMValueRef f = LLVMGetNamedFunction(module, key);
-        LLVMValueRef fnext = LLVMGetNextFunction(f);
-        if (fnext == NULL) {
-            lua_pushnil(L);
-            return 1;
+    LLVMValueRef f = lua_touserdata(L, lua_upvalueindex(1));
+    int filter = lua_tointeger(L, lua_upvalueindex(2));
+    for (; f != NULL; f = LLVMGetNextFunction(f)) {
+        int declaration = LLVMIsDeclaration(f);
+        if (filter == 0 || (filter == 1 && !declaration) ||
+            (filter == 2 && declaration)) {
+            break;
         }
-        const char* fnextname = LLVMGetValueName(fnext);
-        lua_pushstring(L, fnextname);
-        function_new(L, fnext);
     }
-    return 2;
+    if (f == NULL) {
+        return 0;
+    }
+
+    lua_pushlightuserdata(L, LLVMGetNextFunction(f));
+    lua_replace(L, lua_upvalueindex(1));
+    if (lua_toboolean(L, lua_upvalueindex(3))) {
+        lua_pushstring(L, LLVMGetValueName(f));
+        function_new(L, f);
+        return 2;
+    }
+    return function_new(L, f);
+}
+
+static int pushiterator(lua_State* L, int filter, int named) {
+    LLVMModuleRef module = getmodule(L, 1);
+    lua_pushlightuserdata(L, LLVMGetFirstFunction(module));
+    lua_pushinteger(L, filter);
+    lua_pushboolean(L, named);
+    lua_pushcclosure(L, module_iterator, 3);
+    lua_pushvalue(L, 1);
+    lua_pushnil(L);
+    return 3;
 }
 
 // ==================================================
 //
 // __pairs metamethod
+// iterates over all functions in a module as (name, function)
 //
 // ==================================================
 int module_pairs(lua_State* L) {
-    lua_pushcfunction(L, module_iterator);
-    lua_pushvalue(L, 1);
-    lua_pushnil(L);
-    return 3;
+    return pushiterator(L, 0, 1);
 }
 
 // ==================================================
 //
-// __index metamethod
+// iterates over the functions in a module.
+// receives an optional filter: "all", "definitions" or "declarations"
 //
 // ==================================================
-int module_index(lua_State* L) {
+int module_functions(lua_State* L) {
+    int filter = luaL_checkoption(L, 2, "all", functionfilters);
+    return pushiterator(L, filter, 0);
+}
+
+// ==================================================
+//
+// gets a function by its name, or nil
+//
+// ==================================================
+int module_get_function(lua_State* L) {
     LLVMModuleRef module = getmodule(L, 1);
     const char* key = luaL_checkstring(L, 2);
     LLVMValueRef f = LLVMGetNamedFunction(module, key);
@@ -149,6 +227,61 @@ int module_index(lua_State* L) {
     return 1;
 }
 
+// ==================================================
+//
+// adds a function to the module, or returns the existing one:
+// module:add_function("max", "i32", {"i32", "i32"})
+// a declaration, until blocks are added to it. receives the return
+// type, the parameter types and if it is variadic.
+//
+// ==================================================
+int module_add_function(lua_State* L) {
+    LLVMModuleRef module = getmodule(L, 1);
+    const char* name = luaL_checkstring(L, 2);
+    LLVMContextRef ctx = LLVMGetModuleContext(module);
+    LLVMTypeRef ret = builder_type(L, ctx, luaL_checkstring(L, 3));
+    int n = 0;
+    if (!lua_isnoneornil(L, 4)) {
+        luaL_checktype(L, 4, LUA_TTABLE);
+        n = luaL_len(L, 4);
+    }
+    int vararg = lua_toboolean(L, 5);
+
+    LLVMTypeRef params[n + 1];
+    for (int i = 0; i < n; i++) {
+        lua_geti(L, 4, i + 1);
+        params[i] = builder_type(L, ctx, luaL_checkstring(L, -1));
+        lua_pop(L, 1);
+    }
+
+    LLVMValueRef f = LLVMGetNamedFunction(module, name);
+    if (f == NULL) {
+        f = LLVMAddFunction(
+            module, name, LLVMFunctionType(ret, params, n, vararg));
+    }
+    return function_new(L, f);
+}
+
+// ==================================================
+//
+// __index metamethod
+// methods take precedence over functions with the same name,
+// get_function always looks up a function
+//
+// ==================================================
+int module_index(lua_State* L) {
+    const char* key = luaL_checkstring(L, 2);
+    if (key[0] != '_' || key[1] != '_') {
+        lua_getmetatable(L, 1);
+        lua_pushvalue(L, 2);
+        if (lua_rawget(L, -2) != LUA_TNIL) {
+            return 1;
+        }
+        lua_pop(L, 2);
+    }
+    return module_get_function(L);
+}
+
 // ==================================================
 //
 // returns the IR builder of a module
@@ -159,9 +292,67 @@ int module_get_builder(lua_State* L) {
     LLVMContextRef context = LLVMGetModuleContext(module);
     LLVMBuilderRef builder = LLVMCreateBuilderInContext(context);
     newuserdata(L, builder, LLB_BUILDER);
+    // the module outlives its builders
+    lua_pushvalue(L, 1);
+    lua_setuservalue(L, -2);
     return 1;
 }
 
+// ==================================================
+//
+// gets the module at index i with all its functions materialized
+//
+// ==================================================
+static LLVMModuleRef checkmaterialized(lua_State* L, int i) {
+    LLVMModuleRef module = getmodule(L, i);
+    char* err;
+    if (lazy_materialize_all(module, &err)) {
+        lua_pushfstring(L, "[LLVM] %s", err);
+        LLVMDisposeMessage(err);
+        lua_error(L);
+    }
+    return module;
+}
+
+// ==================================================
+//
+// returns the bitcode of a module as a string, or streams it to the
+// file handle given, through its file descriptor
+//
+// ==================================================
+int module_to_bitcode(lua_State* L) {
+    LLVMModuleRef module = checkmaterialized(L, 1);
+    FILE* f = optfile(L, 2);
+    if (f != NULL) {
+        int ok = fflush(f) == 0 && stream_bitcode(module, fileno(f)) == 0;
+        return pushfile(L, 2, ok);
+    }
+    LLVMMemoryBufferRef buffer = LLVMWriteBitcodeToMemoryBuffer(module);
+    int n = pushoutput(
+        L, 2, NULL, LLVMGetBufferStart(buffer), LLVMGetBufferSize(buffer));
+    LLVMDisposeMemoryBuffer(buffer);
+    return n;
+}
+
+// ==================================================
+//
+// returns the textual IR of a module as a string, or streams it to the
+// file handle given, through its file descriptor
+//
+// ==================================================
+int module_to_ir(lua_State* L) {
+    LLVMModuleRef module = checkmaterialized(L, 1);
+    FILE* f = optfile(L, 2);
+    if (f != NULL) {
+        int ok = fflush(f) == 0 && stream_module_ir(module, fileno(f)) == 0;
+        return pushfile(L, 2, ok);
+    }
+    char* ir = LLVMPrintModuleToString(module);
+    int n = pushoutput(L, 2, NULL, ir, strlen(ir));
+    LLVMDisposeMessage(ir);
+    return n;
+}
+
 // ==================================================
 //
 // __tostring metamethod
@@ -21,11 +21,18 @@
 #ifndef _LLB_MODULE_H
 #define _LLB_MODULE_H
 
-extern int module_new(lua_State*, LLVMModuleRef);
+extern int module_new(lua_State*, LLVMModuleRef, int);
+extern void module_keep(lua_State*, int);
 extern int module_dispose(lua_State*);
+extern int module_context(lua_State*);
 extern int module_pairs(lua_State*);
+extern int module_functions(lua_State*);
 extern int module_index(lua_State*);
+extern int module_get_function(lua_State*);
+extern int module_add_function(lua_State*);
 extern int module_get_builder(lua_State*);
+extern int module_to_bitcode(lua_State*);
+extern int module_to_ir(lua_State*);
 extern int module_tostring(lua_State*);
 
 #endif
@@ -0,0 +1,63 @@
+/*
+ * Lua binding for LLVM C API.
+ * Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+ *
+ * This file is part of llb.
+ *
+ * llb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * llb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with llb. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// the C API can create LLJITs but not LLLazyJITs
+
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/Support/Error.h>
+
+#include "orc.h"
+
+using namespace llvm;
+using namespace llvm::orc;
+
+// the C API wrappers are plain casts, but their helpers are private
+#define unwrapjit(j) (reinterpret_cast<LLJIT*>(j))
+#define unwraptmb(b) (reinterpret_cast<JITTargetMachineBuilder*>(b))
+#define unwraptsm(m) (reinterpret_cast<ThreadSafeModule*>(m))
+
+static int seterror(Error e, char** err) {
+    if (!e) {
+        return 0;
+    }
+    *err = LLVMCreateMessage(toString(std::move(e)).c_str());
+    return 1;
+}
+
+int orc_createlazy(LLVMOrcLLJITRef* result,
+    LLVMOrcJITTargetMachineBuilderRef builder, char** err) {
+    std::unique_ptr<JITTargetMachineBuilder> tmb(unwraptmb(builder));
+    auto jit = LLLazyJITBuilder()
+                   .setJITTargetMachineBuilder(std::move(*tmb))
+                   .create();
+    if (!jit) {
+        return seterror(jit.takeError(), err);
+    }
+    *result = reinterpret_cast<LLVMOrcLLJITRef>(
+        static_cast<LLJIT*>(jit->release()));
+    return 0;
+}
+
+int orc_addlazy(LLVMOrcLLJITRef jit, LLVMOrcThreadSafeModuleRef module,
+    char** err) {
+    std::unique_ptr<ThreadSafeModule> tsm(unwraptsm(module));
+    auto* lazy = static_cast<LLLazyJIT*>(unwrapjit(jit));
+    return seterror(lazy->addLazyIRModule(std::move(*tsm)), err);
+}
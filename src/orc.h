@@ -0,0 +1,49 @@
+/*
+ * Lua binding for LLVM C API.
+ * Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+ *
+ * This file is part of llb.
+ *
+ * llb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * llb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with llb. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LLB_ORC_H
+#define _LLB_ORC_H
+
+#include <llvm-c/Core.h>
+#include <llvm-c/LLJIT.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ==================================================
+//
+// the C API has no LLLazyJIT, these create one and add modules to it.
+// the LLLazyJIT is returned as a LLJIT, that must be disposed with
+// LLVMOrcDisposeLLJIT. both take ownership of their second argument.
+// return 0 on success, otherwise err is set and must be disposed with
+// LLVMDisposeMessage.
+//
+// ==================================================
+extern int orc_createlazy(LLVMOrcLLJITRef*, LLVMOrcJITTargetMachineBuilderRef,
+    char** err);
+extern int orc_addlazy(LLVMOrcLLJITRef, LLVMOrcThreadSafeModuleRef,
+    char** err);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,189 @@
+/*
+ * Lua binding for LLVM C API.
+ * Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+ *
+ * This file is part of llb.
+ *
+ * llb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * llb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with llb. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <lauxlib.h>
+#include <lua.h>
+
+#include <llvm-c/Core.h>
+#include <llvm-c/Error.h>
+#include <llvm-c/Transforms/PassBuilder.h>
+
+#include "core.h"
+#include "function.h"
+#include "lazy.h"
+#include "passes.h"
+#include "pipeline.h"
+
+// ==================================================
+//
+// keys of the options table, in the order of pipeline.h
+//
+// ==================================================
+static const char* const optionnames[PIPELINE_NOPTIONS] = {
+    "verify_each",
+    "debug_logging",
+    "loop_interleaving",
+    "loop_vectorization",
+    "slp_vectorization",
+    "loop_unrolling",
+    "forget_all_scev_in_loop_unroll",
+    "licm_mssa_opt_cap",
+    "licm_mssa_no_acc_for_promotion_cap",
+    "call_graph_profile",
+    "merge_functions",
+};
+
+static void checkoptions(lua_State* L, int i, struct pipelineoptions* opts) {
+    for (int k = 0; k < PIPELINE_NOPTIONS; k++) {
+        opts->options[k] = -1;
+    }
+    if (lua_isnoneornil(L, i)) {
+        return;
+    }
+
+    luaL_checktype(L, i, LUA_TTABLE);
+    for (int k = 0; k < PIPELINE_NOPTIONS; k++) {
+        switch (lua_getfield(L, i, optionnames[k])) {
+            case LUA_TNIL:
+                break;
+            case LUA_TBOOLEAN:
+                opts->options[k] = lua_toboolean(L, -1);
+                break;
+            case LUA_TNUMBER:
+                if (lua_isinteger(L, -1) && lua_tointeger(L, -1) >= 0) {
+                    opts->options[k] = lua_tointeger(L, -1);
+                    break;
+                }
+            // fall through
+            default:
+                luaL_error(L, "bad option '%s'", optionnames[k]);
+        }
+        lua_pop(L, 1);
+    }
+}
+
+static void throwerror(lua_State* L, LLVMErrorRef e) {
+    char* err = LLVMGetErrorMessage(e);
+    lua_pushfstring(L, "[LLVM] %s", err);
+    LLVMDisposeErrorMessage(err);
+    lua_error(L);
+}
+
+// ==================================================
+//
+// runs a pass pipeline on a module, through LLVMRunPasses.
+// receives the pipeline, in opt's -passes format (e.g. "mem2reg,gvn" or
+// "default<O2>"), and an optional table of pass builder options:
+// verify_each, debug_logging, loop_interleaving, loop_vectorization,
+// slp_vectorization, loop_unrolling, forget_all_scev_in_loop_unroll,
+// licm_mssa_opt_cap, licm_mssa_no_acc_for_promotion_cap,
+// call_graph_profile and merge_functions.
+// objects of the values erased by the passes must not be used.
+//
+// ==================================================
+int passes_module(lua_State* L) {
+    LLVMModuleRef module = getmodule(L, 1);
+    const char* passes = luaL_checkstring(L, 2);
+    struct pipelineoptions opts;
+    checkoptions(L, 3, &opts);
+
+    char* err;
+    if (lazy_materialize_all(module, &err)) {
+        lua_pushfstring(L, "[LLVM] %s", err);
+        LLVMDisposeMessage(err);
+        return lua_error(L);
+    }
+    pushinterned(L, module);
+
+    const long long* o = opts.options;
+    LLVMPassBuilderOptionsRef options = LLVMCreatePassBuilderOptions();
+    // clang-format off
+    if (o[PIPELINE_VERIFYEACH] >= 0)
+        LLVMPassBuilderOptionsSetVerifyEach(options,
+            o[PIPELINE_VERIFYEACH]);
+    if (o[PIPELINE_DEBUGLOGGING] >= 0)
+        LLVMPassBuilderOptionsSetDebugLogging(options,
+            o[PIPELINE_DEBUGLOGGING]);
+    if (o[PIPELINE_LOOPINTERLEAVING] >= 0)
+        LLVMPassBuilderOptionsSetLoopInterleaving(options,
+            o[PIPELINE_LOOPINTERLEAVING]);
+    if (o[PIPELINE_LOOPVECTORIZATION] >= 0)
+        LLVMPassBuilderOptionsSetLoopVectorization(options,
+            o[PIPELINE_LOOPVECTORIZATION]);
+    if (o[PIPELINE_SLPVECTORIZATION] >= 0)
+        LLVMPassBuilderOptionsSetSLPVectorization(options,
+            o[PIPELINE_SLPVECTORIZATION]);
+    if (o[PIPELINE_LOOPUNROLLING] >= 0)
+        LLVMPassBuilderOptionsSetLoopUnrolling(options,
+            o[PIPELINE_LOOPUNROLLING]);
+    if (o[PIPELINE_FORGETALLSCEV] >= 0)
+        LLVMPassBuilderOptionsSetForgetAllSCEVInLoopUnroll(options,
+            o[PIPELINE_FORGETALLSCEV]);
+    if (o[PIPELINE_LICMMSSAOPTCAP] >= 0)
+        LLVMPassBuilderOptionsSetLicmMssaOptCap(options,
+            o[PIPELINE_LICMMSSAOPTCAP]);
+    if (o[PIPELINE_LICMMSSANOACCCAP] >= 0)
+        LLVMPassBuilderOptionsSetLicmMssaNoAccForPromotionCap(options,
+            o[PIPELINE_LICMMSSANOACCCAP]);
+    if (o[PIPELINE_CALLGRAPHPROFILE] >= 0)
+        LLVMPassBuilderOptionsSetCallGraphProfile(options,
+            o[PIPELINE_CALLGRAPHPROFILE]);
+    if (o[PIPELINE_MERGEFUNCTIONS] >= 0)
+        LLVMPassBuilderOptionsSetMergeFunctions(options,
+            o[PIPELINE_MERGEFUNCTIONS]);
+    // clang-format on
+
+    LLVMErrorRef e = LLVMRunPasses(module, passes, NULL, options);
+    LLVMDisposePassBuilderOptions(options);
+    // the passes may have deleted or changed any function, even on errors
+    forgetdeleted(L, module, -1);
+    for (LLVMValueRef f = LLVMGetFirstFunction(module); f != NULL;
+         f = LLVMGetNextFunction(f)) {
+        touchfunction(L, f, 1);
+    }
+    if (e != NULL) {
+        throwerror(L, e);
+    }
+    return 0;
+}
+
+// ==================================================
+//
+// runs a function pass pipeline on a single function.
+// receives the same arguments as passes_module, the pipeline must only
+// have function passes (e.g. "mem2reg,instcombine").
+//
+// ==================================================
+int passes_function(lua_State* L) {
+    LLVMValueRef f = function_checkbody(L, 1);
+    const char* passes = luaL_checkstring(L, 2);
+    struct pipelineoptions opts;
+    checkoptions(L, 3, &opts);
+
+    char* err;
+    touchfunction(L, f, 1);
+    if (LLVMCountBasicBlocks(f) > 0 &&
+        pipeline_runfunction(f, passes, &opts, &err)) {
+        lua_pushfstring(L, "[LLVM] %s", err);
+        LLVMDisposeMessage(err);
+        return lua_error(L);
+    }
+    return 0;
+}
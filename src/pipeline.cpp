@@ -0,0 +1,82 @@
+/*
+ * Lua binding for LLVM C API.
+ * Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+ *
+ * This file is part of llb.
+ *
+ * llb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * llb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with llb. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// the C API runs pass pipelines only on whole modules
+
+#include <llvm/IR/Function.h>
+#include <llvm/IR/PassManager.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Passes/StandardInstrumentations.h>
+#include <llvm/Support/Error.h>
+
+#include "pipeline.h"
+
+using namespace llvm;
+
+int pipeline_runfunction(LLVMValueRef f, const char* passes,
+    const struct pipelineoptions* opts, char** err) {
+    Function* F = unwrap<Function>(f);
+    const long long* o = opts->options;
+
+    PipelineTuningOptions PTO;
+    if (o[PIPELINE_LOOPINTERLEAVING] >= 0)
+        PTO.LoopInterleaving = o[PIPELINE_LOOPINTERLEAVING];
+    if (o[PIPELINE_LOOPVECTORIZATION] >= 0)
+        PTO.LoopVectorization = o[PIPELINE_LOOPVECTORIZATION];
+    if (o[PIPELINE_SLPVECTORIZATION] >= 0)
+        PTO.SLPVectorization = o[PIPELINE_SLPVECTORIZATION];
+    if (o[PIPELINE_LOOPUNROLLING] >= 0)
+        PTO.LoopUnrolling = o[PIPELINE_LOOPUNROLLING];
+    if (o[PIPELINE_FORGETALLSCEV] >= 0)
+        PTO.ForgetAllSCEVInLoopUnroll = o[PIPELINE_FORGETALLSCEV];
+    if (o[PIPELINE_LICMMSSAOPTCAP] >= 0)
+        PTO.LicmMssaOptCap = o[PIPELINE_LICMMSSAOPTCAP];
+    if (o[PIPELINE_LICMMSSANOACCCAP] >= 0)
+        PTO.LicmMssaNoAccForPromotionCap = o[PIPELINE_LICMMSSANOACCCAP];
+    if (o[PIPELINE_CALLGRAPHPROFILE] >= 0)
+        PTO.CallGraphProfile = o[PIPELINE_CALLGRAPHPROFILE];
+    if (o[PIPELINE_MERGEFUNCTIONS] >= 0)
+        PTO.MergeFunctions = o[PIPELINE_MERGEFUNCTIONS];
+
+    // same setup as LLVMRunPasses
+    bool verify = o[PIPELINE_VERIFYEACH] > 0;
+    PassInstrumentationCallbacks PIC;
+    StandardInstrumentations SI(o[PIPELINE_DEBUGLOGGING] > 0, verify);
+    PassBuilder PB(nullptr, PTO, None, &PIC);
+
+    LoopAnalysisManager LAM;
+    FunctionAnalysisManager FAM;
+    CGSCCAnalysisManager CGAM;
+    ModuleAnalysisManager MAM;
+    PB.registerLoopAnalyses(LAM);
+    PB.registerFunctionAnalyses(FAM);
+    PB.registerCGSCCAnalyses(CGAM);
+    PB.registerModuleAnalyses(MAM);
+    PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+    SI.registerCallbacks(PIC, &FAM);
+
+    FunctionPassManager FPM;
+    if (Error e = PB.parsePassPipeline(FPM, passes)) {
+        *err = LLVMCreateMessage(toString(std::move(e)).c_str());
+        return 1;
+    }
+    FPM.run(*F, FAM);
+    return 0;
+}
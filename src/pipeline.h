@@ -0,0 +1,70 @@
+/*
+ * Lua binding for LLVM C API.
+ * Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+ *
+ * This file is part of llb.
+ *
+ * llb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * llb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with llb. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LLB_PIPELINE_H
+#define _LLB_PIPELINE_H
+
+#include <llvm-c/Core.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ==================================================
+//
+// pass builder options, as in llvm-c/Transforms/PassBuilder.h.
+// negative fields keep the LLVM defaults.
+//
+// ==================================================
+enum {
+    PIPELINE_VERIFYEACH,
+    PIPELINE_DEBUGLOGGING,
+    PIPELINE_LOOPINTERLEAVING,
+    PIPELINE_LOOPVECTORIZATION,
+    PIPELINE_SLPVECTORIZATION,
+    PIPELINE_LOOPUNROLLING,
+    PIPELINE_FORGETALLSCEV,
+    PIPELINE_LICMMSSAOPTCAP,
+    PIPELINE_LICMMSSANOACCCAP,
+    PIPELINE_CALLGRAPHPROFILE,
+    PIPELINE_MERGEFUNCTIONS,
+    PIPELINE_NOPTIONS
+};
+
+struct pipelineoptions {
+    long long options[PIPELINE_NOPTIONS];
+};
+
+// ==================================================
+//
+// runs a function pass pipeline, in opt's -passes format, on a single
+// function. the C API only runs pipelines on whole modules.
+// return 0 on success, otherwise err is set and must be disposed with
+// LLVMDisposeMessage.
+//
+// ==================================================
+extern int pipeline_runfunction(LLVMValueRef, const char* passes,
+    const struct pipelineoptions*, char** err);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
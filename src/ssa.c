@@ -0,0 +1,553 @@
+/*
+ * Lua binding for LLVM C API.
+ * Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+ *
+ * This file is part of llb.
+ *
+ * llb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * llb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with llb. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdlib.h>
+
+#include <llvm-c/Core.h>
+
+#include "cfg.h"
+#include "dom.h"
+#include "ssa.h"
+#include "stats.h"
+
+// ==================================================
+//
+// native counterpart of function.lua's prunedssa.
+// promotes the function's allocas to SSA registers in one walk:
+// phis are placed on the iterated dominance frontier of the stores,
+// loads are renamed with value stacks over the dominator tree.
+// phis are created in the same order as the Lua version (block order,
+// then alloca order) so both produce the same IR.
+//
+// ==================================================
+
+struct ssa {
+    struct cfg g;
+    unsigned* idom;
+    unsigned* dfoff;
+    unsigned* df;
+    // promotable allocas in program order
+    unsigned nallocas;
+    LLVMValueRef* allocas;
+    struct allocakey* keys;
+    // phis of block b: phi[phioff[b] .. phioff[b + 1] - 1], with
+    // phialloca[k] being the alloca of phi[k]
+    unsigned* phioff;
+    unsigned* phialloca;
+    LLVMValueRef* phi;
+    // incoming values of phi k, one per predecessor of its block:
+    // incoming[inoff[k] .. inoff[k] + npreds - 1], NULL for undef
+    unsigned* inoff;
+    LLVMValueRef* incoming;
+    // reaching definition of each alloca, NULL for undef, and the log
+    // of the definitions it replaced, to undo them when leaving a block
+    LLVMValueRef* current;
+    unsigned nlog, logcap;
+    unsigned* logalloca;
+    LLVMValueRef* logvalue;
+};
+
+struct allocakey {
+    LLVMValueRef alloca;
+    unsigned i;
+};
+
+static int keycmp(const void* a, const void* b) {
+    LLVMValueRef x = ((const struct allocakey*)a)->alloca;
+    LLVMValueRef y = ((const struct allocakey*)b)->alloca;
+    return x < y ? -1 : x > y;
+}
+
+// ==================================================
+//
+// returns the index of a promotable alloca, or CFG_UNDEF
+//
+// ==================================================
+static unsigned allocaindex(const struct ssa* s, LLVMValueRef v) {
+    if (v == NULL || !LLVMIsAAllocaInst(v)) {
+        return CFG_UNDEF;
+    }
+    struct allocakey key = {v, 0};
+    struct allocakey* found = bsearch(
+        &key, s->keys, s->nallocas, sizeof(struct allocakey), keycmp);
+    return found == NULL ? CFG_UNDEF : found->i;
+}
+
+// ==================================================
+//
+// an alloca is promotable if it's only loaded from and stored to
+//
+// ==================================================
+int ssa_ispromotable(LLVMValueRef alloca) {
+    for (LLVMUseRef use = LLVMGetFirstUse(alloca); use != NULL;
+         use = LLVMGetNextUse(use)) {
+        LLVMValueRef user = LLVMGetUser(use);
+        if (LLVMIsALoadInst(user)) {
+            continue;
+        }
+        if (LLVMIsAStoreInst(user) && LLVMGetOperand(user, 0) != alloca) {
+            continue;
+        }
+        return 0;
+    }
+    return 1;
+}
+
+static void ssa_free(struct ssa* s) {
+    cfg_free(&s->g);
+    free(s->idom);
+    free(s->dfoff);
+    free(s->df);
+    free(s->allocas);
+    free(s->keys);
+    free(s->phioff);
+    free(s->phialloca);
+    free(s->phi);
+    free(s->inoff);
+    free(s->incoming);
+    free(s->current);
+    free(s->logalloca);
+    free(s->logvalue);
+}
+
+// ==================================================
+//
+// collects the promotable allocas of the function
+//
+// ==================================================
+static int findallocas(struct ssa* s) {
+    unsigned n = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        for (unsigned b = 0; b < s->g.n; b++) {
+            for (LLVMValueRef inst = LLVMGetFirstInstruction(s->g.blocks[b]);
+                 inst != NULL; inst = LLVMGetNextInstruction(inst)) {
+                if (LLVMIsAAllocaInst(inst) && ssa_ispromotable(inst)) {
+                    if (pass == 1) {
+                        s->allocas[s->nallocas] = inst;
+                        s->keys[s->nallocas] =
+                            (struct allocakey){inst, s->nallocas};
+                        s->nallocas++;
+                    } else {
+                        n++;
+                    }
+                }
+            }
+        }
+        if (pass == 0) {
+            s->allocas = malloc((n + 1) * sizeof(LLVMValueRef));
+            s->keys = malloc((n + 1) * sizeof(struct allocakey));
+            if (s->allocas == NULL || s->keys == NULL) {
+                return -1;
+            }
+        }
+    }
+    qsort(s->keys, s->nallocas, sizeof(struct allocakey), keycmp);
+    return 0;
+}
+
+// ==================================================
+//
+// places the phis of every alloca on the iterated dominance frontier
+// of the blocks that store to it (Cytron et al.), with one worklist
+// per alloca and per alloca stamps so no marks are ever cleared
+//
+// ==================================================
+static int placephis(struct ssa* s, LLVMBuilderRef builder) {
+    unsigned n = s->g.n, na = s->nallocas;
+    // (block, alloca) pairs of the phis, in alloca order
+    unsigned* hasphi = malloc((n + 1) * sizeof(unsigned));
+    unsigned* queued = malloc((n + 1) * sizeof(unsigned));
+    unsigned* work = malloc((n + 1) * sizeof(unsigned));
+    unsigned cap = 16, nphis = 0;
+    unsigned* pairs = malloc(cap * 2 * sizeof(unsigned));
+    s->phioff = calloc(n + 1, sizeof(unsigned));
+    if (!hasphi || !queued || !work || !pairs || !s->phioff) {
+        goto fail;
+    }
+    for (unsigned b = 0; b < n; b++) {
+        hasphi[b] = queued[b] = CFG_UNDEF;
+    }
+
+    for (unsigned a = 0; a < na; a++) {
+        unsigned top = 0;
+        // the entry block implicitly assigns every alloca
+        if (n > 0) {
+            queued[0] = a;
+            work[top++] = 0;
+        }
+        LLVMValueRef alloca = s->allocas[a];
+        for (LLVMUseRef use = LLVMGetFirstUse(alloca); use != NULL;
+             use = LLVMGetNextUse(use)) {
+            LLVMValueRef user = LLVMGetUser(use);
+            if (!LLVMIsAStoreInst(user)) {
+                continue;
+            }
+            unsigned b = cfg_index(&s->g, LLVMGetInstructionParent(user));
+            if (b != CFG_UNDEF && queued[b] != a) {
+                queued[b] = a;
+                work[top++] = b;
+            }
+        }
+        while (top > 0) {
+            unsigned x = work[--top];
+            for (unsigned k = s->dfoff[x]; k < s->dfoff[x + 1]; k++) {
+                unsigned y = s->df[k];
+                if (hasphi[y] == a) {
+                    continue;
+                }
+                hasphi[y] = a;
+                if (nphis == cap) {
+                    cap *= 2;
+                    unsigned* p = realloc(pairs, cap * 2 * sizeof(unsigned));
+                    if (p == NULL) {
+                        goto fail;
+                    }
+                    pairs = p;
+                }
+                pairs[2 * nphis] = y;
+                pairs[2 * nphis + 1] = a;
+                nphis++;
+                s->phioff[y + 1]++;
+                if (queued[y] != a) {
+                    queued[y] = a;
+                    work[top++] = y;
+                }
+            }
+        }
+    }
+
+    // groups the phis by block, keeping the alloca order within a block
+    for (unsigned b = 0; b < n; b++) {
+        s->phioff[b + 1] += s->phioff[b];
+    }
+    s->phialloca = malloc((nphis + 1) * sizeof(unsigned));
+    s->phi = malloc((nphis + 1) * sizeof(LLVMValueRef));
+    if (s->phialloca == NULL || s->phi == NULL) {
+        goto fail;
+    }
+    for (unsigned b = 0; b < n; b++) {
+        hasphi[b] = s->phioff[b];
+    }
+    for (unsigned k = 0; k < nphis; k++) {
+        s->phialloca[hasphi[pairs[2 * k]]++] = pairs[2 * k + 1];
+    }
+
+    // creates the phis in block order, then alloca order
+    for (unsigned b = 0; b < n; b++) {
+        for (unsigned k = s->phioff[b]; k < s->phioff[b + 1]; k++) {
+            LLVMValueRef alloca = s->allocas[s->phialloca[k]];
+            LLVMPositionBuilderBefore(
+                builder, LLVMGetFirstInstruction(s->g.blocks[b]));
+            s->phi[k] =
+                LLVMBuildPhi(builder, LLVMGetAllocatedType(alloca), "phi");
+        }
+    }
+
+    free(hasphi);
+    free(queued);
+    free(work);
+    free(pairs);
+    return 0;
+
+fail:
+    free(hasphi);
+    free(queued);
+    free(work);
+    free(pairs);
+    return -1;
+}
+
+// ==================================================
+//
+// makes v the reaching definition of alloca a, logging the previous one
+//
+// ==================================================
+static int define(struct ssa* s, unsigned a, LLVMValueRef v) {
+    if (s->nlog == s->logcap) {
+        unsigned cap = s->logcap ? s->logcap * 2 : 64;
+        unsigned* la = realloc(s->logalloca, cap * sizeof(unsigned));
+        if (la == NULL) {
+            return -1;
+        }
+        s->logalloca = la;
+        LLVMValueRef* lv = realloc(s->logvalue, cap * sizeof(LLVMValueRef));
+        if (lv == NULL) {
+            return -1;
+        }
+        s->logvalue = lv;
+        s->logcap = cap;
+    }
+    s->logalloca[s->nlog] = a;
+    s->logvalue[s->nlog] = s->current[a];
+    s->nlog++;
+    s->current[a] = v;
+    return 0;
+}
+
+// ==================================================
+//
+// replaces the loads of a block with the reaching definitions,
+// removes its stores and fills in the incoming values of the
+// phis of its successors
+//
+// ==================================================
+static int renameblock(struct ssa* s, unsigned b) {
+    for (unsigned k = s->phioff[b]; k < s->phioff[b + 1]; k++) {
+        if (define(s, s->phialloca[k], s->phi[k])) {
+            return -1;
+        }
+    }
+
+    LLVMValueRef inst = LLVMGetFirstInstruction(s->g.blocks[b]);
+    while (inst != NULL) {
+        LLVMValueRef next = LLVMGetNextInstruction(inst);
+        if (LLVMIsALoadInst(inst)) {
+            unsigned a = allocaindex(s, LLVMGetOperand(inst, 0));
+            if (a != CFG_UNDEF) {
+                LLVMValueRef v = s->current[a];
+                LLVMReplaceAllUsesWith(
+                    inst, v ? v : LLVMGetUndef(LLVMTypeOf(inst)));
+                LLVMInstructionEraseFromParent(inst);
+            }
+        } else if (LLVMIsAStoreInst(inst)) {
+            unsigned a = allocaindex(s, LLVMGetOperand(inst, 1));
+            if (a != CFG_UNDEF) {
+                if (define(s, a, LLVMGetOperand(inst, 0))) {
+                    return -1;
+                }
+                LLVMInstructionEraseFromParent(inst);
+            }
+        }
+        inst = next;
+    }
+
+    for (unsigned e = s->g.succoff[b]; e < s->g.succoff[b + 1]; e++) {
+        unsigned succ = s->g.succ[e];
+        unsigned j = 0;
+        while (s->g.pred[s->g.predoff[succ] + j] != b) {
+            j++;
+        }
+        for (unsigned k = s->phioff[succ]; k < s->phioff[succ + 1]; k++) {
+            s->incoming[s->inoff[k] + j] = s->current[s->phialloca[k]];
+        }
+    }
+    return 0;
+}
+
+// ==================================================
+//
+// walks the dominator tree from the entry, renaming each block
+// with the definitions that reach it
+//
+// ==================================================
+static int rename(struct ssa* s) {
+    unsigned n = s->g.n;
+    unsigned* childoff = calloc(n + 2, sizeof(unsigned));
+    unsigned* child = malloc((n + 1) * sizeof(unsigned));
+    unsigned* stack = malloc((n + 1) * sizeof(unsigned));
+    unsigned* cursor = malloc((n + 1) * sizeof(unsigned));
+    unsigned* mark = malloc((n + 1) * sizeof(unsigned));
+    if (!childoff || !child || !stack || !cursor || !mark) {
+        goto fail;
+    }
+
+    // dominator tree children as CSR, childoff[b + 1] used as cursor
+    for (unsigned b = 0; b < n; b++) {
+        if (s->idom[b] != CFG_UNDEF) {
+            childoff[s->idom[b] + 2]++;
+        }
+    }
+    for (unsigned b = 0; b < n; b++) {
+        childoff[b + 2] += childoff[b + 1];
+    }
+    for (unsigned b = 0; b < n; b++) {
+        if (s->idom[b] != CFG_UNDEF) {
+            child[childoff[s->idom[b] + 1]++] = b;
+        }
+    }
+
+    unsigned top = 0;
+    if (n > 0) {
+        stack[top++] = 0;
+        cursor[0] = childoff[0];
+        mark[0] = s->nlog;
+        if (renameblock(s, 0)) {
+            goto fail;
+        }
+    }
+    while (top > 0) {
+        unsigned b = stack[top - 1];
+        if (cursor[b] < childoff[b + 1]) {
+            unsigned c = child[cursor[b]++];
+            stack[top++] = c;
+            cursor[c] = childoff[c];
+            mark[c] = s->nlog;
+            if (renameblock(s, c)) {
+                goto fail;
+            }
+        } else {
+            // restores the definitions that reached the block
+            while (s->nlog > mark[b]) {
+                s->nlog--;
+                s->current[s->logalloca[s->nlog]] = s->logvalue[s->nlog];
+            }
+            top--;
+        }
+    }
+
+    free(childoff);
+    free(child);
+    free(stack);
+    free(cursor);
+    free(mark);
+    return 0;
+
+fail:
+    free(childoff);
+    free(child);
+    free(stack);
+    free(cursor);
+    free(mark);
+    return -1;
+}
+
+// ==================================================
+//
+// removes the loads and stores left in blocks unreachable from the
+// entry, they aren't visited by rename
+//
+// ==================================================
+static void cleanunreachable(struct ssa* s) {
+    for (unsigned b = 0; b < s->g.n; b++) {
+        if (s->g.order[b] != CFG_UNDEF) {
+            continue;
+        }
+        LLVMValueRef inst = LLVMGetFirstInstruction(s->g.blocks[b]);
+        while (inst != NULL) {
+            LLVMValueRef next = LLVMGetNextInstruction(inst);
+            if (LLVMIsALoadInst(inst) &&
+                allocaindex(s, LLVMGetOperand(inst, 0)) != CFG_UNDEF) {
+                LLVMReplaceAllUsesWith(inst, LLVMGetUndef(LLVMTypeOf(inst)));
+                LLVMInstructionEraseFromParent(inst);
+            } else if (LLVMIsAStoreInst(inst) &&
+                       allocaindex(s, LLVMGetOperand(inst, 1)) != CFG_UNDEF) {
+                LLVMInstructionEraseFromParent(inst);
+            }
+            inst = next;
+        }
+    }
+}
+
+// ==================================================
+//
+// returns the number of edges from pred to bb, the cfg keeps only one
+//
+// ==================================================
+static unsigned countedges(LLVMBasicBlockRef pred, LLVMBasicBlockRef bb) {
+    LLVMValueRef terminator = LLVMGetBasicBlockTerminator(pred);
+    unsigned n = LLVMGetNumSuccessors(terminator), count = 0;
+    for (unsigned i = 0; i < n; i++) {
+        count += LLVMGetSuccessor(terminator, i) == bb;
+    }
+    return count;
+}
+
+// ==================================================
+//
+// transforms a function to its pruned SSA form.
+// returns 0 on success, -1 if out of memory.
+//
+// ==================================================
+int ssa_prunedssa(LLVMValueRef f, LLVMBuilderRef builder) {
+    struct ssa s = {0};
+    if (cfg_fromfunction(&s.g, f)) {
+        return -1;
+    }
+
+    unsigned n = s.g.n;
+    s.idom = malloc((n + 1) * sizeof(unsigned));
+    s.dfoff = malloc((n + 1) * sizeof(unsigned));
+    if (!s.idom || !s.dfoff || dom_idom(&s.g, s.idom) ||
+        dom_df(&s.g, s.idom, s.dfoff, &s.df) || findallocas(&s)) {
+        goto fail;
+    }
+    if (s.nallocas == 0) {
+        ssa_free(&s);
+        return 0;
+    }
+    STATS_START(place);
+    if (placephis(&s, builder)) {
+        goto fail;
+    }
+    STATS_STOP(STATS_SSAPLACE, place);
+
+    unsigned nphis = s.phioff[n], nincoming = 0;
+    s.inoff = malloc((nphis + 1) * sizeof(unsigned));
+    s.current = calloc(s.nallocas, sizeof(LLVMValueRef));
+    if (s.inoff == NULL || s.current == NULL) {
+        goto fail;
+    }
+    for (unsigned b = 0; b < n; b++) {
+        for (unsigned k = s.phioff[b]; k < s.phioff[b + 1]; k++) {
+            s.inoff[k] = nincoming;
+            nincoming += s.g.predoff[b + 1] - s.g.predoff[b];
+        }
+    }
+    STATS_START(renaming);
+    s.incoming = calloc(nincoming + 1, sizeof(LLVMValueRef));
+    if (s.incoming == NULL || rename(&s)) {
+        goto fail;
+    }
+    cleanunreachable(&s);
+
+    // adds the (value, predecessor) tuples in predecessor order,
+    // once per edge, as a switch may branch twice to the same block
+    for (unsigned b = 0; b < n; b++) {
+        unsigned npreds = s.g.predoff[b + 1] - s.g.predoff[b];
+        const unsigned* preds = &s.g.pred[s.g.predoff[b]];
+        for (unsigned k = s.phioff[b]; k < s.phioff[b + 1]; k++) {
+            LLVMValueRef* values = &s.incoming[s.inoff[k]];
+            LLVMTypeRef type = LLVMTypeOf(s.phi[k]);
+            for (unsigned j = 0; j < npreds; j++) {
+                LLVMBasicBlockRef pred = s.g.blocks[preds[j]];
+                if (values[j] == NULL) {
+                    values[j] = LLVMGetUndef(type);
+                }
+                unsigned nedges = countedges(pred, s.g.blocks[b]);
+                for (unsigned e = 0; e < nedges; e++) {
+                    LLVMAddIncoming(s.phi[k], &values[j], &pred, 1);
+                }
+            }
+        }
+    }
+
+    for (unsigned a = 0; a < s.nallocas; a++) {
+        LLVMInstructionEraseFromParent(s.allocas[a]);
+    }
+    STATS_STOP(STATS_SSARENAME, renaming);
+
+    ssa_free(&s);
+    return 0;
+
+fail:
+    ssa_free(&s);
+    return -1;
+}
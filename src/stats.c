@@ -0,0 +1,242 @@
+/*
+ * Lua binding for LLVM C API.
+ * Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+ *
+ * This file is part of llb.
+ *
+ * llb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * llb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with llb. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <time.h>
+
+#include <lauxlib.h>
+#include <lua.h>
+
+#include <llvm-c/Core.h>
+
+#include "core.h"
+#include "stats.h"
+
+// ==================================================
+//
+// the statistics of a lua state live in the registry table
+// LLB_STATISTICS = {timers = {name = seconds}, counters = {name = n},
+// calls = {name = counter}}. timers and counters come from the lua
+// side, calls count the calls of every class method.
+// the native timers and counters are per thread, see stats.h.
+//
+// ==================================================
+#ifdef LLB_STATS
+
+static const char* const timernames[STATS_NTIMERS] = {
+    "cfg", "idom", "df", "ssa.place", "ssa.rename", "loops",
+    "liveness", "domtree", "defuse", "graphviz"};
+
+static const char* const counternames[STATS_NCOUNTERS] = {
+    "objects.new", "objects.reused", "domtree.recomputes"};
+
+__thread struct stats llb_stats;
+
+double stats_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int countcall(lua_State* L) {
+    lua_Integer* calls = lua_touserdata(L, lua_upvalueindex(2));
+    (*calls)++;
+    return lua_tocfunction(L, lua_upvalueindex(1))(L);
+}
+
+#endif
+
+// ==================================================
+//
+// creates the statistics table of a lua state
+//
+// ==================================================
+void stats_open(lua_State* L) {
+    lua_createtable(L, 0, 3);
+    lua_newtable(L);
+    lua_setfield(L, -2, "timers");
+    lua_newtable(L);
+    lua_setfield(L, -2, "counters");
+    lua_newtable(L);
+    lua_setfield(L, -2, "calls");
+    lua_setfield(L, LUA_REGISTRYINDEX, LLB_STATISTICS);
+}
+
+// ==================================================
+//
+// sets the methods of class name on the table on the top of the stack,
+// as luaL_setfuncs. with LLB_STATS each method counts its calls.
+//
+// ==================================================
+void stats_setfuncs(lua_State* L, const char* name, const luaL_Reg* funcs) {
+#ifdef LLB_STATS
+    lua_getfield(L, LUA_REGISTRYINDEX, LLB_STATISTICS);
+    lua_getfield(L, -1, "calls");
+    for (; funcs->name != NULL; funcs++) {
+        lua_pushcfunction(L, funcs->func);
+        lua_Integer* calls = lua_newuserdata(L, sizeof(lua_Integer));
+        *calls = 0;
+        lua_pushfstring(L, "calls.%s.%s", name, funcs->name);
+        lua_pushvalue(L, -2);
+        lua_settable(L, -5);
+        lua_pushcclosure(L, countcall, 2);
+        lua_setfield(L, -4, funcs->name);
+    }
+    lua_pop(L, 2);
+#else
+    luaL_setfuncs(L, funcs, 0);
+#endif
+}
+
+// ==================================================
+//
+// copies the table field of the statistics table at index s to the
+// table on the top of the stack, and clears it on reset
+//
+// ==================================================
+static void copyfield(lua_State* L, int s, const char* field, int reset) {
+    lua_getfield(L, s, field);
+    lua_pushnil(L);
+    while (lua_next(L, -2) != 0) {
+        lua_pushvalue(L, -2);
+        lua_insert(L, -2);
+        lua_settable(L, -5);
+    }
+    lua_pop(L, 1);
+    if (reset) {
+        lua_newtable(L);
+        lua_setfield(L, s, field);
+    }
+}
+
+// ==================================================
+//
+// returns the statistics: {enabled = boolean, timers = {name = seconds},
+// counters = {name = n}}. receives an optional flag to reset them.
+//
+// ==================================================
+int stats_get(lua_State* L) {
+    int reset = lua_toboolean(L, 1);
+    lua_getfield(L, LUA_REGISTRYINDEX, LLB_STATISTICS);
+    int s = lua_gettop(L);
+
+    lua_createtable(L, 0, 3);
+#ifdef LLB_STATS
+    lua_pushboolean(L, 1);
+#else
+    lua_pushboolean(L, 0);
+#endif
+    lua_setfield(L, -2, "enabled");
+
+    lua_newtable(L);
+#ifdef LLB_STATS
+    for (int t = 0; t < STATS_NTIMERS; t++) {
+        lua_pushnumber(L, llb_stats.timers[t]);
+        lua_setfield(L, -2, timernames[t]);
+    }
+#endif
+    copyfield(L, s, "timers", reset);
+    lua_setfield(L, -2, "timers");
+
+    lua_newtable(L);
+#ifdef LLB_STATS
+    for (int c = 0; c < STATS_NCOUNTERS; c++) {
+        lua_pushinteger(L, llb_stats.counters[c]);
+        lua_setfield(L, -2, counternames[c]);
+    }
+#endif
+    copyfield(L, s, "counters", reset);
+    lua_getfield(L, s, "calls");
+    lua_pushnil(L);
+    while (lua_next(L, -2) != 0) {
+        lua_Integer* calls = lua_touserdata(L, -1);
+        if (*calls > 0) {
+            lua_pushvalue(L, -2);
+            lua_pushinteger(L, *calls);
+            lua_settable(L, -6);
+        }
+        if (reset) {
+            *calls = 0;
+        }
+        lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+    lua_setfield(L, -2, "counters");
+
+#ifdef LLB_STATS
+    if (reset) {
+        llb_stats = (struct stats){{0}};
+    }
+#endif
+    return 1;
+}
+
+#ifdef LLB_STATS
+
+// ==================================================
+//
+// the lua side of the instrumentation, see stats.lua.
+// returns a monotonic clock, in seconds.
+//
+// ==================================================
+int stats_clock(lua_State* L) {
+    lua_pushnumber(L, stats_now());
+    return 1;
+}
+
+// ==================================================
+//
+// adds seconds to the timer name
+//
+// ==================================================
+int stats_time(lua_State* L) {
+    luaL_checkstring(L, 1);
+    lua_Number seconds = luaL_checknumber(L, 2);
+    lua_getfield(L, LUA_REGISTRYINDEX, LLB_STATISTICS);
+    lua_getfield(L, -1, "timers");
+    lua_pushvalue(L, 1);
+    lua_pushvalue(L, 1);
+    lua_Number total = lua_rawget(L, -3) == LUA_TNIL ? 0 : lua_tonumber(L, -1);
+    lua_pop(L, 1);
+    lua_pushnumber(L, total + seconds);
+    lua_rawset(L, -3);
+    return 0;
+}
+
+// ==================================================
+//
+// adds n, 1 by default, to the counter name
+//
+// ==================================================
+int stats_count(lua_State* L) {
+    luaL_checkstring(L, 1);
+    lua_Integer n = luaL_optinteger(L, 2, 1);
+    lua_getfield(L, LUA_REGISTRYINDEX, LLB_STATISTICS);
+    lua_getfield(L, -1, "counters");
+    lua_pushvalue(L, 1);
+    lua_pushvalue(L, 1);
+    lua_Integer total =
+        lua_rawget(L, -3) == LUA_TNIL ? 0 : lua_tointeger(L, -1);
+    lua_pop(L, 1);
+    lua_pushinteger(L, total + n);
+    lua_rawset(L, -3);
+    return 0;
+}
+
+#endif
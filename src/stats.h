@@ -0,0 +1,85 @@
+/*
+ * Lua binding for LLVM C API.
+ * Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+ *
+ * This file is part of llb.
+ *
+ * llb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * llb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with llb. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LLB_STATS_H
+#define _LLB_STATS_H
+
+// ==================================================
+//
+// instrumentation of the native phases, reported by llb.stats.
+// compiled only with LLB_STATS, otherwise the macros expand to nothing.
+// timers and counters are per thread, so llb.batch workers do not race.
+//
+// ==================================================
+enum {
+    STATS_CFG,
+    STATS_IDOM,
+    STATS_DF,
+    STATS_SSAPLACE,
+    STATS_SSARENAME,
+    STATS_LOOPS,
+    STATS_LIVENESS,
+    STATS_DOMTREE,
+    STATS_DEFUSE,
+    STATS_GRAPHVIZ,
+    STATS_NTIMERS
+};
+
+enum {
+    STATS_OBJECTSNEW,
+    STATS_OBJECTSREUSED,
+    STATS_DOMTREERECOMPUTES,
+    STATS_NCOUNTERS
+};
+
+struct stats {
+    double timers[STATS_NTIMERS];
+    unsigned long long counters[STATS_NCOUNTERS];
+};
+
+#ifdef LLB_STATS
+
+extern __thread struct stats llb_stats;
+extern double stats_now(void);
+
+#define STATS_COUNT(c) (llb_stats.counters[c]++)
+#define STATS_START(v) double v = stats_now()
+#define STATS_STOP(t, v) (llb_stats.timers[t] += stats_now() - (v))
+
+#else
+
+#define STATS_COUNT(c) ((void)0)
+#define STATS_START(v) ((void)0)
+#define STATS_STOP(t, v) ((void)0)
+
+#endif
+
+struct lua_State;
+struct luaL_Reg;
+
+extern void stats_open(struct lua_State*);
+extern void stats_setfuncs(
+    struct lua_State*, const char*, const struct luaL_Reg*);
+extern int stats_get(struct lua_State*);
+extern int stats_clock(struct lua_State*);
+extern int stats_time(struct lua_State*);
+extern int stats_count(struct lua_State*);
+
+#endif
@@ -0,0 +1,46 @@
+--
+-- Lua binding for LLVM C API.
+-- Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+--
+-- This file is part of llb.
+--
+-- llb is free software: you can redistribute it and/or modify
+-- it under the terms of the GNU General Public License as published by
+-- the Free Software Foundation, either version 2 of the License, or
+-- (at your option) any later version.
+--
+-- llb is distributed in the hope that it will be useful,
+-- but WITHOUT ANY WARRANTY; without even the implied warranty of
+-- MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+-- GNU General Public License for more details.
+--
+-- You should have received a copy of the GNU General Public License
+-- along with llb. If not, see <http://www.gnu.org/licenses/>.
+--
+
+--
+-- Lua side of the instrumentation reported by llb.stats (see stats.c)
+-- when the bindings are compiled without LLB_STATS every function is
+-- a no-op
+--
+-- local start = stats.clock()
+-- ...
+-- stats.time("phase", start)
+--
+local core = require "core"
+
+local stats = {}
+
+if core.stats_clock ~= nil then
+    stats.clock = core.stats_clock
+    stats.count = core.stats_count
+    function stats.time(name, start)
+        core.stats_time(name, core.stats_clock() - start)
+    end
+else
+    function stats.clock() end
+    function stats.count() end
+    function stats.time() end
+end
+
+return stats
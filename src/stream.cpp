@@ -0,0 +1,66 @@
+/*
+ * Lua binding for LLVM C API.
+ * Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+ *
+ * This file is part of llb.
+ *
+ * llb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * llb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with llb. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// the C API prints the IR only to strings or named files, and its
+// bitcode writer to file descriptors aborts on write errors
+
+#include <cerrno>
+
+// the summary index of some LLVM versions trips -Wuninitialized
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#include <llvm/Bitcode/BitcodeWriter.h>
+#pragma GCC diagnostic pop
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Value.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include "stream.h"
+
+using namespace llvm;
+
+static int finish(raw_fd_ostream& os) {
+    os.flush();
+    if (!os.has_error()) {
+        return 0;
+    }
+    errno = os.error().value();
+    // a stream destroyed with an error still set aborts the process
+    os.clear_error();
+    return -1;
+}
+
+int stream_module_ir(LLVMModuleRef module, int fd) {
+    raw_fd_ostream os(fd, false);
+    unwrap(module)->print(os, nullptr);
+    return finish(os);
+}
+
+int stream_function_ir(LLVMValueRef f, int fd) {
+    raw_fd_ostream os(fd, false);
+    unwrap(f)->print(os);
+    return finish(os);
+}
+
+int stream_bitcode(LLVMModuleRef module, int fd) {
+    raw_fd_ostream os(fd, false);
+    WriteBitcodeToFile(*unwrap(module), os);
+    return finish(os);
+}
@@ -0,0 +1,22 @@
+define i32 @f(i32 %n) {
+entry:
+  %v = alloca i32
+  store i32 0, i32* %v
+  %c = icmp slt i32 %n, 1
+  br i1 %c, label %a, label %b
+a:
+  %la = load i32, i32* %v
+  %sa = add i32 %la, 1
+  store i32 %sa, i32* %v
+  %ca = icmp slt i32 %sa, %n
+  br i1 %ca, label %b, label %exit
+b:
+  %lb = load i32, i32* %v
+  %sb = add i32 %lb, 2
+  store i32 %sb, i32* %v
+  %cb = icmp slt i32 %sb, %n
+  br i1 %cb, label %a, label %exit
+exit:
+  %r = load i32, i32* %v
+  ret i32 %r
+}
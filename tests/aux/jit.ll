@@ -0,0 +1,47 @@
+declare i64 @strlen(i8*)
+
+define double @scale(double %x, i32 %k) {
+entry:
+    %kd = sitofp i32 %k to double
+    %r = fmul double %x, %kd
+    ret double %r
+}
+
+define float @half(float %x) {
+entry:
+    %r = fmul float %x, 0.5
+    ret float %r
+}
+
+define i1 @isnull(i8* %p) {
+entry:
+    %r = icmp eq i8* %p, null
+    ret i1 %r
+}
+
+define i8* @identity(i8* %p) {
+entry:
+    ret i8* %p
+}
+
+define i64 @length(i8* %s) {
+entry:
+    %r = call i64 @strlen(i8* %s)
+    ret i64 %r
+}
+
+define i8 @wrap(i8 %x) {
+entry:
+    %r = add i8 %x, 1
+    ret i8 %r
+}
+
+define void @nothing() {
+entry:
+    ret void
+}
+
+define i128 @wide(i128 %x) {
+entry:
+    ret i128 %x
+}
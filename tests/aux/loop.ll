@@ -0,0 +1,15 @@
+define i32 @f(i32 %n) {
+entry:
+  br label %head
+head:
+  %c = icmp slt i32 %n, 10
+  br i1 %c, label %body, label %exit
+body:
+  br i1 %c, label %head, label %body2
+body2:
+  br label %head
+dead:
+  br label %exit
+exit:
+  ret i32 0
+}
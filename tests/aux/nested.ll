@@ -0,0 +1,12 @@
+define void @f(i1 %c) {
+entry:
+  br label %outer
+outer:
+  br label %inner
+inner:
+  br i1 %c, label %inner, label %latch
+latch:
+  br i1 %c, label %outer, label %exit
+exit:
+  ret void
+}
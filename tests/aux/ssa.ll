@@ -0,0 +1,34 @@
+define i32 @sum(i32 %n) {
+entry:
+    %i = alloca i32
+    %s = alloca i32
+    %unused = alloca i32
+    store i32 0, i32* %i
+    store i32 0, i32* %s
+    br label %cond
+cond:
+    %load-i = load i32, i32* %i
+    %lt = icmp slt i32 %load-i, %n
+    br i1 %lt, label %body, label %exit
+body:
+    %load-s = load i32, i32* %s
+    %load-i-2 = load i32, i32* %i
+    %add = add i32 %load-s, %load-i-2
+    store i32 %add, i32* %s
+    %odd = and i32 %load-i-2, 1
+    %isodd = icmp eq i32 %odd, 1
+    br i1 %isodd, label %inc, label %double
+double:
+    %load-s-2 = load i32, i32* %s
+    %twice = mul i32 %load-s-2, 2
+    store i32 %twice, i32* %s
+    br label %inc
+inc:
+    %load-i-3 = load i32, i32* %i
+    %next = add i32 %load-i-3, 1
+    store i32 %next, i32* %i
+    br label %cond
+exit:
+    %load-s-3 = load i32, i32* %s
+    ret i32 %load-s-3
+}
@@ -0,0 +1,13 @@
+define i32 @f(i32 %x) {
+entry:
+    %v = alloca i32
+    store i32 0, i32* %v
+    switch i32 %x, label %one [i32 1, label %join
+                               i32 2, label %join]
+one:
+    store i32 1, i32* %v
+    br label %join
+join:
+    %r = load i32, i32* %v
+    ret i32 %r
+}
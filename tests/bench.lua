@@ -0,0 +1,337 @@
+--
+-- Lua binding for LLVM C API.
+-- Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+--
+-- This file is part of llb.
+--
+-- llb is free software: you can redistribute it and/or modify
+-- it under the terms of the GNU General Public License as published by
+-- the Free Software Foundation, either version 2 of the License, or
+-- (at your option) any later version.
+--
+-- llb is distributed in the hope that it will be useful,
+-- but WITHOUT ANY WARRANTY; without even the implied warranty of
+-- MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+-- GNU General Public License for more details.
+--
+-- You should have received a copy of the GNU General Public License
+-- along with llb. If not, see <http://www.gnu.org/licenses/>.
+--
+
+--
+-- benchmarks the analyses on synthetic CFGs.
+-- usage: lua -l setup bench.lua [scale]
+-- prints one JSON object per line for each shape, size and phase, with
+-- the size of the function, the CPU time, the throughput in blocks
+-- and instructions per second, the memory
+-- allocated by lua during the phase and the peak RSS of the process
+-- during the phase, null where it cannot be reset.
+--
+
+local llb = require "llb"
+
+local scale = tonumber(arg and arg[1]) or 1
+
+-----------------------------------------------------
+--
+--  shapes, each one returns the IR of a function @f(i32 %n)
+--
+-----------------------------------------------------
+
+local shapes = {}
+
+-- entry -> b1 -> ... -> bn -> exit, all updating a single variable
+function shapes.chain(n)
+    local ir = {
+        "define i32 @f(i32 %n) {",
+        "entry:",
+        "  %v = alloca i32",
+        "  store i32 0, i32* %v",
+        "  br label %b1",
+    }
+    for k = 1, n do
+        local next = k < n and "%b" .. (k + 1) or "%exit"
+        ir[#ir + 1] = string.format([[
+b%d:
+  %%l%d = load i32, i32* %%v
+  %%a%d = add i32 %%l%d, 1
+  store i32 %%a%d, i32* %%v
+  br label %s]], k, k, k, k, k, next)
+    end
+    ir[#ir + 1] = "exit:\n  %r = load i32, i32* %v\n  ret i32 %r\n}"
+    return table.concat(ir, "\n")
+end
+
+-- n loops nested, each with its own counter
+function shapes.loops(n)
+    local ir = {"define i32 @f(i32 %n) {", "entry:"}
+    for k = 1, n do
+        ir[#ir + 1] = string.format("  %%i%d = alloca i32", k)
+    end
+    ir[#ir + 1] = "  %s = alloca i32"
+    ir[#ir + 1] = "  store i32 0, i32* %s"
+    ir[#ir + 1] = "  store i32 0, i32* %i1"
+    ir[#ir + 1] = "  br label %h1"
+    for k = 1, n do
+        ir[#ir + 1] = string.format([[
+h%d:
+  %%x%d = load i32, i32* %%i%d
+  %%c%d = icmp slt i32 %%x%d, %%n
+  br i1 %%c%d, label %%b%d, label %%e%d]], k, k, k, k, k, k, k, k)
+        if k < n then
+            ir[#ir + 1] = string.format([[
+b%d:
+  store i32 0, i32* %%i%d
+  br label %%h%d]], k, k + 1, k + 1)
+        else
+            ir[#ir + 1] = string.format([[
+b%d:
+  %%t = load i32, i32* %%s
+  %%u = add i32 %%t, 1
+  store i32 %%u, i32* %%s
+  br label %%l%d]], k, k)
+        end
+        ir[#ir + 1] = string.format([[
+l%d:
+  %%y%d = load i32, i32* %%i%d
+  %%z%d = add i32 %%y%d, 1
+  store i32 %%z%d, i32* %%i%d
+  br label %%h%d]], k, k, k, k, k, k, k, k)
+        if k > 1 then
+            ir[#ir + 1] = string.format("e%d:\n  br label %%l%d", k, k - 1)
+        else
+            ir[#ir + 1] = "e1:\n  %r = load i32, i32* %s\n  ret i32 %r"
+        end
+    end
+    ir[#ir + 1] = "}"
+    return table.concat(ir, "\n")
+end
+
+-- a switch with n cases, each one storing to the same variable
+function shapes.switch(n)
+    local cases, blocks = {}, {}
+    for k = 1, n do
+        cases[k] = string.format("i32 %d, label %%c%d", k, k)
+        blocks[k] = string.format(
+            "c%d:\n  store i32 %d, i32* %%v\n  br label %%join", k, k)
+    end
+    return table.concat({
+        "define i32 @f(i32 %n) {",
+        "entry:",
+        "  %v = alloca i32",
+        "  store i32 0, i32* %v",
+        "  switch i32 %n, label %default [ " ..
+            table.concat(cases, " ") .. " ]",
+        table.concat(blocks, "\n"),
+        "default:\n  br label %join",
+        "join:\n  %r = load i32, i32* %v\n  ret i32 %r\n}",
+    }, "\n")
+end
+
+-- n irreducible regions in sequence, a and b can both be entered
+function shapes.irreducible(n)
+    local ir = {
+        "define i32 @f(i32 %n) {",
+        "entry:",
+        "  %v = alloca i32",
+        "  store i32 0, i32* %v",
+        "  br label %r1",
+    }
+    for k = 1, n do
+        local next = k < n and "%r" .. (k + 1) or "%exit"
+        ir[#ir + 1] = string.format([[
+r%d:
+  %%c%d = icmp slt i32 %%n, %d
+  br i1 %%c%d, label %%a%d, label %%b%d
+a%d:
+  %%la%d = load i32, i32* %%v
+  %%sa%d = add i32 %%la%d, 1
+  store i32 %%sa%d, i32* %%v
+  %%ca%d = icmp slt i32 %%sa%d, %%n
+  br i1 %%ca%d, label %%b%d, label %%x%d
+b%d:
+  %%lb%d = load i32, i32* %%v
+  %%sb%d = add i32 %%lb%d, 2
+  store i32 %%sb%d, i32* %%v
+  %%cb%d = icmp slt i32 %%sb%d, %%n
+  br i1 %%cb%d, label %%a%d, label %%x%d
+x%d:
+  br label %s]], k, k, k, k, k, k,
+            k, k, k, k, k, k, k, k, k, k,
+            k, k, k, k, k, k, k, k, k, k,
+            k, next)
+    end
+    ir[#ir + 1] = "exit:\n  %r = load i32, i32* %v\n  ret i32 %r\n}"
+    return table.concat(ir, "\n")
+end
+
+-- n variables assigned in both sides of a diamond
+function shapes.allocas(n)
+    local ir = {"define i32 @f(i32 %n) {", "entry:"}
+    for k = 1, n do
+        ir[#ir + 1] = string.format(
+            "  %%v%d = alloca i32\n  store i32 0, i32* %%v%d", k, k)
+    end
+    ir[#ir + 1] = "  %c = icmp slt i32 %n, 0"
+    ir[#ir + 1] = "  br i1 %c, label %left, label %right"
+    for _, side in ipairs({"left", "right"}) do
+        ir[#ir + 1] = side .. ":"
+        for k = 1, n do
+            ir[#ir + 1] = string.format(
+                "  store i32 %d, i32* %%v%d", side == "left" and k or -k, k)
+        end
+        ir[#ir + 1] = "  br label %join"
+    end
+    ir[#ir + 1] = "join:\n  %s0 = add i32 0, 0"
+    for k = 1, n do
+        ir[#ir + 1] = string.format([[
+  %%l%d = load i32, i32* %%v%d
+  %%s%d = add i32 %%s%d, %%l%d]], k, k, k, k - 1, k)
+    end
+    ir[#ir + 1] = string.format("  ret i32 %%s%d\n}", n)
+    return table.concat(ir, "\n")
+end
+
+-- shape => base size, each shape runs with size and 4 * size
+local sizes = {
+    {"chain", 250},
+    {"loops", 25},
+    {"switch", 250},
+    {"irreducible", 60},
+    {"allocas", 60},
+}
+
+-----------------------------------------------------
+--
+--  phases, each one receives a freshly parsed function
+--  and returns the function that is timed
+--
+-----------------------------------------------------
+
+local function storeblocks(g)
+    local s = g:newset()
+    for _, node in ipairs(g) do
+        for i in node.ref:each_instruction() do
+            if i:is_store() then
+                s:add(node)
+                break
+            end
+        end
+    end
+    return s
+end
+
+local phases = {
+    {"bbgraph", function(f) return function() f:bbgraph() end end},
+    {"dom", function(f)
+        local g = f:bbgraph()
+        return function() g:dom() end
+    end},
+    {"idom", function(f)
+        local g = f:bbgraph()
+        return function() g:idom() end
+    end},
+    {"df", function(f)
+        local g = f:bbgraph()
+        return function() g:df() end
+    end},
+    {"dfplus", function(f)
+        local g = f:bbgraph()
+        local s, df = storeblocks(g), g:df()
+        return function() g:dfplus(s, df) end
+    end},
+    {"prunedssa", function(f, module)
+        local builder = llb.get_builder(module)
+        return function() f:prunedssa(builder) end
+    end},
+    {"native_idom", function(f) return function() f:idom() end end},
+    {"native_df", function(f) return function() f:df() end end},
+    {"native_cfg", function(f) return function() f:cfg() end end},
+    {"native_loops", function(f) return function() f:loops() end end},
+    {"native_liveness", function(f) return function() f:liveness() end end},
+    {"native_domtree", function(f) return function() f:domtree() end end},
+    {"native_ssa_index", function(f) return function() f:ssa_index() end end},
+    {"native_to_dot", function(f)
+        local null = assert(io.open("/dev/null", "w"))
+        local options = {graph = "loops", instructions = true, color = "depth"}
+        return function() f:to_dot(null, options) end
+    end},
+    {"native_prunedssa", function(f, module)
+        local builder = llb.get_builder(module)
+        return function() f:native_prunedssa(builder) end
+    end},
+}
+
+-----------------------------------------------------
+--
+--  measurement
+--
+-----------------------------------------------------
+
+-- peak resident set size in kB, or nil where /proc is not available
+local function rsspeak()
+    local status = io.open("/proc/self/status")
+    if status == nil then return nil end
+    local kb = status:read("a"):match("VmHWM:%s*(%d+)")
+    status:close()
+    return tonumber(kb)
+end
+
+-- resets the peak resident set size to the current one, returns false
+-- where it cannot be reset
+local function rssreset()
+    local clear = io.open("/proc/self/clear_refs", "w")
+    if clear == nil then return false end
+    local ok = clear:write("5") and clear:close()
+    return ok == true
+end
+
+-- runs f with the collector stopped, so the lua memory it allocates
+-- is measured, and returns the CPU time, the kB allocated and the peak
+-- RSS during the run
+local function measure(f)
+    collectgarbage("collect")
+    collectgarbage("stop")
+    local memory = collectgarbage("count")
+    local reset = rssreset()
+    local clock = os.clock()
+    f()
+    clock = os.clock() - clock
+    local peak = reset and rsspeak() or nil
+    memory = collectgarbage("count") - memory
+    collectgarbage("restart")
+    return clock, memory, peak
+end
+
+local function report(shape, size, f, phase, seconds, kb, peak)
+    local per = function(n) return seconds > 0 and n / seconds or 0 end
+    print(string.format('{"shape": "%s", "size": %d, "blocks": %d, ' ..
+        '"instructions": %d, "phase": "%s", "seconds": %.6f, ' ..
+        '"blocks_per_second": %.1f, "instructions_per_second": %.1f, ' ..
+        '"lua_alloc_kb": %.1f, "phase_rss_peak_kb": %s}',
+        shape, size, f.blocks, f.instructions, phase, seconds,
+        per(f.blocks), per(f.instructions), kb, peak or "null"))
+end
+
+for _, entry in ipairs(sizes) do
+    local shape, base = entry[1], math.max(1, math.floor(entry[2] * scale))
+    for _, size in ipairs({base, 4 * base}) do
+        local ir = shapes[shape](size)
+        local module
+        local seconds, kb, peak =
+            measure(function() module = llb.parse_ir(ir) end)
+        local f = {blocks = 0, instructions = 0}
+        for _, bb in ipairs(module.f:basic_blocks()) do
+            f.blocks = f.blocks + 1
+            f.instructions = f.instructions + bb:instruction_count()
+        end
+        report(shape, size, f, "parse", seconds, kb, peak)
+        llb.dispose(module)
+        for _, phase in ipairs(phases) do
+            module = assert(llb.parse_ir(ir))
+            local run = phase[2](module.f, module)
+            report(shape, size, f, phase[1], measure(run))
+            llb.dispose(module)
+        end
+    end
+end
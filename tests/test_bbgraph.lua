@@ -116,6 +116,388 @@ do -- idom
     assert(idom[bb.exit] == bb.b1)
 end
 
+do -- idom (native, indexed by basic block position)
+    local idom = main:idom()
+    assert(idom[1] == nil)
+    for i, node in ipairs(bbgraph) do
+        if i > 1 then
+            assert(bbgraph[idom[i]] == bbgraph:idom()[node])
+        end
+    end
+end
+
+do -- dom & idom with loops and unreachable blocks
+    local loop = llb.load_ir("aux/loop.ll").f
+    local bbgraph = loop:bbgraph()
+    local bb = bbgraphmap(bbgraph)
+    local idom = bbgraph:idom()
+    assert(idom[bb.head] == bb.entry)
+    assert(idom[bb.body] == bb.head)
+    assert(idom[bb.body2] == bb.body)
+    assert(idom[bb.exit] == bb.head)
+    assert(idom[bb.dead] == nil)
+    local dom = bbgraph:dom(idom)
+    assert(dom[bb.body2] == set.new(bb.entry, bb.head, bb.body, bb.body2))
+    assert(dom[bb.dead] == set.new(table.unpack(bbgraph)))
+    local df = bbgraph:df()
+    assert(df[bb.entry]:is_empty())
+    assert(df[bb.head] == set.new(bb.head))
+    assert(df[bb.body] == set.new(bb.head))
+    assert(df[bb.body2] == set.new(bb.head))
+    assert(df[bb.exit]:is_empty())
+end
+
+do -- cfg (native, compact arrays)
+    local f = llb.load_ir("aux/loop.ll").f
+    local cfg = f:cfg()
+    local names = {}
+    for i, block in ipairs(cfg.blocks) do
+        names[i] = tostring(block)
+    end
+    local same = function(a, b)
+        return table.concat(a, ",") == table.concat(b, ",")
+    end
+    assert(same(names, {"entry", "head", "body", "body2", "dead", "exit"}))
+    assert(same(cfg.succoff, {1, 2, 4, 6, 7, 8, 8}))
+    assert(same(cfg.succ, {2, 3, 6, 2, 4, 2, 6}))
+    assert(same(cfg.predoff, {1, 1, 4, 5, 6, 6, 8}))
+    assert(same(cfg.pred, {1, 3, 4, 2, 3, 2, 5}))
+    assert(same(cfg.rpo, {1, 2, 6, 3, 4}))
+    assert(cfg.order[6] == 3 and cfg.order[5] == nil)
+
+    -- a subgraph ignores the edges to blocks outside of it
+    local blocks = cfg.blocks
+    local sub = f:cfg({blocks[1], blocks[2], blocks[6]})
+    assert(same(sub.succ, {2, 3}) and same(sub.rpo, {1, 2, 3}))
+    assert(#llb.load_ir("aux/empty.ll"):add_function("g", "void"):cfg().rpo
+        == 0)
+end
+
+do -- loops
+    local same = function(a, b)
+        table.sort(a)
+        table.sort(b)
+        return table.concat(a, ",") == table.concat(b, ",")
+    end
+
+    local nested = llb.load_ir("aux/nested.ll").f:loops()
+    assert(#nested.loops == 2 and same(nested.roots, {1}))
+    local outer, inner = nested.loops[1], nested.loops[2]
+    assert(outer.header == 2 and outer.depth == 1 and outer.parent == nil)
+    assert(same(outer.blocks, {2, 3, 4}) and same(outer.latches, {4}))
+    assert(same(outer.exits, {5}) and outer.preheader == 1)
+    assert(same(outer.children, {2}))
+    assert(inner.header == 3 and inner.depth == 2 and inner.parent == 1)
+    assert(same(inner.blocks, {3}) and same(inner.latches, {3}))
+    assert(same(inner.exits, {4}) and inner.preheader == 2)
+    assert(table.concat(nested.depth, ",") == "0,1,2,1,0")
+    assert(nested.loopof[3] == 2 and nested.loopof[4] == 1)
+    assert(nested.loopof[1] == nil and #nested.irreducible == 0)
+    assert(tostring(nested.blocks[outer.header]) == "outer")
+
+    local loop = llb.load_ir("aux/loop.ll").f:loops()
+    assert(#loop.loops == 1 and loop.loops[1].header == 2)
+    assert(same(loop.loops[1].blocks, {2, 3, 4}))
+    assert(same(loop.loops[1].latches, {3, 4}))
+    assert(same(loop.loops[1].exits, {6}))
+    assert(loop.depth[5] == 0 and loop.loopof[5] == nil)
+
+    local irreducible = llb.load_ir("aux/irreducible.ll").f:loops()
+    assert(#irreducible.loops == 0 and #irreducible.irreducible == 1)
+    assert(same(irreducible.irreducible[1].blocks, {2, 3}))
+    assert(same(irreducible.irreducible[1].entries, {2, 3}))
+
+    local book = main:loops()
+    assert(#book.loops == 0 and #book.irreducible == 0)
+
+    local dot = require "dot"
+    local f = llb.load_ir("aux/nested.ll").f
+    local graph = dot:loopgraph(f:cfg(), f:loops(), "f")
+    assert(graph:find("subgraph cluster_loop1 {\n", 1, true))
+    assert(graph:find("\t\tsubgraph cluster_loop2 {\n", 1, true))
+    assert(graph:find("Node4 -> Node2 [style=bold];", 1, true))
+    assert(graph:find("Node3 -> Node3 [style=bold];", 1, true))
+    assert(graph:find('\t\t\tNode3 [shape=record,label="{inner}"];', 1, true))
+    assert(graph .. "\n" == f:to_dot(nil, {graph = "loops"}))
+    f = llb.parse_ir([[
+        define void @f(i1 %c) {
+            br label %1
+        1:
+            br i1 %c, label %1, label %"for.body{}"
+        "for.body{}":
+            ret void
+        }]]).f
+    graph = dot:loopgraph(f:cfg(), f:loops(), "f")
+    assert(graph:find('\tNode1 [shape=record,label="{1}"];', 1, true))
+    assert(graph:find('\t\tNode2 [shape=record,label="{2}"];', 1, true))
+    assert(graph:find('Node3 [shape=record,label="{for.body\\{\\}}"]', 1, true))
+    assert(graph .. "\n" == f:to_dot(nil, {graph = "loops"}))
+    f = llb.load_ir("aux/irreducible.ll").f
+    graph = dot:loopgraph(f:cfg(), f:loops(), "f")
+    assert(graph:find("label=\"{a}\",style=filled", 1, true))
+end
+
+do -- dot files written natively, and dot:idomgraph
+    local dot = require "dot"
+    local f = llb.load_ir("aux/nested.ll").f
+    local graph = f:to_dot()
+    assert(graph:find('digraph "CFG for f function" {\n', 1, true))
+    assert(graph:find('\tNode3 [shape=record,label="{inner}"];\n', 1, true))
+    assert(graph:find("\tNode4 -> Node2;\n", 1, true))
+    assert(select(2, graph:gsub("%->", "")) == 6)
+
+    graph = f:to_dot(nil, {graph = "loops", color = "depth",
+        instructions = true})
+    assert(graph:find("\t\tsubgraph cluster_loop2 {\n", 1, true))
+    assert(graph:find("{inner:\\l  br i1 %c, label %inner, label " ..
+        "%latch\\l}\",style=filled,fillcolor=5];", 1, true))
+    assert(graph:find("Node3 -> Node3 [style=bold,color=5];", 1, true))
+    assert(graph:find("Node4 -> Node2 [style=bold,color=3];", 1, true))
+    assert(graph:find("Node4 -> Node5;", 1, true))
+
+    graph = f:to_dot(nil, {graph = "domtree", name = 'a "b"'})
+    assert(graph:find('"Dominator tree for a \\"b\\" function"', 1, true))
+    assert(select(2, graph:gsub("%->", "")) == 4)
+    assert(graph:find("Node4 -> Node5;", 1, true))
+
+    graph = f:to_dot(nil, {weights = {0, 4, 8}, edge_weights = {1, 1}})
+    assert(graph:find('{entry}",style=filled,fillcolor=2];', 1, true))
+    assert(graph:find('{outer}",style=filled,fillcolor=5];', 1, true))
+    assert(graph:find('{inner}",style=filled,fillcolor=9];', 1, true))
+    assert(graph:find('{latch}"];', 1, true))
+    assert(graph:find("Node2 -> Node3 [color=9];", 1, true))
+    assert(graph:find("Node3 -> Node3;", 1, true))
+
+    local name = os.tmpname()
+    local file = io.open(name, "w")
+    assert(f:to_dot(file, {graph = "loops"}) == file)
+    file:close()
+    file = io.open(name)
+    assert(file:read("a") == f:to_dot(nil, {graph = "loops"}))
+    file:close()
+    os.remove(name)
+
+    assert(not pcall(f.to_dot, f, nil, {graph = "nosuchgraph"}))
+    assert(not pcall(f.to_dot, f, nil, {color = "weight"}))
+    assert(not pcall(f.to_dot, f, nil, {graph = "domtree",
+        edge_weights = {}}))
+    -- errors raised while reading the weights leave nothing behind
+    local raising = setmetatable({}, {__index = function() error("w") end})
+    for _ = 1, 4 do
+        assert(not pcall(f.to_dot, f, nil, {weights = raising}))
+    end
+    collectgarbage()
+    assert(f:to_dot(nil, {weights = {0, 4, 8}}) ==
+        f:to_dot(nil, {weights = {0, 4, 8}}))
+
+    local g = f:bbgraph()
+    graph = dot:idomgraph(g:idom(), "f")
+    assert(graph:find("\tNodelatch -> Nodeexit;", 1, true))
+    assert(graph:find("\tNodeinner -> Nodelatch;", 1, true))
+    assert(select(2, graph:gsub("%->", "")) == 4)
+end
+
+do -- domtree, incremental updates against recomputed dominators
+    local blocks = main:basic_blocks()
+    local n = #blocks
+    local edges = {}
+    local cfg = main:cfg()
+    for i = 1, n do
+        edges[i] = {}
+        for k = cfg.succoff[i], cfg.succoff[i + 1] - 1 do
+            edges[i][cfg.succ[k]] = true
+        end
+    end
+
+    local tree = main:domtree()
+    local function check()
+        -- dom[i] = {i} U intersection of dom[p], over the reachable preds
+        local reachable, work = {[1] = true}, {1}
+        while #work > 0 do
+            local i = table.remove(work)
+            for j in pairs(edges[i]) do
+                if not reachable[j] then
+                    reachable[j] = true
+                    table.insert(work, j)
+                end
+            end
+        end
+        local dom = {[1] = set.new(1)}
+        for i = 2, n do
+            dom[i] = set.new()
+            for j = 1, n do
+                dom[i]:add(j)
+            end
+        end
+        local changed = true
+        while changed do
+            changed = false
+            for i = 2, n do
+                if reachable[i] then
+                    local new
+                    for p = 1, n do
+                        if reachable[p] and edges[p][i] then
+                            new = new and new * dom[p] or dom[p]:copy()
+                        end
+                    end
+                    new:add(i)
+                    if new ~= dom[i] then
+                        dom[i], changed = new, true
+                    end
+                end
+            end
+        end
+        -- the idom is the strict dominator with the most dominators
+        for i = 1, n do
+            local idom, depth = nil, 0
+            if reachable[i] then
+                depth = dom[i]:size()
+                for d in pairs(dom[i]) do
+                    if dom[d]:size() == depth - 1 then
+                        idom = d
+                    end
+                end
+            end
+            assert(tree:idom(blocks[i]) == (idom and blocks[idom]))
+            assert(tree:depth(blocks[i]) == depth)
+        end
+        local tblocks, idoms = tree:blocks(), tree:idoms()
+        for k, b in ipairs(tblocks) do
+            assert(tree:idom(b) == (idoms[k] and tblocks[idoms[k]]))
+        end
+    end
+
+    check()
+    assert(tree:dominates(blocks[1], blocks[n]))
+    assert(not tree:dominates(blocks[n], blocks[1]))
+    assert(#tree:children(blocks[1]) == 1 and #tree:blocks() == n)
+
+    llb.stats(true)
+    math.randomseed(7)
+    for step = 1, 80 do
+        local a, b = math.random(n), math.random(n)
+        if step % 4 == 0 then
+            edges[a][b] = nil
+            tree:delete_edge(blocks[a], blocks[b])
+        else
+            edges[a][b] = true
+            tree:insert_edge(blocks[a], blocks[b])
+        end
+        check()
+    end
+    local stats = llb.stats()
+    assert(not stats.enabled or stats.counters["domtree.recomputes"] == 0)
+
+    -- splitting edges and deleting branches never recompute the tree
+    local f = llb.load_ir("aux/loop.ll").f
+    local other = llb.load_ir("aux/loop.ll").f:basic_blocks()
+    local bb = {}
+    for k, b in ipairs(f:basic_blocks()) do
+        bb[({"entry", "head", "body", "body2", "dead", "exit"})[k]] = b
+    end
+    tree = f:domtree()
+    llb.stats(true)
+    local m, m2 = other[1], other[2]
+    tree:insert_edge(bb.head, m)
+    tree:insert_edge(m, bb.body)
+    tree:delete_edge(bb.head, bb.body)
+    assert(tree:idom(m) == bb.head and tree:idom(bb.body) == m)
+    assert(tree:idom(bb.body2) == bb.body and tree:depth(bb.body2) == 5)
+    -- a chain of new blocks becomes reachable at once
+    tree:insert_edge(m2, bb.body2)
+    tree:insert_edge(bb.exit, m2)
+    assert(tree:idom(m2) == bb.exit and tree:depth(m2) == 4)
+    assert(tree:idom(bb.body2) == bb.head and tree:depth(bb.body2) == 3)
+    -- the branch to body dies with its subtree, body2 keeps m2
+    tree:delete_edge(bb.head, m)
+    assert(tree:idom(m) == nil and tree:depth(m) == 0)
+    assert(tree:idom(bb.body) == nil and tree:depth(bb.body) == 0)
+    assert(tree:idom(bb.body2) == m2 and tree:depth(bb.body2) == 5)
+    assert(#tree:children(bb.head) == 1)
+    stats = llb.stats()
+    assert(not stats.enabled or stats.counters["domtree.recomputes"] == 0)
+
+    -- bbgraph keeps its tree, idom follows the edge updates
+    f = llb.load_ir("aux/loop.ll").f
+    local graph = f:bbgraph()
+    local nodes = bbgraphmap(graph)
+    assert(graph:idom()[nodes.body2] == nodes.body)
+    graph:insert_edge(nodes.entry, nodes.body2)
+    assert(graph:idom()[nodes.body2] == nodes.entry)
+    assert(nodes.entry.successors:contains(nodes.body2))
+    graph:insert_edge(nodes.head, nodes.dead)
+    assert(graph:idom()[nodes.dead] == nodes.head)
+    graph:delete_edge(nodes.entry, nodes.body2)
+    assert(graph:idom()[nodes.body2] == nodes.body)
+    local new = graph:add_block(llb.load_ir("aux/loop.ll").f:basic_blocks()[1])
+    graph:insert_edge(nodes.body2, new)
+    assert(graph:idom()[new] == nodes.body2)
+    assert(graph:domtree():depth(new.ref) == 5)
+end
+
+do -- liveness, before and after SSA construction
+    local module = llb.load_ir("aux/ssa.ll")
+    local f = module.sum
+    local value = {}
+    for _, v in ipairs(f:params()) do
+        value[tostring(v)] = v
+    end
+    for _, bb in ipairs(f:basic_blocks()) do
+        for _, inst in ipairs(bb:instructions()) do
+            local name = tostring(inst):match("%%([%w%-]+) =")
+            value[name or inst] = inst
+        end
+    end
+
+    -- entry, cond, body, double, inc, exit
+    local live = f:liveness(nil, {instructions = true})
+    -- the allocas are slots, their addresses are not registers
+    assert(#live.values == 13 and #live.allocas == 3)
+    local n, i, s = value["i32 %n"], value.i, value.s
+    assert(live.live_in[1] == llb.bitset(live.values, n))
+    assert(live.live_out[1] == llb.bitset(live.values, n))
+    assert(live.live_in[6]:is_empty())
+    assert(live.live_out[6]:is_empty())
+    assert(live.allocas_in[1]:is_empty())
+    assert(live.allocas_out[1] == llb.bitset(live.allocas, i, s))
+    assert(live.allocas_in[4] == llb.bitset(live.allocas, i, s))
+    assert(live.allocas_in[6] == llb.bitset(live.allocas, s))
+    assert(not live.allocas_in[2]:contains(value.unused))
+    assert(live.ranges[value.unused] == nil)
+    assert(table.concat(live.ranges[n], ",") == "1,2,3,4,5")
+    assert(table.concat(live.ranges[value.add], ",") == "3")
+    assert(live.pressure[1] == 1 and live.pressure[6] == 1)
+    local after = llb.bitset(live.values, n, value.lt)
+    assert(live.live_after[value.lt] == after)
+    assert(live.live_after[value.add]:contains(value["load-i-2"]))
+    assert(not live.live_after[value.add]:contains(value["load-s"]))
+
+    f:native_prunedssa(llb.get_builder(module))
+    live = f:liveness()
+    assert(#live.allocas == 0 and live.live_after == nil)
+    local phis = {}
+    assert(#live.values == 10)
+    for _, inst in ipairs(live.blocks[2]:instructions()) do
+        if inst:opcode() == llb.opcodes.phi then
+            table.insert(phis, inst)
+        end
+    end
+    -- phis are defined at their block, their operands live on the edges
+    for _, phi in ipairs(phis) do
+        assert(not live.live_in[2]:contains(phi))
+        assert(live.live_out[2]:contains(phi))
+    end
+    assert(live.live_in[1] == llb.bitset(live.values, n))
+    assert(live.live_out[1] == llb.bitset(live.values, n))
+    assert(live.live_in[6]:size() == 1 and live.live_out[6]:is_empty())
+    assert(not live.live_in[5]:contains(value.next))
+
+    local loop = llb.load_ir("aux/loop.ll").f
+    local blocks = loop:basic_blocks()
+    live = loop:liveness({blocks[1], blocks[2]})
+    assert(#live.blocks == 2 and #live.live_in == 2)
+end
+
 do -- ridom
     local ridom = bbgraph:ridom()
     assert(ridom[bb.entry] == set.new(bb.b1))
@@ -158,4 +540,18 @@ do -- dfplus
     assert(dfp_z == set.new(bb.exit))
 end
 
+do -- phis
+    local phis = bbgraph:phis({
+        a = set.new(bb.entry),
+        x = set.new(bb.b2, bb.b3),
+        y = set.new(bb.b4),
+        z = set.new(bb.b1, bb.b5, bb.b6)
+    })
+    assert(phis[bb.entry]:is_empty())
+    assert(phis[bb.b1]:is_empty())
+    assert(phis[bb.b5] == set.new("x"))
+    assert(phis[bb.exit] == set.new("x", "y", "z"))
+    assert(bbgraph:df() == bbgraph:df()) -- cached
+end
+
 testing.ok()
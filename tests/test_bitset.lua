@@ -0,0 +1,133 @@
+--
+-- Lua binding for LLVM C API.
+-- Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+--
+-- This file is part of llb.
+--
+-- llb is free software: you can redistribute it and/or modify
+-- it under the terms of the GNU General Public License as published by
+-- the Free Software Foundation, either version 2 of the License, or
+-- (at your option) any later version.
+--
+-- llb is distributed in the hope that it will be useful,
+-- but WITHOUT ANY WARRANTY; without even the implied warranty of
+-- MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+-- GNU General Public License for more details.
+--
+-- You should have received a copy of the GNU General Public License
+-- along with llb. If not, see <http://www.gnu.org/licenses/>.
+--
+
+local testing = require "testing"
+local llb = require "llb"
+local set = require "set"
+
+testing.header("bitset.c")
+
+do -- new
+    local s = llb.bitset(100)
+    assert(s:is_empty())
+    assert(s:size() == 0)
+
+    s = llb.bitset(100, 1, 64, 65, 100)
+    assert(s:size() == 4)
+    assert(s:contains(1, 64, 65, 100))
+    assert(not s:contains(2))
+    assert(not s:contains(101))
+    assert(not pcall(s.add, s, 101))
+end
+
+do -- copy & equality
+    local s = llb.bitset(200, 3, 130)
+    local copy = s:copy()
+    assert(copy == s)
+    s:add(7)
+    assert(copy ~= s)
+    assert(s:size() == 3)
+    assert(copy:size() == 2)
+end
+
+do -- add, remove & pop
+    local s = llb.bitset(10)
+    s:add(1, 2, 3)
+    s:add(2)
+    assert(s:size() == 3)
+    s:remove(2, 9)
+    assert(s:size() == 2)
+    assert(s:pop() == 1)
+    assert(s:pop() == 3)
+    assert(s:pop() == nil)
+    assert(s:is_empty())
+end
+
+do -- pairs
+    local s = llb.bitset(300, 299, 1, 64, 128)
+    local t = {}
+    for k, v in pairs(s) do
+        assert(k == v)
+        table.insert(t, k)
+    end
+    assert(#t == 4)
+    assert(t[1] == 1 and t[2] == 64 and t[3] == 128 and t[4] == 299)
+end
+
+do -- operators
+    local a = llb.bitset(70, 1, 2, 69)
+    local b = llb.bitset(70, 2, 3, 69)
+    assert(a + b == llb.bitset(70, 1, 2, 3, 69))
+    assert(a * b == llb.bitset(70, 2, 69))
+    assert(a - b == llb.bitset(70, 1))
+    assert(a + {4} == llb.bitset(70, 1, 2, 4, 69))
+    assert({4} + a == llb.bitset(70, 1, 2, 4, 69))
+    assert(a:size() == 3) -- operators don't modify their operands
+end
+
+do -- in place operations
+    local a = llb.bitset(70, 1, 2, 69)
+    assert(a:union(llb.bitset(70, 5)) == a)
+    assert(a == llb.bitset(70, 1, 2, 5, 69))
+    a:intersect({1, 5, 69})
+    assert(a == llb.bitset(70, 1, 5, 69))
+    a:difference({5})
+    assert(a == llb.bitset(70, 1, 69))
+    assert(not pcall(a.union, a, llb.bitset(71)))
+end
+
+do -- universe
+    local x, y, z = {}, {}, {}
+    local universe = {x, y, z}
+    local s = llb.bitset(universe, z, x)
+    assert(s:size() == 2)
+    assert(s:contains(x, z))
+    assert(not s:contains(y))
+    assert(not s:contains({}))
+    assert(s + {y} == llb.bitset(universe, x, y, z))
+    assert(s:map(function(e) return e == x and 1 or 3 end) == set.new(1, 3))
+    assert(s:filter(function(e) return e == x end) == llb.bitset(universe, x))
+    assert(s ~= llb.bitset({x, y, z}, x, z)) -- another universe
+end
+
+do -- dense bbgraph
+    local main = llb.load_ir("aux/book.ll").main
+    local sparse = main:bbgraph()
+    local bbgraph = main:bbgraph(nil, true)
+    local position = {}
+    for i, node in ipairs(bbgraph) do
+        position[node] = i
+    end
+    -- maps a bitset of dense nodes to a set of sparse nodes
+    local function tosparse(s)
+        return s:map(function(node) return sparse[position[node]] end)
+    end
+
+    local dom, sparsedom = bbgraph:dom(), sparse:dom()
+    local df, sparsedf = bbgraph:df(), sparse:df()
+    for i, node in ipairs(bbgraph) do
+        assert(tosparse(node.successors) == sparse[i].successors)
+        assert(tosparse(node.predecessors) == sparse[i].predecessors)
+        assert(tosparse(dom[node]) == sparsedom[sparse[i]])
+        assert(tosparse(df[node]) == sparsedf[sparse[i]])
+    end
+end
+
+testing.ok()
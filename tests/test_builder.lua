@@ -0,0 +1,210 @@
+--
+-- Lua binding for LLVM C API.
+-- Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+--
+-- This file is part of llb.
+--
+-- llb is free software: you can redistribute it and/or modify
+-- it under the terms of the GNU General Public License as published by
+-- the Free Software Foundation, either version 2 of the License, or
+-- (at your option) any later version.
+--
+-- llb is distributed in the hope that it will be useful,
+-- but WITHOUT ANY WARRANTY; without even the implied warranty of
+-- MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+-- GNU General Public License for more details.
+--
+-- You should have received a copy of the GNU General Public License
+-- along with llb. If not, see <http://www.gnu.org/licenses/>.
+--
+
+local testing = require "testing"
+local llb = require "llb"
+
+testing.header("builder.h")
+
+do -- builds a function with the builder methods
+    local module = llb.load_ir("aux/empty.ll")
+    local f = module:add_function("max", "i32", {"i32", "i32"})
+    assert(module:add_function("max", "i32", {"i32", "i32"}) == f)
+    local a, b = table.unpack(f:params())
+    local builder = module:get_builder()
+    local entry = builder:block(f)
+    local left, right = builder:block(f), builder:block(f)
+    assert(builder:insert_block() == nil)
+    builder:position(entry)
+    assert(builder:insert_block() == entry)
+    local gt = builder:icmp("sgt", a, b)
+    builder:cond_br(gt, left, right)
+    builder:position(left)
+    builder:ret(a)
+    builder:position(right)
+    builder:ret(b)
+    local engine = module:jit()
+    assert(engine:lookup("max")(3, 5) == 5)
+    assert(engine:lookup("max")(7, -2) == 7)
+end
+
+do -- arithmetic, memory, casts, calls and constants
+    local module = llb.load_ir("aux/empty.ll")
+    local max = module:add_function("max", "i64", {"i64", "i64"})
+    local f = module:add_function("f", "double", {"i32", "double*"})
+    local n, p = table.unpack(f:params())
+    local builder = llb.get_builder(module)
+    builder:position(builder:block(f))
+    local slot = builder:alloca("[4 x i32]")
+    local second = builder:gep(slot, 0, 1)
+    builder:store(builder:mul(n, 3), second)
+    local x = builder:add(builder:load(second), 1)
+    x = builder:bxor(builder:bnot(builder:neg(x)), 0)
+    local wide = builder:sext(x, "i64")
+    local m = builder:call(max, wide, builder:const("i64", 10))
+    local d = builder:sitofp(m, "double")
+    local old = builder:load(p)
+    builder:store(builder:fadd(d, old), p)
+    local small = builder:fcmp("olt", d, 0.5)
+    builder:ret(builder:select(small, 0.5, builder:fmul(d, 2)))
+
+    builder:position(builder:block(max))
+    local lhs, rhs = table.unpack(max:params())
+    local lt = builder:icmp("slt", lhs, rhs)
+    builder:ret(builder:select(lt, rhs, lhs))
+
+    local ir = module:to_ir()
+    for _, s in ipairs({"alloca [4 x i32]", "getelementptr", "sext",
+                        "call i64 @max", "sitofp", "fcmp olt", "select"}) do
+        assert(ir:find(s, 1, true), s)
+    end
+    assert(llb.parse_ir(ir))
+end
+
+do -- invalid operands
+    local module = llb.load_ir("aux/empty.ll")
+    local f = module:add_function("f", "void", {"i32"})
+    local builder = module:get_builder()
+    builder:position(builder:block(f))
+    local n = f:params()[1]
+    assert(not pcall(builder.add, builder, 1, 2))
+    assert(not pcall(builder.add, builder, n))
+    assert(not pcall(builder.icmp, builder, "less", n, n))
+    assert(not pcall(builder.alloca, builder, "i32**x"))
+    assert(not pcall(builder.br, builder, n))
+    assert(not pcall(builder.call, builder, f))
+    assert(not pcall(module.add_function, module, "g", "int"))
+end
+
+do -- operands of the wrong type
+    local module = llb.load_ir("aux/empty.ll")
+    local g = module:add_function("g", "i32", {"i64"})
+    local f = module:add_function("f", "i32", {"i32", "i64", "double",
+        "i32*"})
+    local builder = module:get_builder()
+    local entry = builder:block(f)
+    builder:position(entry)
+    local n, wide, d, p = table.unpack(f:params())
+    assert(not pcall(builder.add, builder, n, wide))
+    assert(not pcall(builder.add, builder, d, d))
+    assert(not pcall(builder.fadd, builder, n, n))
+    assert(not pcall(builder.neg, builder, d))
+    assert(not pcall(builder.icmp, builder, "eq", n, wide))
+    assert(not pcall(builder.icmp, builder, "eq", d, d))
+    assert(not pcall(builder.fcmp, builder, "oeq", n, n))
+    assert(not pcall(builder.select, builder, n, n, n))
+    assert(not pcall(builder.store, builder, wide, p))
+    assert(not pcall(builder.call, builder, g, n))
+    assert(not pcall(builder.phi, builder, "i32", wide, entry))
+    assert(not pcall(builder.cond_br, builder, n, entry, entry))
+    assert(not pcall(builder.switch, builder, n, entry, n, entry))
+    assert(not pcall(builder.ret, builder, wide))
+    assert(not pcall(builder.ret, builder))
+    assert(#entry:instructions() == 0)
+    builder:ret(builder:call(g, wide))
+    assert(llb.parse_ir(module:to_ir()))
+end
+
+do -- emit builds the same IR as the builder methods
+    local module = llb.load_ir("aux/empty.ll")
+    local f = module:add_function("sum", "i32", {"i32"})
+    local n = f:params()[1]
+    local results = {}
+    local last = module:get_builder():emit({
+        {"block", -1},                 -- 1: entry
+        {"block", -1},                 -- 2: loop
+        {"block", -1},                 -- 3: exit
+        {"position", 1},
+        {"const", "i32", 0},           -- 5
+        {"br", 2},
+        {"position", 2},
+        {"phi", "i32", 5, 1, 10, 2},   -- 8: i
+        {"phi", "i32", 5, 1, 11, 2},   -- 9: s
+        {"add", 8, -3},                -- 10: i + 1
+        {"add", 9, 8},                 -- 11: s + i
+        {"icmp", "slt", 10, -2},       -- 12
+        {"cond_br", 12, 2, 3},
+        {"position", 3},
+        {"ret", 11},
+    }, {f, n, llb.get_builder(module):const("i32", 1)}, results)
+    assert(last == results[15])
+    assert(results[1] == f:basic_blocks()[1])
+    assert(results[4] == nil)
+    local sum = module:jit():lookup("sum")
+    assert(sum(1) == 0 and sum(5) == 10 and sum(100) == 4950)
+end
+
+do -- numbers in the inputs are constants, not references
+    local module = llb.load_ir("aux/empty.ll")
+    local f = module:add_function("seven", "i32", {})
+    module:get_builder():emit({
+        {"block", -1},
+        {"position", 1},
+        {"const", "i32", 2},           -- 3
+        {"add", 3, -2},                -- 4: 2 + 5
+        {"ret", 4},
+    }, {f, 5})
+    assert(module:jit():lookup("seven")() == 7)
+end
+
+do -- emit errors
+    local module = llb.load_ir("aux/empty.ll")
+    local f = module:add_function("f", "void", {})
+    local builder = module:get_builder()
+    assert(not pcall(builder.emit, builder, {{"nosuchop"}}))
+    assert(not pcall(builder.emit, builder, {{"block", -1}}))
+    assert(not pcall(builder.emit, builder, {{"block", -1}, {"br", 3}}, {f}))
+    assert(not pcall(builder.emit, builder, {"ret"}))
+
+    -- nothing is left of a program that fails
+    local n = #f:basic_blocks()
+    local ok, err = pcall(builder.emit, builder, {
+        {"block", -1},                 -- 1
+        {"block", -1},                 -- 2
+        {"position", 1},
+        {"phi", "i32", 6, 2},          -- 4
+        {"br", 2},
+        {"const", "i64", 1},           -- 6
+        {"position", 2},
+        {"ret"},
+    }, {f})
+    assert(not ok and err:find("instruction 4, operand 2"))
+    assert(#f:basic_blocks() == n)
+    assert(builder:insert_block() == nil)
+    assert(not pcall(builder.emit, builder, {
+        {"block", -1},
+        {"position", 1},
+        {"const", "i32", 1},
+        {"add", 3, 3.5},
+        {"ret", 4},
+    }, {module:add_function("g", "i32", {})}))
+    assert(#module.g:basic_blocks() == 0)
+    assert(llb.parse_ir(module:to_ir()))
+end
+
+do -- builders are collected
+    local module = llb.load_ir("aux/empty.ll")
+    for _ = 1, 100 do
+        module:get_builder()
+    end
+    collectgarbage()
+end
+
+testing.ok()
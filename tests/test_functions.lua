@@ -46,6 +46,43 @@ do -- bbgraph
     -- complete test in test_bbgraph.lua
 end
 
+do -- objects are interned
+    local bbs = main:basic_blocks()
+    assert(rawequal(module.main, main))
+    assert(rawequal(bbs[1], main:basic_blocks()[1]))
+    assert(rawequal(bbs[1]:successors()[1], bbs[2]))
+    assert(rawequal(bbs[1]:parent(), main))
+    local first = bbs[1]:first_instruction()
+    assert(rawequal(first, bbs[1]:instructions()[1]))
+    for _, usage in ipairs(first:usages()) do
+        local operands = usage:operands()
+        assert(rawequal(operands[1], first) or rawequal(operands[2], first))
+    end
+end
+
+do -- lazy iterators & counts
+    for _, bb in ipairs(main:basic_blocks()) do
+        local instructions, i = bb:instructions(), 0
+        for instruction in bb:each_instruction() do
+            i = i + 1
+            assert(rawequal(instruction, instructions[i]))
+            local operands = instruction:operands()
+            assert(instruction:operand_count() == #operands)
+            for j, operand in instruction:each_operand() do
+                assert(rawequal(operand, operands[j]))
+                assert(rawequal(operand, instruction:operand(j)))
+            end
+            local usages, k = instruction:usages(), 0
+            for usage in instruction:each_usage() do
+                k = k + 1
+                assert(rawequal(usage, usages[k]))
+            end
+            assert(instruction:usage_count() == k and k == #usages)
+        end
+        assert(bb:instruction_count() == i and i == #instructions)
+    end
+end
+
 do -- prunedssa
     local builder = llb.get_builder(module)
     assert(builder)
@@ -54,4 +91,273 @@ do -- prunedssa
     llb.write_bitcode(module, "testando.bc")
 end
 
+do -- native_prunedssa produces the same IR as prunedssa
+    local function ir(f)
+        local t = {}
+        for _, bb in ipairs(f:basic_blocks()) do
+            table.insert(t, tostring(bb) .. ":")
+            for _, instruction in ipairs(bb:instructions()) do
+                table.insert(t, tostring(instruction))
+            end
+        end
+        return table.concat(t, "\n")
+    end
+    local cases = {
+        {"aux/book.ll", "main"},
+        {"aux/ssa.ll", "sum"},
+        {"aux/irreducible.ll", "f"},
+        {"aux/switch.ll", "f"},
+    }
+    for _, case in ipairs(cases) do
+        local lua, native = llb.load_ir(case[1]), llb.load_ir(case[1])
+        lua[case[2]]:prunedssa(llb.get_builder(lua))
+        native[case[2]]:native_prunedssa(llb.get_builder(native))
+        assert(ir(lua[case[2]]) == ir(native[case[2]]))
+        assert(not ir(native[case[2]]):find("alloca"))
+        lua:run_passes("verify")
+        native:run_passes("verify")
+    end
+
+    -- a phi has an incoming value per edge, the switch branches twice
+    local native = llb.load_ir("aux/switch.ll")
+    native.f:native_prunedssa(llb.get_builder(native))
+    local phi = native.f:basic_blocks()[3]:first_instruction()
+    assert(phi:opcode() == llb.opcodes.phi)
+    assert(tostring(phi):find("[ 0, %entry ], [ 0, %entry ], [ 1, %one ]",
+        1, true))
+end
+
+do -- find
+    local module = llb.load_ir("aux/ssa.ll")
+    local sum = module.sum
+    local found = sum:find({"load", "store"})
+    local expected = {}
+    for _, bb in ipairs(sum:basic_blocks()) do
+        for _, instruction in ipairs(bb:instructions()) do
+            local opcode = instruction:opcode()
+            if opcode == llb.opcodes.load or opcode == llb.opcodes.store then
+                table.insert(expected, instruction)
+            end
+        end
+    end
+    assert(#found == #expected and #found == 11)
+    for i, instruction in ipairs(found) do
+        assert(instruction == expected[i])
+    end
+    assert(#sum:find("alloca") == 3)
+    assert(#sum:find({llb.opcodes.alloca, "ret"}) == 4)
+    assert(#sum:find({}) == 0)
+    assert(llb.opcodes[llb.opcodes.phi] == "phi")
+
+    local byopcode = sum:find({"load", "store", "phi"}, "opcode")
+    assert(#byopcode.load == 6 and #byopcode.store == 5)
+    assert(#byopcode.phi == 0)
+    for _, load in ipairs(byopcode.load) do
+        assert(load:opcode() == llb.opcodes.load)
+    end
+
+    local byblock = sum:find({"load", "store"}, "block")
+    local blocks = sum:basic_blocks()
+    assert(#byblock[blocks[1]] == 2 and #byblock[blocks[2]] == 1)
+    assert(byblock[blocks[6]][1] == found[#found])
+    local n = 0
+    for _, instructions in pairs(byblock) do
+        n = n + #instructions
+    end
+    assert(n == #found)
+
+    assert(not pcall(sum.find, sum, {"nosuchopcode"}))
+    assert(not pcall(sum.find, sum, {"load"}, "function"))
+    assert(found[1]:operand(1):opcode() == 0)
+    assert(found[1]:operand(2):opcode() == llb.opcodes.alloca)
+end
+
+do -- run_passes
+    local module = llb.load_ir("aux/ssa.ll")
+    module.sum:run_passes("mem2reg", {verify_each = true})
+    assert(not module.sum:to_ir():find("alloca"))
+    assert(module.sum:to_ir():find("phi"))
+    module:run_passes("instcombine,simplifycfg", {loop_unrolling = false})
+    assert(not module.sum:to_ir():find("alloca"))
+    assert(not pcall(module.sum.run_passes, module.sum, "nosuchpass"))
+    assert(not pcall(module.run_passes, module, "nosuchpass"))
+    assert(not pcall(module.run_passes, module, "mem2reg", {
+        licm_mssa_opt_cap = "many",
+    }))
+end
+
+do -- analysis cache, invalidated by the changes made through llb
+    local module = llb.load_ir("aux/ssa.ll")
+    local sum = module.sum
+    assert(select("#", sum:epochs()) == 2 and sum:epochs() == 0)
+    local bbgraph, idom = sum:analysis("bbgraph"), sum:analysis("idom")
+    local live = sum:analysis("liveness")
+    assert(sum:analysis("bbgraph") == bbgraph)
+    assert(sum:analysis("idom") == idom)
+    assert(sum:analysis("liveness") == live)
+    assert(not pcall(sum.analysis, sum, "nosuchanalysis"))
+
+    -- prunedssa changes the IR but not the graph, and uses the cache
+    sum:prunedssa(llb.get_builder(module))
+    local ir, cfg = sum:epochs()
+    assert(ir > 0 and cfg == 0)
+    assert(sum:analysis("bbgraph") == bbgraph)
+    assert(sum:analysis("idom") == idom)
+    assert(sum:analysis("liveness") ~= live)
+    assert(#sum:analysis("liveness").allocas == 0)
+
+    -- new blocks and terminators change the graph
+    local builder = llb.get_builder(module)
+    local exit = sum:basic_blocks()[6]
+    local ret = exit:last_instruction()
+    local block = builder:block(sum)
+    assert(select(2, sum:epochs()) == cfg + 1)
+    assert(sum:analysis("bbgraph") ~= bbgraph)
+    bbgraph = sum:analysis("bbgraph")
+    assert(#bbgraph == 7)
+    builder:position(block)
+    builder:unreachable()
+    assert(sum:analysis("bbgraph") ~= bbgraph)
+    ir, cfg = sum:epochs()
+    builder:position_before(ret)
+    builder:add(ret:operand(1), 1)
+    assert(sum:epochs() == ir + 1 and select(2, sum:epochs()) == cfg)
+
+    ir, cfg = sum:epochs()
+    sum:run_passes("instcombine")
+    assert(sum:epochs() == ir + 1 and select(2, sum:epochs()) == cfg + 1)
+    module:run_passes("simplifycfg")
+    assert(select(2, sum:epochs()) == cfg + 2)
+
+    idom = sum:analysis("idom")
+    sum:invalidate("idom")
+    assert(sum:analysis("idom") ~= idom)
+    sum:invalidate()
+    assert(sum:analysis("idom") ~= idom)
+end
+
+do -- module passes forget the functions they delete
+    local ir = [[
+        define internal void @dead(i1 %c) {
+        entry:
+            br i1 %c, label %a, label %b
+        a:
+            br label %b
+        b:
+            ret void
+        }
+    ]]
+    -- the objects are kept alive, as LLVM may reuse their addresses
+    local dead = {}
+    for i = 1, 16 do
+        local module = llb.parse_ir(ir)
+        dead[i] = module.dead
+        assert(#dead[i]:analysis("bbgraph") == 3)
+        module:run_passes("globaldce")
+        assert(module.dead == nil)
+
+        local g = module:add_function("g", "void", {"i1"})
+        local builder = llb.get_builder(module)
+        builder:position(builder:block(g))
+        builder:ret()
+        assert(g ~= dead[i])
+        local graph = g:analysis("bbgraph")
+        assert(#graph == 1 and graph[1].ref == g:basic_blocks()[1])
+    end
+end
+
+do -- analyses updated along with the changes are preserved
+    local module = llb.load_ir("aux/ssa.ll")
+    local sum = module.sum
+    local graph, tree = sum:analysis("bbgraph"), sum:analysis("domtree")
+    local exit = sum:basic_blocks()[6]
+    local builder = llb.get_builder(module)
+    local block = builder:block(sum)
+    builder:position(block)
+    builder:br(exit)
+    local node = graph:add_block(block)
+    graph:insert_edge(node, graph[6])
+    tree:insert_edge(block, exit)
+    assert(sum:analysis("bbgraph") == graph)
+    assert(sum:analysis("domtree") ~= tree)
+
+    tree = sum:analysis("domtree")
+    builder:position(builder:block(sum))
+    builder:br(exit)
+    sum:preserve("domtree", {})
+    assert(sum:analysis("domtree") ~= tree)
+    tree = sum:analysis("domtree")
+    builder:position(builder:block(sum))
+    builder:br(exit)
+    sum:preserve("domtree")
+    assert(sum:analysis("domtree") == tree)
+    assert(not pcall(sum.preserve, sum, "nosuchanalysis"))
+end
+
+do -- analyses are not shared with the functions of disposed modules
+    local one = "define void @f() {\n  ret void\n}"
+    local three = [[
+        define void @f(i1 %c) {
+        entry:
+            br i1 %c, label %a, label %b
+        a:
+            ret void
+        b:
+            ret void
+        }]]
+    for _ = 1, 20 do
+        local m = llb.parse_ir(one)
+        assert(#m.f:analysis("cfg").blocks == 1)
+        llb.dispose(m)
+        local g = llb.parse_ir(three).f
+        assert(g:epochs() == 0)
+        assert(#g:analysis("cfg").blocks == 3)
+    end
+    collectgarbage()
+end
+
+do -- ssa_index
+    local module = llb.load_ir("aux/ssa.ll")
+    local sum = module.sum
+    local index = sum:ssa_index(nil, {instructions = true})
+    assert(index.n == 26 and index.nargs == 1)
+    assert(#index.blocks == 6 and #index.blockoff == 7)
+    assert(index.blockoff[1] == 1 and index.blockoff[7] == 27)
+    for b = 1, #index.blocks do
+        local k = index.blockoff[b]
+        for instruction in index.blocks[b]:each_instruction() do
+            assert(index.instructions[k] == instruction)
+            assert(index.opcode[k] == instruction:opcode())
+            assert(index.block[k] == b)
+            k = k + 1
+        end
+        assert(k == index.blockoff[b + 1])
+    end
+
+    -- %lt = icmp slt i32 %load-i, %n
+    local lt = index.opoff[8]
+    assert(index.opcode[8] == llb.opcodes.icmp)
+    assert(index.opoff[9] - lt == 2)
+    assert(index.operand[lt] == 7 and index.operand[lt + 1] == -1)
+    -- store i32 0, i32* %i
+    assert(index.operand[index.opoff[4]] == 0)
+    assert(index.operand[index.opoff[4] + 1] == 1)
+
+    -- %i is used by two stores and three loads
+    local users = {}
+    for k = index.useoff[1], index.useoff[2] - 1 do
+        table.insert(users, index.use[k])
+    end
+    table.sort(users)
+    assert(table.concat(users, ",") == "4,7,11,21,23")
+    -- %unused has no users, the return has no users
+    assert(index.useoff[3] == index.useoff[4])
+    assert(index.useoff[26] == index.useoff[27])
+
+    local blocks = sum:basic_blocks()
+    local sub = sum:ssa_index({blocks[1], blocks[6]})
+    assert(sub.n == 8 and not sub.instructions)
+    assert(sub.block[8] == 2)
+end
+
 testing.ok()
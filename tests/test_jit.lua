@@ -0,0 +1,93 @@
+--
+-- Lua binding for LLVM C API.
+-- Copyright (C) 2018 Matheus Ambrozio, Pedro Tammela, Renan Almeida.
+--
+-- This file is part of llb.
+--
+-- llb is free software: you can redistribute it and/or modify
+-- it under the terms of the GNU General Public License as published by
+-- the Free Software Foundation, either version 2 of the License, or
+-- (at your option) any later version.
+--
+-- llb is distributed in the hope that it will be useful,
+-- but WITHOUT ANY WARRANTY; without even the implied warranty of
+-- MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+-- GNU General Public License for more details.
+--
+-- You should have received a copy of the GNU General Public License
+-- along with llb. If not, see <http://www.gnu.org/licenses/>.
+--
+
+local testing = require "testing"
+local llb = require "llb"
+
+testing.header("jit.h")
+
+local function sum(n)
+    local s = 0
+    for i = 0, n - 1 do
+        s = s + i
+        if i % 2 == 0 then
+            s = s * 2
+        end
+    end
+    return s
+end
+
+do -- calls functions of a module
+    local module = llb.load_ir("aux/ssa.ll")
+    local engine = llb.jit(module)
+    local f = engine:lookup("sum")
+    for n = 0, 10 do
+        assert(f(n) == sum(n))
+    end
+    assert(engine:lookup("nosuchfunction") == nil)
+    assert(not pcall(f))
+    assert(not pcall(f, "a"))
+end
+
+do -- integers, booleans, numbers and pointers
+    local engine = llb.load_ir("aux/jit.ll"):jit({opt_level = 0})
+    assert(engine:lookup("scale")(1.5, 3) == 4.5)
+    assert(engine:lookup("half")(3) == 1.5)
+    assert(engine:lookup("isnull")(nil) == true)
+    assert(engine:lookup("isnull")("") == false)
+    assert(engine:lookup("identity")(nil) == nil)
+    assert(type(engine:lookup("identity")("llb")) == "userdata")
+    assert(engine:lookup("length")("llb") == 3)
+    assert(engine:lookup("wrap")(127) == -128)
+    assert(select("#", engine:lookup("nothing")()) == 0)
+    assert(engine:lookup("wide") == nil)
+    assert(engine:lookup("strlen") == nil)
+end
+
+do -- optimization levels and lazy compilation
+    for level = 0, 3 do
+        for _, lazy in ipairs({false, true}) do
+            local module = llb.load_ir("aux/ssa.ll")
+            local engine = llb.jit(module, {opt_level = level, lazy = lazy})
+            assert(engine:lookup("sum")(7) == sum(7))
+        end
+    end
+    assert(not pcall(llb.jit, llb.load_ir("aux/ssa.ll"), {opt_level = 4}))
+end
+
+do -- engines run a snapshot of rewritten modules
+    local module = llb.load_ir("aux/ssa.ll")
+    module.sum:native_prunedssa(llb.get_builder(module))
+    local engine = llb.jit(module, {lazy = true})
+    module.sum:run_passes("instcombine")
+    assert(engine:lookup("sum")(9) == sum(9))
+end
+
+do -- disposed engines
+    local engine = llb.jit(llb.load_ir("aux/ssa.ll"))
+    local f = engine:lookup("sum")
+    engine:dispose()
+    engine:dispose()
+    assert(not pcall(f, 1))
+    assert(not pcall(engine.lookup, engine, "sum"))
+    assert(tostring(engine))
+end
+
+testing.ok()
@@ -68,6 +68,35 @@ local tests = {{
         arguments = {"aux/invalid.bc"},
         err = err.invalid_bc_file
     }}
+}, {
+    func = "parse_ir",
+    cases = {{
+        name = "ok",
+        arguments = {io.open("aux/book.ll"):read("a")},
+        res = function(got)
+            return type(got) == "userdata", "userdata", type(got)
+        end,
+        err = nil
+    }, {
+        name = "invalid string",
+        arguments = {"invalid_ir"},
+        err = "[LLVM] string:1:1: error: " ..
+            "expected top-level entity\ninvalid_ir\n^\n"
+    }}
+}, {
+    func = "parse_bitcode",
+    cases = {{
+        name = "ok",
+        arguments = {io.open("aux/book.bc"):read("a")},
+        res = function(got)
+            return type(got) == "userdata", "userdata", type(got)
+        end,
+        err = nil
+    }, {
+        name = "invalid string",
+        arguments = {"invalid_bc"},
+        err = err.invalid_bc_file
+    }}
 }, {
     func = "write_bitcode",
     cases = {} -- TODO
@@ -91,4 +120,89 @@ for i, test in ipairs(tests) do
     end
 end
 
+-- lazy loading
+do -- function bodies are read on demand
+    local eager = llb.load_bitcode("aux/book.bc")
+    local lazy = llb.load_bitcode("aux/book.bc", nil, true)
+    local parsed = llb.parse_bitcode(io.open("aux/book.bc"):read("a"),
+        nil, true)
+    collectgarbage()
+    local count = 0
+    for f in eager:functions("declarations") do count = count + 1 end
+    for f in lazy:functions("declarations") do count = count - 1 end
+    assert(count == 0)
+    for name, f in pairs(eager) do
+        assert(#lazy[name]:basic_blocks() == #f:basic_blocks())
+        assert(#parsed[name]:basic_blocks() == #f:basic_blocks())
+    end
+end
+
+do -- lazy modules are written whole
+    local lazy = llb.load_bitcode("aux/book.bc", nil, true)
+    local path = os.tmpname()
+    llb.write_bitcode(lazy, path)
+    local written = llb.load_bitcode(path)
+    os.remove(path)
+    for name, f in pairs(llb.load_bitcode("aux/book.bc")) do
+        assert(#written[name]:basic_blocks() == #f:basic_blocks())
+    end
+end
+
+-- batch
+do -- results and errors are indexed like the paths
+    local paths = {"aux/book.bc", "aux/loop.ll", "notafile.bc", "aux/ssa.ll"}
+    local res, err = llb.batch(paths, function(module, path)
+        local blocks = {}
+        for name, f in pairs(module) do blocks[name] = #f:basic_blocks() end
+        return {path = path, blocks = blocks}
+    end, 2)
+    assert(res[1].path == "aux/book.bc" and res[1].blocks.main == 8)
+    assert(res[2].path == "aux/loop.ll" and res[2].blocks.f == 6)
+    assert(res[3] == nil and err[3] == "[LLVM] No such file or directory")
+    assert(res[4].blocks.sum ~= nil)
+    assert(err[1] == nil and err[2] == nil and err[4] == nil)
+end
+
+do -- scripts as source
+    local res, err = llb.batch({"aux/loop.ll"}, "return select(2, ...)")
+    assert(res[1] == "aux/loop.ll")
+    res, err = llb.batch({"aux/loop.ll", "aux/ssa.ll"}, "error(", 1)
+    assert(err[1] ~= nil and err[1] == err[2])
+end
+
+do -- functions must be lua functions without upvalues
+    local tag = "tag"
+    local ok, msg = pcall(llb.batch, {"aux/loop.ll"}, function()
+        return tag
+    end)
+    assert(not ok and msg:find("upvalues"))
+    ok, msg = pcall(llb.batch, {"aux/loop.ll"}, print)
+    assert(not ok and msg:find("lua function"))
+    local res = llb.batch({"aux/loop.ll"}, function() return type(print) end)
+    assert(res[1] == "function")
+end
+
+do -- only plain values are copied back
+    local res, err = llb.batch({"aux/loop.ll"}, "return print")
+    assert(res[1] == nil and err[1] == "cannot serialize a function")
+end
+
+-- stats
+do -- phases and calls are recorded until reset
+    llb.stats(true)
+    local module = llb.load_ir("aux/ssa.ll")
+    module.sum:prunedssa(llb.get_builder(module))
+    local stats = llb.stats(true)
+    if stats.enabled then
+        assert(stats.timers["prunedssa.mapinstructions"] > 0)
+        assert(stats.timers.idom > 0)
+        assert(stats.counters["calls.function.basic_blocks"] == 1)
+        assert(stats.counters["calls.basicblock.replace_between"] > 0)
+        assert(stats.counters["objects.new"] > 0)
+    end
+    stats = llb.stats()
+    assert(stats.counters["calls.function.basic_blocks"] == nil)
+    assert(stats.timers["prunedssa.mapinstructions"] == nil)
+end
+
 testing.ok()
@@ -24,9 +24,154 @@ local llb = require "llb"
 testing.header("module.h")
 
 -- new
+do -- modules share the default context
+    local a = llb.load_ir("aux/simple.ll")
+    local b = llb.load_bitcode("aux/book.bc")
+    assert(a:context() == llb.default_context())
+    assert(b:context() == a:context())
+end
+
+do -- modules loaded in a context
+    local ctx = llb.context()
+    local a = llb.load_ir("aux/simple.ll", ctx)
+    local b = llb.load_bitcode("aux/book.bc", ctx)
+    assert(a:context() == ctx and b:context() == ctx)
+    assert(ctx ~= llb.default_context())
+    assert(ctx:module_count() == 2)
+    assert(llb.load_ir("aux/invalid.ll", ctx) == nil)
+    assert(ctx:module_count() == 2)
+end
+
 -- dispose
+do -- the context lives until its last module is disposed
+    local ctx = llb.context()
+    local a = llb.load_ir("aux/simple.ll", ctx)
+    local b = llb.load_ir("aux/loop.ll", ctx)
+    ctx:dispose()
+    assert(not pcall(llb.load_ir, "aux/simple.ll", ctx))
+    assert(ctx:module_count() == 2)
+    llb.dispose(a)
+    llb.dispose(a)
+    assert(ctx:module_count() == 1)
+    assert(tostring(b.f) == "f")
+    llb.dispose(b)
+    assert(ctx:module_count() == 0)
+end
+
+do -- disposing the default context makes a new default
+    local ctx = llb.default_context()
+    local a = llb.load_ir("aux/simple.ll")
+    ctx:dispose()
+    assert(tostring(a.main) == "main")
+    local b = llb.load_ir("aux/simple.ll")
+    assert(b:context() == llb.default_context())
+    assert(b:context() ~= ctx and a:context() == ctx)
+end
+
 -- pairs
+do -- empty module
+    local module = llb.load_ir("aux/empty.ll")
+    for _ in pairs(module) do assert(false) end
+    for _ in module:functions() do assert(false) end
+end
+
+do -- every function is visited once, in module order
+    local module = llb.load_ir("aux/simple.ll")
+    local names = {}
+    for name, f in pairs(module) do
+        assert(f == module:get_function(name))
+        names[#names + 1] = name
+    end
+    assert(#names == 2)
+    assert(names[1] == "printf" and names[2] == "main")
+end
+
+-- functions
+do -- filters
+    local module = llb.load_ir("aux/simple.ll")
+    local function collect(filter)
+        local fs = {}
+        for f in module:functions(filter) do fs[#fs + 1] = f end
+        return fs
+    end
+    assert(#collect() == 2)
+    assert(#collect("all") == 2)
+    local definitions = collect("definitions")
+    assert(#definitions == 1 and definitions[1] == module.main)
+    local declarations = collect("declarations")
+    assert(#declarations == 1 and declarations[1] == module.printf)
+    assert(not pcall(module.functions, module, "nothing"))
+end
+
 -- index
+do -- methods and functions
+    local module = llb.load_ir("aux/simple.ll")
+    assert(type(module.functions) == "function")
+    assert(module.main == module:get_function("main"))
+    assert(module.nothing == nil)
+    assert(module:get_function("functions") == nil)
+end
+
+-- to_bitcode
+do -- round trip through a string and a file
+    local module = llb.load_ir("aux/simple.ll")
+    local bc = module:to_bitcode()
+    assert(bc:sub(1, 2) == "BC")
+    assert(llb.parse_bitcode(bc):to_ir():find("define void @main", 1, true))
+    local file = io.tmpfile()
+    assert(module:to_bitcode(file) == file)
+    file:seek("set")
+    assert(file:read("a") == bc)
+    file:close()
+    assert(not pcall(module.to_bitcode, module, file))
+end
+
+-- to_ir
+do -- module and function IR
+    local module = llb.load_ir("aux/loop.ll")
+    local ir = module:to_ir()
+    assert(llb.parse_ir(ir).f:to_ir() == module.f:to_ir())
+    assert(ir:find(module.f:to_ir(), 1, true))
+    local file = io.tmpfile()
+    assert(module:to_ir(file) == file)
+    assert(module.f:to_ir(file) == file)
+    file:write("; end\n")
+    file:seek("set")
+    assert(file:read("a") == ir .. module.f:to_ir() .. "; end\n")
+    file:close()
+
+    -- write errors are returned as by file:write
+    local name = os.tmpname()
+    io.open(name, "w"):close()
+    file = io.open(name, "r")
+    assert(module:to_ir(file) == nil)
+    assert(module.f:to_ir(file) == nil)
+    assert(module:to_bitcode(file) == nil)
+    file:close()
+    os.remove(name)
+end
+
+do -- lazy modules are materialized
+    local lazy = llb.load_bitcode("aux/book.bc", nil, true)
+    assert(lazy:to_ir() == llb.load_bitcode("aux/book.bc"):to_ir())
+end
+
 -- tostring
 
+do -- find
+    local module = llb.load_bitcode("aux/book.bc", nil, true)
+    local calls = module:find("call")
+    local byfunction = module:find({"call"}, "function")
+    local n = 0
+    for f, instructions in pairs(byfunction) do
+        assert(module:get_function(tostring(f)) == f)
+        for _, call in ipairs(instructions) do
+            assert(call:opcode() == llb.opcodes.call)
+            n = n + 1
+        end
+    end
+    assert(n == #calls)
+    assert(#module:find({"ret"}) == #module:find({"ret"}, "opcode").ret)
+end
+
 testing.ok()